@@ -0,0 +1,168 @@
+#version 460 core
+
+// InstanceCuller::Cull: one workgroup per draw, which keeps the visible ones of the draw's candidates in their order.
+// The arithmetic is written out and precise so it rounds the way InstanceCuller::CullCPU does
+
+layout(local_size_x = 256) in;
+
+struct InstanceData
+{
+  mat4 model;
+  vec4 color;
+  vec3 glow;
+  uint flags;
+};
+
+struct DrawCommand
+{
+  uint count;
+  uint instanceCount;
+  uint firstIndex;
+  int baseVertex;
+  uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Instances { InstanceData instances[]; };
+layout(std430, binding = 1) readonly buffer Candidates { uint candidates[]; };
+layout(std430, binding = 2) readonly buffer Bounds { vec4 bounds[]; };
+layout(std430, binding = 3) buffer Draws { DrawCommand draws[]; };
+layout(std430, binding = 4) writeonly buffer DrawOrder { uint drawOrder[]; };
+
+// max depth pyramid of the previous frame
+layout(binding = 0) uniform sampler2D s_pyramid;
+
+uniform vec4 u_planes[6];
+uniform bool u_occlusion;
+uniform mat4 u_depthViewProj;
+uniform ivec2 u_depthSize;
+uniform int u_depthLevels;
+
+const uint instanceVisible = 1;
+
+shared uint s_sums[gl_WorkGroupSize.x];
+
+vec4 Transform(mat4 m, vec4 v)
+{
+  precise vec4 result = m[0] * v.x + m[1] * v.y + m[2] * v.z + m[3] * v.w;
+  return result;
+}
+
+// whether the box around the sphere was behind the pyramid's depth everywhere it covered
+bool Occluded(vec3 center, float radius)
+{
+  vec2 lo = vec2(1e30);
+  vec2 hi = vec2(-1e30);
+  float nearest = 1e30;
+  for (int i = 0; i < 8; i++)
+  {
+    precise vec3 corner = center + radius * vec3((i & 1) != 0 ? 1 : -1, (i & 2) != 0 ? 1 : -1, (i & 4) != 0 ? 1 : -1);
+    const vec4 clip = Transform(u_depthViewProj, vec4(corner, 1));
+    if (clip.w <= 0)
+    {
+      // reaches behind the viewer
+      return false;
+    }
+    precise vec3 ndc = clip.xyz / clip.w;
+    lo = min(lo, ndc.xy);
+    hi = max(hi, ndc.xy);
+    nearest = min(nearest, ndc.z);
+  }
+  if (hi.x < -1 || hi.y < -1 || lo.x > 1 || lo.y > 1)
+  {
+    // the depth has nothing on it
+    return false;
+  }
+
+  // the pixels it covered, then the first level where they fit in 2x2 texels
+  const vec2 size = vec2(u_depthSize);
+  const ivec2 last = u_depthSize - 1;
+  precise vec2 uv0 = clamp(lo * 0.5 + 0.5, 0.0, 1.0) * size;
+  precise vec2 uv1 = clamp(hi * 0.5 + 0.5, 0.0, 1.0) * size;
+  const ivec2 p0 = min(ivec2(floor(uv0)), last);
+  const ivec2 p1 = min(ivec2(floor(uv1)), last);
+  int level = 0;
+  while (level + 1 < u_depthLevels && ((p1.x >> level) - (p0.x >> level) > 1 || (p1.y >> level) - (p0.y >> level) > 1))
+  {
+    level++;
+  }
+
+  // the last texel of a level also covers the odd row or column of the level before
+  const ivec2 levelSize = max(u_depthSize >> level, ivec2(1));
+  const ivec2 t0 = min(p0 >> level, levelSize - 1);
+  const ivec2 t1 = min(p1 >> level, levelSize - 1);
+  float farthest = 0;
+  for (int y = t0.y; y <= t1.y; y++)
+  {
+    for (int x = t0.x; x <= t1.x; x++)
+    {
+      farthest = max(farthest, texelFetch(s_pyramid, ivec2(x, y), level).r);
+    }
+  }
+  return nearest > farthest;
+}
+
+bool Visible(uint slot, vec4 sphere)
+{
+  const InstanceData instance = instances[slot];
+  if ((instance.flags & instanceVisible) == 0)
+  {
+    return false;
+  }
+
+  // the largest scale of any axis keeps the sphere around the mesh
+  const mat4 model = instance.model;
+  const vec3 center = Transform(model, vec4(sphere.xyz, 1)).xyz;
+  precise float scale0 = model[0].x * model[0].x + model[0].y * model[0].y + model[0].z * model[0].z;
+  precise float scale1 = model[1].x * model[1].x + model[1].y * model[1].y + model[1].z * model[1].z;
+  precise float scale2 = model[2].x * model[2].x + model[2].y * model[2].y + model[2].z * model[2].z;
+  precise float radius = sphere.w * sqrt(max(max(scale0, scale1), scale2));
+  for (int i = 0; i < 6; i++)
+  {
+    precise float distance = u_planes[i].x * center.x + u_planes[i].y * center.y + u_planes[i].z * center.z + u_planes[i].w;
+    if (distance < -radius)
+    {
+      return false;
+    }
+  }
+  return !u_occlusion || !Occluded(center, radius);
+}
+
+void main()
+{
+  const uint draw = gl_WorkGroupID.x;
+  const uint thread = gl_LocalInvocationID.x;
+  const uint base = draws[draw].baseInstance;
+  const uint count = draws[draw].instanceCount;
+  const vec4 sphere = bounds[draw];
+
+  // a chunk of candidates at a time, each visible one goes after the visible ones before it
+  uint written = 0;
+  for (uint start = 0; start < count; start += gl_WorkGroupSize.x)
+  {
+    const uint i = start + thread;
+    const uint slot = i < count ? candidates[base + i] : 0;
+    const bool visible = i < count && Visible(slot, sphere);
+
+    s_sums[thread] = visible ? 1 : 0;
+    barrier();
+    for (uint offset = 1; offset < gl_WorkGroupSize.x; offset *= 2)
+    {
+      const uint add = thread >= offset ? s_sums[thread - offset] : 0;
+      barrier();
+      s_sums[thread] += add;
+      barrier();
+    }
+
+    if (visible)
+    {
+      drawOrder[base + written + s_sums[thread] - 1] = slot;
+    }
+    written += s_sums[gl_WorkGroupSize.x - 1];
+    barrier();
+  }
+
+  if (thread == 0)
+  {
+    draws[draw].instanceCount = written;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#version 460 core
+
+// pipe model, second pass of GridEroder::Step: moves the water, derives its velocity and erodes or deposits
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(std430, binding = 0) readonly buffer Terrain { float terrain[]; };
+layout(std430, binding = 1) buffer Water { float water[]; };
+layout(std430, binding = 2) readonly buffer FluxL { float fluxL[]; };
+layout(std430, binding = 3) readonly buffer FluxR { float fluxR[]; };
+layout(std430, binding = 4) readonly buffer FluxT { float fluxT[]; };
+layout(std430, binding = 5) readonly buffer FluxB { float fluxB[]; };
+layout(std430, binding = 6) buffer Sediment { float sediment[]; };
+layout(std430, binding = 7) writeonly buffer VelX { float velX[]; };
+layout(std430, binding = 8) writeonly buffer VelY { float velY[]; };
+layout(std430, binding = 9) writeonly buffer TerrainOut { float terrainOut[]; };
+
+uniform uint u_width;
+uniform uint u_height;
+uniform uint u_pitch;
+uniform float u_timeStep;
+uniform float u_rainRate;
+uniform float u_sedimentCapacity;
+uniform float u_dissolveRate;
+uniform float u_depositRate;
+uniform float u_minTilt;
+uniform float u_maxErosionDepth;
+
+void main()
+{
+  const uvec2 cell = gl_GlobalInvocationID.xy;
+  if (cell.x >= u_width || cell.y >= u_height)
+  {
+    return;
+  }
+
+  const float dt = u_timeStep;
+  const float rain = dt * u_rainRate;
+  const float maxSpeed = 1 / dt;
+
+  const uint i = cell.x + cell.y * u_pitch;
+  const uint l = cell.x > 0 ? i - 1 : i;
+  const uint r = cell.x + 1 < u_width ? i + 1 : i;
+  const uint t = cell.y > 0 ? i - u_pitch : i;
+  const uint b = cell.y + 1 < u_height ? i + u_pitch : i;
+
+  // flows coming in from the neighbors, zero beyond the border
+  const float inL = cell.x > 0 ? fluxR[l] : 0.0;
+  const float inR = cell.x + 1 < u_width ? fluxL[r] : 0.0;
+  const float inT = cell.y > 0 ? fluxB[t] : 0.0;
+  const float inB = cell.y + 1 < u_height ? fluxT[b] : 0.0;
+
+  const float outflow = fluxL[i] + fluxR[i] + fluxT[i] + fluxB[i];
+  const float inflow = inL + inR + inT + inB;
+  const float d1 = water[i] + rain;
+  const float d2 = max(d1 + dt * (inflow - outflow), 0.0);
+
+  // velocity from the net flow through the cell over the average water depth
+  const float depth = max((d1 + d2) * 0.5, 1e-4);
+  float u = (inL - fluxL[i] + fluxR[i] - inR) * 0.5 / depth;
+  float v = (inT - fluxT[i] + fluxB[i] - inB) * 0.5 / depth;
+
+  // thin films can report huge velocities; the sediment backtrace must not skip more than a cell per step
+  const float speed = sqrt(u * u + v * v);
+  const float speedScale = min(1.0, maxSpeed / max(speed, 1e-12));
+  u *= speedScale;
+  v *= speedScale;
+
+  // steeper and faster flow can hold more sediment
+  const float gx = (terrain[r] - terrain[l]) * 0.5;
+  const float gy = (terrain[b] - terrain[t]) * 0.5;
+  const float slope2 = gx * gx + gy * gy;
+  const float sinTilt = max(sqrt(slope2 / (1 + slope2)), u_minTilt);
+  const float depthScale = min(d2 / u_maxErosionDepth, 1.0);
+  const float capacity = u_sedimentCapacity * sinTilt * speed * speedScale * depthScale;
+
+  const float excess = capacity - sediment[i];
+  const float rate = excess > 0 ? u_dissolveRate : u_depositRate;
+  const float change = dt * rate * excess;
+
+  terrainOut[i] = terrain[i] - change;
+  sediment[i] += change;
+  water[i] = d2;
+  velX[i] = u;
+  velY[i] = v;
+}
\ No newline at end of file
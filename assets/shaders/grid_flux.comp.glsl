@@ -0,0 +1,54 @@
+#version 460 core
+
+// pipe model, first pass of GridEroder::Step: outflow of every cell towards its four neighbors
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(std430, binding = 0) readonly buffer Terrain { float terrain[]; };
+layout(std430, binding = 1) readonly buffer Water { float water[]; };
+layout(std430, binding = 2) buffer FluxL { float fluxL[]; };
+layout(std430, binding = 3) buffer FluxR { float fluxR[]; };
+layout(std430, binding = 4) buffer FluxT { float fluxT[]; };
+layout(std430, binding = 5) buffer FluxB { float fluxB[]; };
+
+uniform uint u_width;
+uniform uint u_height;
+uniform uint u_pitch;
+uniform float u_timeStep;
+uniform float u_rainRate;
+uniform float u_pipeArea;
+uniform float u_gravity;
+
+void main()
+{
+  const uvec2 cell = gl_GlobalInvocationID.xy;
+  if (cell.x >= u_width || cell.y >= u_height)
+  {
+    return;
+  }
+
+  const float dt = u_timeStep;
+  const float k = dt * u_pipeArea * u_gravity;
+  const float rain = dt * u_rainRate;
+
+  // neighbors beyond the border are the cell itself, which gives them no head difference and thus no flow
+  const uint i = cell.x + cell.y * u_pitch;
+  const uint l = cell.x > 0 ? i - 1 : i;
+  const uint r = cell.x + 1 < u_width ? i + 1 : i;
+  const uint t = cell.y > 0 ? i - u_pitch : i;
+  const uint b = cell.y + 1 < u_height ? i + u_pitch : i;
+
+  const float h = terrain[i] + water[i];
+  const float outL = max(0.0, fluxL[i] + k * (h - terrain[l] - water[l]));
+  const float outR = max(0.0, fluxR[i] + k * (h - terrain[r] - water[r]));
+  const float outT = max(0.0, fluxT[i] + k * (h - terrain[t] - water[t]));
+  const float outB = max(0.0, fluxB[i] + k * (h - terrain[b] - water[b]));
+
+  // never let more water leave than the cell holds
+  const float total = (outL + outR + outT + outB) * dt;
+  const float scale = min(1.0, (water[i] + rain) / max(total, 1e-12));
+  fluxL[i] = outL * scale;
+  fluxR[i] = outR * scale;
+  fluxT[i] = outT * scale;
+  fluxB[i] = outB * scale;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#version 460 core
+
+// pipe model, last pass of GridEroder::Step: carries the sediment along with the water and evaporates some water
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(std430, binding = 1) buffer Water { float water[]; };
+layout(std430, binding = 6) readonly buffer Sediment { float sediment[]; };
+layout(std430, binding = 7) readonly buffer VelX { float velX[]; };
+layout(std430, binding = 8) readonly buffer VelY { float velY[]; };
+layout(std430, binding = 10) writeonly buffer SedimentOut { float sedimentOut[]; };
+
+uniform uint u_width;
+uniform uint u_height;
+uniform uint u_pitch;
+uniform float u_timeStep;
+uniform float u_evaporationRate;
+
+void main()
+{
+  const uvec2 cell = gl_GlobalInvocationID.xy;
+  if (cell.x >= u_width || cell.y >= u_height)
+  {
+    return;
+  }
+
+  const float dt = u_timeStep;
+  const float evaporation = max(1 - u_evaporationRate * dt, 0.0);
+  const uint i = cell.x + cell.y * u_pitch;
+
+  // semi-Lagrangian: take the sediment from where the water came from
+  const float px = clamp(float(cell.x) - velX[i] * dt, 0.0, float(u_width - 1));
+  const float py = clamp(float(cell.y) - velY[i] * dt, 0.0, float(u_height - 1));
+  const uint x0 = uint(px);
+  const uint y0 = uint(py);
+  const uint x1 = min(x0 + 1, u_width - 1);
+  const uint y1 = min(y0 + 1, u_height - 1);
+  const float fx = px - x0;
+  const float fy = py - y0;
+
+  const uint row0 = y0 * u_pitch;
+  const uint row1 = y1 * u_pitch;
+  sedimentOut[i] = (sediment[row0 + x0] * (1 - fx) + sediment[row0 + x1] * fx) * (1 - fy) + (sediment[row1 + x0] * (1 - fx) + sediment[row1 + x1] * fx) * fy;
+  water[i] *= evaporation;
+}
\ No newline at end of file
@@ -1,5 +1,8 @@
 #version 460 core
 
+uniform vec3 u_sunDir;
+uniform float u_blendDay;
+
 in VS_OUT
 {
   vec3 position;
@@ -11,5 +14,18 @@ out vec4 fragColor;
 
 void main()
 {
-  fragColor = vec4(fs_in.uv, 0, 1);
+  vec3 sunDay = vec3(1);
+  vec3 sunNight = vec3(0.3);
+  vec3 sun = mix(sunNight, sunDay, u_blendDay);
+
+  vec3 N = normalize(fs_in.normal);
+  float NoL = max(0.0, dot(N, -u_sunDir));
+
+  // flat ground is grassy, slopes steeper than about 30 degrees are bare rock
+  vec3 grass = vec3(0.30, 0.42, 0.18);
+  vec3 rock = vec3(0.45, 0.40, 0.36);
+  vec3 diffuse = mix(grass, rock, 1.0 - smoothstep(0.8, 0.9, N.y));
+
+  vec3 lit = clamp(min(u_blendDay, 0.9) * diffuse * NoL * sun + diffuse * sun * 0.15, vec3(0), vec3(1));
+  fragColor = vec4(lit, 1);
 }
\ No newline at end of file
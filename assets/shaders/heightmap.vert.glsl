@@ -5,7 +5,26 @@ uniform mat4 u_model;
 uniform uint u_width;
 uniform uint u_height;
 
+uniform uint u_patchSize;
+uniform vec2 u_viewPos;           // x and z in model space
+uniform float u_viewHeight;       // the viewer's height above the terrain, the vertical part of every LOD distance
+uniform vec2 u_morphRanges[16];   // per level, the distances over which its vertices morph into the next level's
+
 layout(binding = 0) uniform sampler2D s_heightmap;
+layout(binding = 1) uniform sampler2D s_normals;   // the height gradient per texel, in heights per texel
+
+struct TerrainNode
+{
+  uvec2 origin;   // texel of the node's corner
+  uint level;     // the node's quads are 2^level texels wide
+  uint padding;
+};
+
+// the quadtree nodes being drawn, one per instance starting at the draw's base instance
+layout(std430, binding = 0) readonly buffer TerrainNodes
+{
+  TerrainNode nodes[];
+};
 
 out VS_OUT
 {
@@ -14,33 +33,32 @@ out VS_OUT
   vec2 uv;
 }vs_out;
 
-// counterclockwise from bottom right texture coordinates
-const vec2 tex_corners[] =
-{
-  { 1, 0 },
-  { 1, 1 },
-  { 0, 1 },
-  { 0, 0 },
-};
-const uint indices[6] = { 3, 1, 0, 2, 1, 3 };
-
 void main()
 {
-  uint quadIndex = gl_VertexID / 6;
-  uint vertexIndex = gl_VertexID % 6;
-  vec2 trianglePos = vec2(quadIndex % u_width, quadIndex / u_width);
+  TerrainNode node = nodes[gl_BaseInstance + gl_InstanceID];
+  vec2 mapSize = vec2(u_width, u_height);
+  float scale = float(1u << node.level);
+
+  // the patch's vertex IDs are y * (u_patchSize + 1) + x. Nodes hanging over the edge of the map are clamped to it,
+  // which collapses their extra triangles
+  uvec2 patchPos = uvec2(gl_VertexID % (u_patchSize + 1), gl_VertexID / (u_patchSize + 1));
+  vec2 corner = min(vec2(node.origin) + vec2(patchPos) * scale, mapSize);
+  vec2 uv = corner / mapSize;
+  float distanceToView = length(vec3(uv - 0.5 - u_viewPos, u_viewHeight));
 
-  vec3 aPosition = vec3(trianglePos.x, 0, trianglePos.y);
-  aPosition.xz += tex_corners[indices[vertexIndex]];
-  aPosition.xz /= vec2(u_width, u_height);
-  aPosition.xz -= 0.5;
+  // vertices on odd rows and columns of the level's grid slide onto their even neighbors as the node nears the end
+  // of its range, so by then it has turned into the next level's patch and meets those nodes without cracks
+  vec2 morphRange = u_morphRanges[node.level];
+  float morph = clamp((distanceToView - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+  uvec2 gridPos = (node.origin >> node.level) + patchPos;
+  corner = min(vec2(node.origin) + (vec2(patchPos) - vec2(gridPos & 1u) * morph) * scale, mapSize);
+  uv = corner / mapSize;
 
-  vec3 aNormal = vec3(0, 1, 0);
-  vec2 uv = tex_corners[indices[vertexIndex]] + trianglePos;
-  uv /= vec2(u_width, u_height);
+  vec3 aPosition = vec3(uv.x - 0.5, textureLod(s_heightmap, uv, 0).r, uv.y - 0.5);
 
-  aPosition.y = textureLod(s_heightmap, uv, 0).r;
-  //aPosition.y = uv.y;
+  // the gradient is per texel and a texel is 1 / mapSize across in model space
+  vec2 gradient = textureLod(s_normals, uv, 0).rg * mapSize;
+  vec3 aNormal = normalize(vec3(-gradient.x, 1.0, -gradient.y));
 
   vs_out.position = (u_model * vec4(aPosition, 1.0)).xyz;
   vs_out.normal = normalize((u_model * vec4(aNormal, 0.0)).xyz);
@@ -0,0 +1,42 @@
+#version 460 core
+
+// one level of InstanceCuller's depth pyramid. Level 0 copies the depth buffer, every other level keeps the farthest
+// depth of the texels it covers in the level before. A level's last row and column also cover the odd row or column
+// the level before has left over
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D s_depth;
+layout(binding = 1) uniform sampler2D s_pyramid;
+layout(r32f, binding = 0) uniform writeonly image2D i_level;
+
+uniform int u_level;
+
+void main()
+{
+  const ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  const ivec2 size = imageSize(i_level);
+  if (texel.x >= size.x || texel.y >= size.y)
+  {
+    return;
+  }
+
+  if (u_level == 0)
+  {
+    imageStore(i_level, texel, vec4(texelFetch(s_depth, texel, 0).r));
+    return;
+  }
+
+  const ivec2 sourceSize = textureSize(s_pyramid, u_level - 1);
+  const ivec2 lo = 2 * texel;
+  const ivec2 hi = mix(lo + 1, sourceSize - 1, equal(texel, size - 1));
+  float depth = 0;
+  for (int y = lo.y; y <= hi.y; y++)
+  {
+    for (int x = lo.x; x <= hi.x; x++)
+    {
+      depth = max(depth, texelFetch(s_pyramid, ivec2(x, y), u_level - 1).r);
+    }
+  }
+  imageStore(i_level, texel, vec4(depth));
+}
\ No newline at end of file
@@ -2,14 +2,14 @@
 
 uniform vec3 u_sunDir;
 uniform float u_blendDay;
-uniform vec4 u_color;
-uniform vec3 u_glow;
 
 in VS_OUT
 {
     vec3 vPosition;
     vec3 vNormal;
     vec2 vTexcoord;
+    flat vec4 vColor;
+    flat vec3 vGlow;
 }fs_in;
 
 out vec4 fragColor;
@@ -21,7 +21,7 @@ vec3 faceNormal(vec3 wPos)
 
 vec4 GetDiffuse()
 {
-    return u_color;
+    return fs_in.vColor;
 }
 
 void main()
@@ -43,8 +43,8 @@ void main()
 
     vec3 lit = sunLit + groundLit;
 
-    vec3 finalColor = u_glow + lit + (0.04 * (N * 0.5 + 0.5));
+    vec3 finalColor = fs_in.vGlow + lit + (0.04 * (N * 0.5 + 0.5));
 
-    if (u_color.a < 0.01) discard;
-    fragColor = vec4(finalColor, u_color.a);
+    if (fs_in.vColor.a < 0.01) discard;
+    fragColor = vec4(finalColor, fs_in.vColor.a);
 }
\ No newline at end of file
@@ -5,20 +5,44 @@ layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexcoord;
 
 uniform mat4 u_viewProj;
-uniform mat4 u_model;
+
+struct InstanceData
+{
+    mat4 model;
+    vec4 color;
+    vec3 glow;
+    uint flags;
+};
+
+// the objects in the order they were submitted
+layout(std430, binding = 0) readonly buffer Instances
+{
+    InstanceData instances[];
+};
+
+// indices of the objects being drawn, grouped by mesh. Each draw's objects start at its base instance
+layout(std430, binding = 1) readonly buffer DrawOrder
+{
+    uint drawOrder[];
+};
 
 out VS_OUT
 {
     vec3 vPosition;
     vec3 vNormal;
     vec2 vTexcoord;
+    flat vec4 vColor;
+    flat vec3 vGlow;
 }vs_out;
 
 void main()
 {
-    vs_out.vPosition = (u_model * vec4(aPosition, 1.0)).xyz;
-    vs_out.vNormal = (u_model * vec4(aNormal, 0.0)).xyz;
+    InstanceData instance = instances[drawOrder[gl_BaseInstance + gl_InstanceID]];
+    vs_out.vPosition = (instance.model * vec4(aPosition, 1.0)).xyz;
+    vs_out.vNormal = (instance.model * vec4(aNormal, 0.0)).xyz;
     vs_out.vTexcoord = aTexcoord;
+    vs_out.vColor = instance.color;
+    vs_out.vGlow = instance.glow;
 
     gl_Position = u_viewProj * vec4(vs_out.vPosition, 1.0);
 }
\ No newline at end of file
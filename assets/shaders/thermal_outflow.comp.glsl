@@ -0,0 +1,45 @@
+#version 460 core
+
+// first pass of ThermalEroder::Step: how much of its excess over each lower neighbor a cell sheds
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(std430, binding = 0) readonly buffer Terrain { float terrain[]; };
+layout(std430, binding = 11) writeonly buffer Outflow { float outflow[]; };
+
+uniform uint u_width;
+uniform uint u_height;
+uniform uint u_pitch;
+uniform float u_talus;
+uniform float u_talusDiag;
+uniform float u_rate;
+
+// same order as the CPU stencil, so the sums round the same way
+const ivec2 offsets[8] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 }, { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+
+void main()
+{
+  const ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+  if (cell.x >= u_width || cell.y >= u_height)
+  {
+    return;
+  }
+
+  const float c = terrain[cell.x + cell.y * u_pitch];
+  float largest = 0;
+  float total = 0;
+  for (int n = 0; n < 8; n++)
+  {
+    const ivec2 neighbor = cell + offsets[n];
+    if (neighbor.x < 0 || neighbor.y < 0 || neighbor.x >= u_width || neighbor.y >= u_height)
+    {
+      continue;
+    }
+    const float e = max(c - terrain[neighbor.x + neighbor.y * u_pitch] - (n >= 4 ? u_talusDiag : u_talus), 0.0);
+    largest = max(largest, e);
+    total += e;
+  }
+
+  // shed a fraction of half the largest excess, so a cell never ends up below the neighbor it fed
+  outflow[cell.x + cell.y * u_pitch] = u_rate * 0.5 * largest / max(total, 1e-30);
+}
\ No newline at end of file
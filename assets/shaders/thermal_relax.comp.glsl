@@ -0,0 +1,45 @@
+#version 460 core
+
+// second pass of ThermalEroder::Step: every cell loses what it sheds and gathers what its neighbors shed into it
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(std430, binding = 0) readonly buffer Terrain { float terrain[]; };
+layout(std430, binding = 9) writeonly buffer TerrainOut { float terrainOut[]; };
+layout(std430, binding = 11) readonly buffer Outflow { float outflow[]; };
+
+uniform uint u_width;
+uniform uint u_height;
+uniform uint u_pitch;
+uniform float u_talus;
+uniform float u_talusDiag;
+
+const ivec2 offsets[8] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 }, { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+
+void main()
+{
+  const ivec2 cell = ivec2(gl_GlobalInvocationID.xy);
+  if (cell.x >= u_width || cell.y >= u_height)
+  {
+    return;
+  }
+
+  const int i = cell.x + cell.y * int(u_pitch);
+  const float c = terrain[i];
+  float shed = 0;
+  float gained = 0;
+  for (int n = 0; n < 8; n++)
+  {
+    const ivec2 neighbor = cell + offsets[n];
+    if (neighbor.x < 0 || neighbor.y < 0 || neighbor.x >= u_width || neighbor.y >= u_height)
+    {
+      continue;
+    }
+    const int j = neighbor.x + neighbor.y * int(u_pitch);
+    const float talus = n >= 4 ? u_talusDiag : u_talus;
+    shed += max(c - terrain[j] - talus, 0.0);
+    gained += outflow[j] * max(terrain[j] - c - talus, 0.0);
+  }
+
+  terrainOut[i] = c - outflow[i] * shed + gained;
+}
\ No newline at end of file
@@ -0,0 +1,587 @@
+#include <iostream>
+#include <fstream>
+#include <format>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <map>
+#include <tuple>
+#include <limits>
+#include <cstdint>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "sim/erosion.h"
+
+namespace
+{
+  // one fixed configuration of the simulation, run for a number of updates from the same initial terrain
+  struct Scenario
+  {
+    uint32_t size{};
+    Erosion::ErosionMode mode{};
+    Erosion::DropletBackend backend{};   // the one that actually runs, droplet mode only
+    uint32_t threads{};
+    uint32_t droplets{};                 // per update, droplet mode only
+    uint32_t updates{};
+
+    [[nodiscard]] std::string Name() const
+    {
+      if (mode == Erosion::ErosionMode::GRID)
+      {
+        return std::format("grid/{}/t{}", size, threads);
+      }
+      return std::format("droplet/{}/{}/d{}/t{}", size, Erosion::ToString(backend), droplets, threads);
+    }
+  };
+
+  struct Result
+  {
+    Scenario scenario;
+    double initSeconds{};
+    double seconds{};         // all timed updates
+    double bestUpdate{};      // fastest single update
+    Erosion::SimulationStats stats;
+    uint64_t peakRss{};       // bytes
+    uint64_t checksum{};
+
+    [[nodiscard]] double Cells() const { return static_cast<double>(scenario.size) * scenario.size; }
+    [[nodiscard]] double CellsPerSecond() const { return Cells() * stats.updates / seconds; }
+    [[nodiscard]] double DropletsPerSecond() const { return static_cast<double>(scenario.droplets) * stats.updates / seconds; }
+    [[nodiscard]] double NsPerDropletStep() const { return stats.dropletSteps > 0 ? seconds * 1e9 / stats.dropletSteps : 0; }
+  };
+
+  struct Suite
+  {
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> droplets;
+    std::vector<Erosion::ErosionMode> modes;
+    std::vector<Erosion::DropletBackend> backends;
+    std::vector<uint32_t> threads;
+    uint32_t updates{};
+  };
+
+  uint32_t HardwareThreads()
+  {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  Suite QuickSuite()
+  {
+    return
+    {
+      .sizes = { 512, 2048 },
+      .droplets = { 65536 },
+      .modes = { Erosion::ErosionMode::DROPLET, Erosion::ErosionMode::GRID },
+      .backends = { Erosion::DropletBackend::AUTO },
+      .threads = { 1, HardwareThreads() },
+      .updates = 5,
+    };
+  }
+
+  Suite FullSuite()
+  {
+    return
+    {
+      .sizes = { 512, 1024, 2048, 4096, 8192 },
+      .droplets = { 16384, 262144 },
+      .modes = { Erosion::ErosionMode::DROPLET, Erosion::ErosionMode::GRID },
+      .backends = { Erosion::DropletBackend::SCALAR, Erosion::DropletBackend::AVX2 },
+      .threads = { 1, 2, 4, 8, HardwareThreads() },
+      .updates = 10,
+    };
+  }
+
+  std::vector<std::string_view> Split(std::string_view list)
+  {
+    std::vector<std::string_view> parts;
+    while (!list.empty())
+    {
+      const size_t comma = std::min(list.find(','), list.size());
+      parts.push_back(list.substr(0, comma));
+      list.remove_prefix(std::min(comma + 1, list.size()));
+    }
+    return parts;
+  }
+
+  std::vector<uint32_t> ParseCounts(std::string_view list)
+  {
+    std::vector<uint32_t> counts;
+    for (std::string_view part : Split(list))
+    {
+      counts.push_back(part == "all" ? HardwareThreads() : static_cast<uint32_t>(std::stoul(std::string(part))));
+    }
+    return counts;
+  }
+
+  std::vector<Erosion::ErosionMode> ParseModes(std::string_view list)
+  {
+    std::vector<Erosion::ErosionMode> modes;
+    for (std::string_view part : Split(list))
+    {
+      if (part == "droplet")
+      {
+        modes.push_back(Erosion::ErosionMode::DROPLET);
+      }
+      else if (part == "grid")
+      {
+        modes.push_back(Erosion::ErosionMode::GRID);
+      }
+      else
+      {
+        throw std::runtime_error(std::format("unknown mode '{}'", part));
+      }
+    }
+    return modes;
+  }
+
+  std::vector<Erosion::DropletBackend> ParseBackends(std::string_view list)
+  {
+    std::vector<Erosion::DropletBackend> backends;
+    for (std::string_view part : Split(list))
+    {
+      bool found = false;
+      for (auto backend : { Erosion::DropletBackend::AUTO, Erosion::DropletBackend::SCALAR, Erosion::DropletBackend::AVX2 })
+      {
+        if (part == Erosion::ToString(backend))
+        {
+          backends.push_back(backend);
+          found = true;
+        }
+      }
+      if (!found)
+      {
+        throw std::runtime_error(std::format("unknown backend '{}'", part));
+      }
+    }
+    return backends;
+  }
+
+  template<typename T>
+  void SortUnique(std::vector<T>& values)
+  {
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+  }
+
+  // scenarios whose requested backend is unavailable are left out, AUTO is resolved to the backend it picks
+  std::vector<Scenario> Expand(Suite suite)
+  {
+    SortUnique(suite.sizes);
+    SortUnique(suite.droplets);
+    SortUnique(suite.threads);
+
+    std::vector<Scenario> scenarios;
+    for (Erosion::ErosionMode mode : suite.modes)
+    {
+      for (uint32_t size : suite.sizes)
+      {
+        if (mode == Erosion::ErosionMode::GRID)
+        {
+          for (uint32_t threads : suite.threads)
+          {
+            scenarios.push_back({ size, mode, Erosion::DropletBackend::AUTO, threads, 0, suite.updates });
+          }
+          continue;
+        }
+
+        std::vector<Erosion::DropletBackend> backends;
+        for (Erosion::DropletBackend requested : suite.backends)
+        {
+          const Erosion::DropletEroder eroder({}, requested);
+          if (requested == Erosion::DropletBackend::AUTO || eroder.Backend() == requested)
+          {
+            backends.push_back(eroder.Backend());
+          }
+          else
+          {
+            std::cerr << std::format("skipping the {} backend, it is not available on this machine\n", Erosion::ToString(requested));
+          }
+        }
+        SortUnique(backends);
+
+        for (Erosion::DropletBackend backend : backends)
+        {
+          for (uint32_t droplets : suite.droplets)
+          {
+            for (uint32_t threads : suite.threads)
+            {
+              scenarios.push_back({ size, mode, backend, threads, droplets, suite.updates });
+            }
+          }
+        }
+      }
+    }
+    return scenarios;
+  }
+
+  // on Linux the peak is reset before every scenario, elsewhere it is the peak of the whole process so far
+  void ResetPeakRss()
+  {
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+  }
+
+  uint64_t PeakRss()
+  {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#elif defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);)
+    {
+      if (line.starts_with("VmHWM:"))
+      {
+        return std::stoull(line.substr(6)) * 1024;
+      }
+    }
+    return 0;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+  }
+
+  // FNV-1a over the bits of every cell, padding excluded
+  uint64_t Checksum(const Erosion::Heightfield& map)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t y = 0; y < map.height; y++)
+    {
+      const auto* bytes = reinterpret_cast<const uint8_t*>(map.Row(y));
+      for (size_t i = 0; i < map.width * sizeof(float); i++)
+      {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+      }
+    }
+    return hash;
+  }
+
+  template<typename Fn>
+  double Seconds(Fn&& fn)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  Result Run(const Scenario& scenario)
+  {
+    Erosion::SimulationCreateInfo info
+    {
+      .width = scenario.size,
+      .height = scenario.size,
+      .mode = scenario.mode,
+      .dropletBackend = scenario.backend,
+      .numThreads = scenario.threads,
+    };
+    info.droplet.dropletsPerUpdate = scenario.droplets;
+
+    // thermal erosion runs the same way in both modes and would hide the difference between them
+    info.thermal.interval = 0;
+
+    ResetPeakRss();
+    Result result;
+    result.scenario = scenario;
+    Erosion::Simulation simulation(info);
+    result.initSeconds = Seconds([&] { simulation.Init(1); });
+
+    result.bestUpdate = std::numeric_limits<double>::max();
+    for (uint32_t i = 0; i < scenario.updates; i++)
+    {
+      const double seconds = Seconds([&] { simulation.Update(1.0); });
+      result.seconds += seconds;
+      result.bestUpdate = std::min(result.bestUpdate, seconds);
+    }
+
+    result.stats = simulation.GetStats();
+    result.peakRss = PeakRss();
+    result.checksum = Checksum(simulation.GetHeightfield());
+    return result;
+  }
+
+  const char* ModeName(Erosion::ErosionMode mode)
+  {
+    return mode == Erosion::ErosionMode::GRID ? "grid" : "droplet";
+  }
+
+  std::string Compiler()
+  {
+#if defined(__clang__)
+    return std::format("clang {}.{}.{}", __clang_major__, __clang_minor__, __clang_patchlevel__);
+#elif defined(__GNUC__)
+    return std::format("gcc {}.{}.{}", __GNUC__, __GNUC_MINOR__, __GNUC_PATCHLEVEL__);
+#elif defined(_MSC_VER)
+    return std::format("msvc {}", _MSC_VER);
+#else
+    return "unknown";
+#endif
+  }
+
+  void WriteJson(std::ostream& out, const std::vector<Result>& results)
+  {
+#ifdef NDEBUG
+    const bool optimized = true;
+#else
+    const bool optimized = false;
+#endif
+    out << "{\n";
+    out << std::format("  \"machine\": {{ \"hardwareThreads\": {}, \"avx2\": {}, \"compiler\": \"{}\", \"optimized\": {} }},\n",
+      HardwareThreads(), Erosion::DropletEroder({}).Backend() == Erosion::DropletBackend::AVX2, Compiler(), optimized);
+    out << "  \"scenarios\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      const Result& r = results[i];
+      const Scenario& s = r.scenario;
+      out << std::format("    {{ \"name\": \"{}\", \"mode\": \"{}\", \"size\": {}, \"backend\": \"{}\", \"threads\": {}, \"droplets\": {}, \"updates\": {}, "
+        "\"initSeconds\": {:.6f}, \"seconds\": {:.6f}, \"bestUpdateSeconds\": {:.6f}, \"dropletSteps\": {}, \"gridSteps\": {}, "
+        "\"dropletsPerSecond\": {:.1f}, \"cellsPerSecond\": {:.1f}, \"nsPerDropletStep\": {:.3f}, \"peakRssBytes\": {}, \"checksum\": \"{:016x}\" }}{}\n",
+        s.Name(), ModeName(s.mode), s.size, s.mode == Erosion::ErosionMode::DROPLET ? Erosion::ToString(s.backend) : "", s.threads, s.droplets, s.updates,
+        r.initSeconds, r.seconds, r.bestUpdate, r.stats.dropletSteps, r.stats.gridSteps,
+        r.DropletsPerSecond(), r.CellsPerSecond(), r.NsPerDropletStep(), r.peakRss, r.checksum, i + 1 < results.size() ? "," : "");
+    }
+    out << "  ]\n}\n";
+  }
+
+  void WriteCsv(std::ostream& out, const std::vector<Result>& results)
+  {
+    out << "name,mode,size,backend,threads,droplets,updates,init_s,s,best_update_s,droplet_steps,grid_steps,droplets_per_s,cells_per_s,ns_per_droplet_step,peak_rss_bytes,checksum\n";
+    for (const Result& r : results)
+    {
+      const Scenario& s = r.scenario;
+      out << std::format("{},{},{},{},{},{},{},{:.6f},{:.6f},{:.6f},{},{},{:.1f},{:.1f},{:.3f},{},{:016x}\n",
+        s.Name(), ModeName(s.mode), s.size, s.mode == Erosion::ErosionMode::DROPLET ? Erosion::ToString(s.backend) : "", s.threads, s.droplets, s.updates,
+        r.initSeconds, r.seconds, r.bestUpdate, r.stats.dropletSteps, r.stats.gridSteps,
+        r.DropletsPerSecond(), r.CellsPerSecond(), r.NsPerDropletStep(), r.peakRss, r.checksum);
+    }
+  }
+
+  // path "-" is stdout
+  template<typename Fn>
+  void WriteReport(const std::string& path, Fn&& write)
+  {
+    if (path == "-")
+    {
+      write(std::cout);
+      return;
+    }
+
+    std::ofstream file(path);
+    if (!file)
+    {
+      throw std::runtime_error(std::format("failed to open '{}' for writing", path));
+    }
+    write(file);
+  }
+
+  void PrintUsage()
+  {
+    std::cout <<
+      "usage: bench_erosion [options]\n"
+      "  --suite S         quick (default) or full, the scenario matrix the options below start from\n"
+      "  --sizes A,B       map sizes\n"
+      "  --droplets A,B    droplets per update\n"
+      "  --modes A,B       droplet and/or grid\n"
+      "  --backends A,B    droplet kernels: auto, scalar, avx2\n"
+      "  --threads A,B     thread counts, all for every hardware thread\n"
+      "  --updates N       timed simulation updates per scenario\n"
+      "  --filter TEXT     only runs scenarios whose name contains TEXT\n"
+      "  --list            prints the scenarios without running them\n"
+      "  --json PATH       writes the results as JSON, - for stdout\n"
+      "  --csv PATH        writes the results as CSV, - for stdout\n"
+      "  --quiet           no table on stdout\n"
+      "Runs that differ only in their thread count must give the same checksum, otherwise the exit code is 1\n";
+  }
+}
+
+// runs fixed simulation scenarios and reports their throughput, see PrintUsage for the options
+auto main(int argc, char** argv) -> int
+{
+  Suite suite = QuickSuite();
+  std::string filter;
+  std::string jsonPath;
+  std::string csvPath;
+  bool list = false;
+  bool quiet = false;
+
+  try
+  {
+    // the suite comes first, so the other options can narrow it down wherever they appear
+    for (int i = 1; i + 1 < argc; i++)
+    {
+      if (std::string_view(argv[i]) == "--suite")
+      {
+        const std::string_view name = argv[i + 1];
+        if (name != "quick" && name != "full")
+        {
+          throw std::runtime_error(std::format("unknown suite '{}'", name));
+        }
+        suite = name == "full" ? FullSuite() : QuickSuite();
+      }
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+      const std::string_view arg = argv[i];
+      auto next = [&]() -> std::string
+      {
+        if (i + 1 >= argc)
+        {
+          throw std::runtime_error(std::format("missing value for {}", arg));
+        }
+        return argv[++i];
+      };
+
+      if (arg == "--suite")
+      {
+        next();
+      }
+      else if (arg == "--sizes")
+      {
+        suite.sizes = ParseCounts(next());
+      }
+      else if (arg == "--droplets")
+      {
+        suite.droplets = ParseCounts(next());
+      }
+      else if (arg == "--modes")
+      {
+        suite.modes = ParseModes(next());
+      }
+      else if (arg == "--backends")
+      {
+        suite.backends = ParseBackends(next());
+      }
+      else if (arg == "--threads")
+      {
+        suite.threads = ParseCounts(next());
+      }
+      else if (arg == "--updates")
+      {
+        suite.updates = static_cast<uint32_t>(std::stoul(next()));
+      }
+      else if (arg == "--filter")
+      {
+        filter = next();
+      }
+      else if (arg == "--list")
+      {
+        list = true;
+      }
+      else if (arg == "--json")
+      {
+        jsonPath = next();
+      }
+      else if (arg == "--csv")
+      {
+        csvPath = next();
+      }
+      else if (arg == "--quiet")
+      {
+        quiet = true;
+      }
+      else if (arg == "--help" || arg == "-h")
+      {
+        PrintUsage();
+        return 0;
+      }
+      else
+      {
+        throw std::runtime_error(std::format("unknown argument '{}'", arg));
+      }
+    }
+
+    if (std::any_of(suite.sizes.begin(), suite.sizes.end(), [](uint32_t size) { return size < 16; }) ||
+      std::any_of(suite.threads.begin(), suite.threads.end(), [](uint32_t threads) { return threads == 0; }))
+    {
+      throw std::runtime_error("sizes must be at least 16 and thread counts at least 1");
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << std::format("error: {}\n", e.what());
+    PrintUsage();
+    return 2;
+  }
+
+  std::vector<Scenario> scenarios = Expand(suite);
+  std::erase_if(scenarios, [&](const Scenario& s) { return s.Name().find(filter) == std::string::npos; });
+  if (list)
+  {
+    for (const Scenario& s : scenarios)
+    {
+      std::cout << s.Name() << "\n";
+    }
+    return 0;
+  }
+
+  try
+  {
+    if (!quiet)
+    {
+      std::cout << std::format("{:<36} {:>9} {:>9} {:>14} {:>14} {:>10} {:>9}  {}\n",
+        "scenario", "init s", "update s", "droplets/s", "cells/s", "ns/step", "peak MiB", "checksum");
+    }
+
+    std::vector<Result> results;
+    for (const Scenario& scenario : scenarios)
+    {
+      const Result& r = results.emplace_back(Run(scenario));
+      if (!quiet)
+      {
+        const bool droplet = scenario.mode == Erosion::ErosionMode::DROPLET;
+        std::cout << std::format("{:<36} {:>9.3f} {:>9.4f} {:>14} {:>14.4g} {:>10} {:>9.1f}  {:016x}\n",
+          scenario.Name(), r.initSeconds, r.seconds / std::max(scenario.updates, 1u),
+          droplet ? std::format("{:.4g}", r.DropletsPerSecond()) : "-", r.CellsPerSecond(),
+          droplet ? std::format("{:.2f}", r.NsPerDropletStep()) : "-", r.peakRss / 1048576.0, r.checksum);
+      }
+    }
+
+    if (!jsonPath.empty())
+    {
+      WriteReport(jsonPath, [&](std::ostream& out) { WriteJson(out, results); });
+    }
+    if (!csvPath.empty())
+    {
+      WriteReport(csvPath, [&](std::ostream& out) { WriteCsv(out, results); });
+    }
+
+    // every backend is only deterministic with itself, but the thread count must not change the result
+    std::map<std::tuple<uint32_t, Erosion::ErosionMode, Erosion::DropletBackend, uint32_t, uint32_t>, const Result*> reference;
+    bool ok = true;
+    for (const Result& r : results)
+    {
+      const Scenario& s = r.scenario;
+      const auto [it, inserted] = reference.try_emplace({ s.size, s.mode, s.backend, s.droplets, s.updates }, &r);
+      if (!inserted && it->second->checksum != r.checksum)
+      {
+        std::cerr << std::format("FAILED: {} gives a different result than {}\n", s.Name(), it->second->scenario.Name());
+        ok = false;
+      }
+    }
+    return ok ? 0 : 1;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << std::format("error: {}\n", e.what());
+    return 1;
+  }
+}
\ No newline at end of file
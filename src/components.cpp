@@ -1,8 +1,88 @@
 #include "components.h"
+#include "transform_kernel.h"
+#include "utility/cpu_features.h"
+#include <algorithm>
 
-glm::mat4 Transform::GetModel() const
+namespace detail
 {
-  return glm::translate(glm::mat4(1.0), position)
-    * glm::mat4_cast(rotation)
-    * glm::scale(glm::mat4(1.0), scale);
+  void ComputeModelsScalar(const TransformLanes& in, ModelLanes& out)
+  {
+    // glm::mat4_cast's rotation with its columns scaled, which is what translate * rotate * scale multiplies out to
+    for (uint32_t i = 0; i < transformLanes; i++)
+    {
+      const float w = in.qw[i];
+      const float x = in.qx[i];
+      const float y = in.qy[i];
+      const float z = in.qz[i];
+      const float xx = x * x;
+      const float yy = y * y;
+      const float zz = z * z;
+      const float xz = x * z;
+      const float xy = x * y;
+      const float yz = y * z;
+      const float wx = w * x;
+      const float wy = w * y;
+      const float wz = w * z;
+
+      out.m[0][i] = (1.0f - 2.0f * (yy + zz)) * in.sx[i];
+      out.m[1][i] = (2.0f * (xy + wz)) * in.sx[i];
+      out.m[2][i] = (2.0f * (xz - wy)) * in.sx[i];
+      out.m[3][i] = (2.0f * (xy - wz)) * in.sy[i];
+      out.m[4][i] = (1.0f - 2.0f * (xx + zz)) * in.sy[i];
+      out.m[5][i] = (2.0f * (yz + wx)) * in.sy[i];
+      out.m[6][i] = (2.0f * (xz + wy)) * in.sz[i];
+      out.m[7][i] = (2.0f * (yz - wx)) * in.sz[i];
+      out.m[8][i] = (1.0f - 2.0f * (xx + yy)) * in.sz[i];
+      out.m[9][i] = in.px[i];
+      out.m[10][i] = in.py[i];
+      out.m[11][i] = in.pz[i];
+    }
+  }
 }
+
+void UpdateModels(std::span<Transform* const> transforms)
+{
+#ifdef ENGINE_AVX2
+  const auto compute = HasAVX2() ? detail::ComputeModelsAVX2 : detail::ComputeModelsScalar;
+#else
+  const auto compute = detail::ComputeModelsScalar;
+#endif
+
+  // gathered into lanes and scattered back a batch at a time, the last batch is padded with identities
+  detail::TransformLanes in{};
+  detail::ModelLanes out;
+  for (size_t begin = 0; begin < transforms.size(); begin += detail::transformLanes)
+  {
+    const size_t count = std::min<size_t>(transforms.size() - begin, detail::transformLanes);
+    for (size_t i = 0; i < detail::transformLanes; i++)
+    {
+      const Transform* t = i < count ? transforms[begin + i] : nullptr;
+      const glm::vec3 position = t ? t->position_ : glm::vec3(0);
+      const glm::vec3 scale = t ? t->scale_ : glm::vec3(1);
+      const glm::quat rotation = t ? t->rotation_ : glm::quat(1, 0, 0, 0);
+      in.px[i] = position.x;
+      in.py[i] = position.y;
+      in.pz[i] = position.z;
+      in.sx[i] = scale.x;
+      in.sy[i] = scale.y;
+      in.sz[i] = scale.z;
+      in.qw[i] = rotation.w;
+      in.qx[i] = rotation.x;
+      in.qy[i] = rotation.y;
+      in.qz[i] = rotation.z;
+    }
+
+    compute(in, out);
+
+    for (size_t i = 0; i < count; i++)
+    {
+      Transform& t = *transforms[begin + i];
+      t.model_ = glm::mat4(
+        glm::vec4(out.m[0][i], out.m[1][i], out.m[2][i], 0.0f),
+        glm::vec4(out.m[3][i], out.m[4][i], out.m[5][i], 0.0f),
+        glm::vec4(out.m[6][i], out.m[7][i], out.m[8][i], 0.0f),
+        glm::vec4(out.m[9][i], out.m[10][i], out.m[11][i], 1.0f));
+      t.dirty_ = false;
+    }
+  }
+}
\ No newline at end of file
@@ -1,25 +1,74 @@
 #pragma once
 
 #include <cstdint>
+#include <cassert>
+#include <span>
+#include <vector>
 
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/gtx/quaternion.hpp>
 
-struct Transform
+// an object's placement. The model matrix is cached: the setters mark it dirty and UpdateModels recomputes it, so
+// objects that don't move cost nothing. A tracked transform also appends its slot to its owner's dirty list when it
+// first changes after an update, so the owner finds the moved ones without looking at the others
+class Transform
 {
-  glm::vec3 position{};
-  glm::vec3 scale{ 1 };
-  glm::quat rotation{ 1, 0, 0, 0 };
+public:
+  [[nodiscard]] const glm::vec3& GetPosition() const { return position_; }
+  [[nodiscard]] const glm::vec3& GetScale() const { return scale_; }
+  [[nodiscard]] const glm::quat& GetRotation() const { return rotation_; }
 
-  glm::mat4 GetModel() const;
+  void SetPosition(const glm::vec3& position) { position_ = position; MarkDirty(); }
+  void SetScale(const glm::vec3& scale) { scale_ = scale; MarkDirty(); }
+  void SetRotation(const glm::quat& rotation) { rotation_ = rotation; MarkDirty(); }
+
+  [[nodiscard]] bool IsDirty() const { return dirty_; }
+
+  // where the transform reports itself once it changes, or nowhere if dirtyList is null
+  void Track(std::vector<uint32_t>* dirtyList, uint32_t slot)
+  {
+    dirtyList_ = dirtyList;
+    slot_ = slot;
+  }
+
+  // translate * rotate * scale, as of the last UpdateModels
+  [[nodiscard]] const glm::mat4& GetModel() const
+  {
+    assert(!dirty_ && "transform changed since the last UpdateModels");
+    return model_;
+  }
+
+private:
+  friend void UpdateModels(std::span<Transform* const> transforms);
+
+  void MarkDirty()
+  {
+    if (!dirty_ && dirtyList_)
+    {
+      dirtyList_->push_back(slot_);
+    }
+    dirty_ = true;
+  }
+
+  glm::vec3 position_{};
+  glm::vec3 scale_{ 1 };
+  glm::quat rotation_{ 1, 0, 0, 0 };
+  glm::mat4 model_{ 1 };
+  bool dirty_ = false;
+  std::vector<uint32_t>* dirtyList_{};
+  uint32_t slot_{};
 };
 
+// recomputes the model matrices of the transforms, several at a time with SIMD, and marks them clean
+void UpdateModels(std::span<Transform* const> transforms);
+
+// a mesh's range in the renderer's shared vertex and index buffers
 struct MeshHandle
 {
-  uint32_t count{};
-  uint32_t vertexBuffer{};
-  uint32_t indexBuffer{};
+  uint32_t count{};        // indices
+  uint32_t firstIndex{};
+  int32_t baseVertex{};
 };
 
 struct Renderable
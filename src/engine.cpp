@@ -7,6 +7,7 @@ namespace Game
     GameObject obj{};
     obj.entity = ++nextEntity;
     objects.push_back(obj);
+    objects.back().transform.Track(&movedSlots, static_cast<uint32_t>(objects.size() - 1));
     return nextEntity;
   }
 
@@ -33,6 +34,16 @@ namespace Game
         //printf("Destroyed object %d\n", objects[i]->entity);
         objects[i] = std::move(objects.back());
         objects.pop_back();
+        if (i < objects.size())
+        {
+          // the last object moved into the slot, and reports it from now on
+          Transform& moved = objects[i].transform;
+          moved.Track(&movedSlots, static_cast<uint32_t>(i));
+          if (moved.IsDirty())
+          {
+            movedSlots.push_back(static_cast<uint32_t>(i));
+          }
+        }
         return;
       }
     }
@@ -40,9 +51,25 @@ namespace Game
     assert(0 && "Tried to delete an object that didn't exist!");
   }
 
+  void EntityManager::UpdateTransforms()
+  {
+    // destroying objects can leave slots that are gone, listed twice or no longer dirty
+    dirtyTransforms.clear();
+    for (uint32_t slot : movedSlots)
+    {
+      if (slot < objects.size() && objects[slot].transform.IsDirty())
+      {
+        dirtyTransforms.push_back(&objects[slot].transform);
+      }
+    }
+    movedSlots.clear();
+    UpdateModels(dirtyTransforms);
+  }
+
   void EntityManager::Clear()
   {
     objects.clear();
+    movedSlots.clear();
     nextEntity = 0;
   }
 }
\ No newline at end of file
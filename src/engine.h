@@ -34,9 +34,17 @@ namespace Game
     void DestroyEntity(entity_t entity);
     void Clear();
 
+    // recomputes the model matrices of the objects that moved since the last call, before they are drawn. Only
+    // the objects whose transforms reported a change are visited
+    void UpdateTransforms();
+
   private:
     entity_t nextEntity = 0;
 
     std::vector<GameObject> objects;
+
+    // slots in objects of the transforms that changed since the last UpdateTransforms, filled by their setters
+    std::vector<uint32_t> movedSlots;
+    std::vector<Transform*> dirtyTransforms;
   };
 }
\ No newline at end of file
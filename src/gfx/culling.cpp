@@ -0,0 +1,355 @@
+#include "culling.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+#include <glad/gl.h>
+
+#include "culling_kernel.h"
+#include "frustum.h"
+#include "utility/cpu_features.h"
+#include "utility/thread_pool.h"
+
+namespace GFX
+{
+  namespace
+  {
+    // matches both local sizes of hiz_reduce.comp.glsl
+    constexpr uint32_t reduceGroupSize = 8;
+
+    // the depth texture has to have the format of the framebuffer's depth for glBlitFramebuffer to copy it
+    GLenum DepthFormat(GLint depthBits, GLint componentType, GLint stencilBits)
+    {
+      if (componentType == GL_FLOAT)
+      {
+        return depthBits != 32 ? GL_NONE : stencilBits == 8 ? GL_DEPTH32F_STENCIL8 : stencilBits == 0 ? GL_DEPTH_COMPONENT32F : GL_NONE;
+      }
+      if (stencilBits == 8)
+      {
+        return depthBits == 24 ? GL_DEPTH24_STENCIL8 : GL_NONE;
+      }
+      if (stencilBits != 0)
+      {
+        return GL_NONE;
+      }
+      switch (depthBits)
+      {
+      case 16: return GL_DEPTH_COMPONENT16;
+      case 24: return GL_DEPTH_COMPONENT24;
+      case 32: return GL_DEPTH_COMPONENT32;
+      default: return GL_NONE;
+      }
+    }
+
+    // the sums and products below are written out in the order cull_instances.comp.glsl has them, so both round alike
+    glm::vec4 Transform(const glm::mat4& m, const glm::vec4& v)
+    {
+      return m[0] * v.x + m[1] * v.y + m[2] * v.z + m[3] * v.w;
+    }
+
+    float LengthSquared(const glm::vec4& v)
+    {
+      return v.x * v.x + v.y * v.y + v.z * v.z;
+    }
+
+    // whether the box around the sphere was behind the pyramid's depth everywhere it covered
+    bool Occluded(const CullView& view, const std::vector<std::vector<float>>& levels, const glm::vec3& center, float radius)
+    {
+      glm::vec2 lo(1e30f);
+      glm::vec2 hi(-1e30f);
+      float nearest = 1e30f;
+      for (int i = 0; i < 8; i++)
+      {
+        const glm::vec3 corner = center + radius * glm::vec3(i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1);
+        const glm::vec4 clip = Transform(view.depthViewProj, glm::vec4(corner, 1));
+        if (clip.w <= 0)
+        {
+          // reaches behind the viewer
+          return false;
+        }
+        const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        lo = glm::min(lo, glm::vec2(ndc));
+        hi = glm::max(hi, glm::vec2(ndc));
+        nearest = std::min(nearest, ndc.z);
+      }
+      if (hi.x < -1 || hi.y < -1 || lo.x > 1 || lo.y > 1)
+      {
+        // the depth has nothing on it
+        return false;
+      }
+      return detail::BehindDepth(view, levels, lo, hi, nearest);
+    }
+
+    bool Visible(const CullView& view, const std::vector<std::vector<float>>& levels, const InstanceData& instance, const MeshBounds& bounds)
+    {
+      if ((instance.flags & instanceVisible) == 0)
+      {
+        return false;
+      }
+
+      // the largest scale of any axis keeps the sphere around the mesh
+      const glm::mat4& model = instance.model;
+      const glm::vec3 center = glm::vec3(Transform(model, glm::vec4(glm::vec3(bounds), 1)));
+      const float scale = std::sqrt(std::max(std::max(LengthSquared(model[0]), LengthSquared(model[1])), LengthSquared(model[2])));
+      const float radius = bounds.w * scale;
+      for (const glm::vec4& plane : view.planes)
+      {
+        if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius)
+        {
+          return false;
+        }
+      }
+      return !view.occlusion || !Occluded(view, levels, center, radius);
+    }
+  }
+
+  namespace detail
+  {
+    bool BehindDepth(const CullView& view, const std::vector<std::vector<float>>& levels, glm::vec2 lo, glm::vec2 hi, float nearest)
+    {
+      // the pixels it covered, then the first level where they fit in 2x2 texels
+      const glm::vec2 size(view.depthSize);
+      const glm::ivec2 last = view.depthSize - 1;
+      const glm::ivec2 p0 = glm::min(glm::ivec2(glm::floor(glm::clamp(lo * 0.5f + 0.5f, 0.0f, 1.0f) * size)), last);
+      const glm::ivec2 p1 = glm::min(glm::ivec2(glm::floor(glm::clamp(hi * 0.5f + 0.5f, 0.0f, 1.0f) * size)), last);
+      uint32_t level = 0;
+      while (level + 1 < view.depthLevels && ((p1.x >> level) - (p0.x >> level) > 1 || (p1.y >> level) - (p0.y >> level) > 1))
+      {
+        level++;
+      }
+
+      // the last texel of a level also covers the odd row or column of the level before
+      const glm::ivec2 levelSize = glm::max(view.depthSize >> static_cast<int>(level), glm::ivec2(1));
+      const glm::ivec2 t0 = glm::min(p0 >> static_cast<int>(level), levelSize - 1);
+      const glm::ivec2 t1 = glm::min(p1 >> static_cast<int>(level), levelSize - 1);
+      float farthest = 0;
+      for (int y = t0.y; y <= t1.y; y++)
+      {
+        for (int x = t0.x; x <= t1.x; x++)
+        {
+          farthest = std::max(farthest, levels[level][static_cast<size_t>(y) * levelSize.x + x]);
+        }
+      }
+      return nearest > farthest;
+    }
+
+    uint32_t CullRunScalar(const CullRunArgs& args, uint32_t i0, uint32_t i1, uint32_t written)
+    {
+      for (uint32_t i = i0; i < i1; i++)
+      {
+        const uint32_t slot = args.candidates[i];
+        if (Visible(*args.view, *args.levels, args.instances[slot], args.bounds))
+        {
+          args.drawOrder[written++] = slot;
+        }
+      }
+      return written;
+    }
+  }
+
+  const char* ToString(CullKernel kernel)
+  {
+    switch (kernel)
+    {
+    case CullKernel::AUTO: return "auto";
+    case CullKernel::SCALAR: return "scalar";
+    case CullKernel::AVX2: return "avx2";
+    default: return "unknown";
+    }
+  }
+
+  InstanceCuller::InstanceCuller(CullKernel kernel)
+    : cullShader_(LoadComputeProgram("cull_instances.comp.glsl")),
+      reduceShader_(LoadComputeProgram("hiz_reduce.comp.glsl"))
+  {
+#ifdef ENGINE_AVX2
+    const bool avx2 = HasAVX2();
+#else
+    const bool avx2 = false;
+#endif
+    kernel_ = (kernel == CullKernel::AUTO || kernel == CullKernel::AVX2) && avx2 ? CullKernel::AVX2 : CullKernel::SCALAR;
+    cullRun_ = detail::CullRunScalar;
+#ifdef ENGINE_AVX2
+    if (kernel_ == CullKernel::AVX2)
+    {
+      cullRun_ = detail::CullRunAVX2;
+    }
+#endif
+  }
+
+  InstanceCuller::~InstanceCuller()
+  {
+    glDeleteTextures(1, &depthTexture_);
+    glDeleteTextures(1, &pyramid_);
+    glDeleteProgram(cullShader_.program);
+    glDeleteProgram(reduceShader_.program);
+  }
+
+  void InstanceCuller::CaptureDepth(const glm::mat4& viewProj)
+  {
+    GLint framebuffer{};
+    GLint viewport[4]{};
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // the default framebuffer names its buffers differently
+    const auto fb = static_cast<GLuint>(framebuffer);
+    const GLenum depthAttachment = fb == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+    const GLenum stencilAttachment = fb == 0 ? GL_STENCIL : GL_STENCIL_ATTACHMENT;
+    GLint depthType = GL_NONE;
+    GLint stencilType = GL_NONE;
+    glGetNamedFramebufferAttachmentParameteriv(fb, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &depthType);
+    glGetNamedFramebufferAttachmentParameteriv(fb, stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &stencilType);
+
+    GLint depthBits{};
+    GLint componentType{};
+    GLint stencilBits{};
+    if (depthType != GL_NONE)
+    {
+      glGetNamedFramebufferAttachmentParameteriv(fb, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+      glGetNamedFramebufferAttachmentParameteriv(fb, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &componentType);
+    }
+    if (stencilType != GL_NONE)
+    {
+      glGetNamedFramebufferAttachmentParameteriv(fb, stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+    }
+
+    const GLenum format = depthType == GL_NONE ? GL_NONE : DepthFormat(depthBits, componentType, stencilBits);
+    const glm::ivec2 size = { viewport[2], viewport[3] };
+    if (format == GL_NONE || size.x <= 0 || size.y <= 0)
+    {
+      ClearDepth();
+      return;
+    }
+
+    if (format != depthFormat_ || size != size_)
+    {
+      glDeleteTextures(1, &depthTexture_);
+      glDeleteTextures(1, &pyramid_);
+      levels_ = static_cast<uint32_t>(std::bit_width(static_cast<uint32_t>(std::max(size.x, size.y))));
+      glCreateTextures(GL_TEXTURE_2D, 1, &depthTexture_);
+      glTextureStorage2D(depthTexture_, 1, format, size.x, size.y);
+      glCreateTextures(GL_TEXTURE_2D, 1, &pyramid_);
+      glTextureStorage2D(pyramid_, static_cast<GLsizei>(levels_), GL_R32F, size.x, size.y);
+      depthFormat_ = format;
+      size_ = size;
+    }
+
+    GLuint copy{};
+    glCreateFramebuffers(1, &copy);
+    glNamedFramebufferTexture(copy, stencilBits != 0 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, depthTexture_, 0);
+    glBlitNamedFramebuffer(fb, copy, viewport[0], viewport[1], viewport[0] + size.x, viewport[1] + size.y,
+      0, 0, size.x, size.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glDeleteFramebuffers(1, &copy);
+
+    BuildPyramid();
+    depthViewProj_ = viewProj;
+    hasDepth_ = true;
+    levelData_.clear();
+  }
+
+  void InstanceCuller::ClearDepth()
+  {
+    hasDepth_ = false;
+    levelData_.clear();
+  }
+
+  void InstanceCuller::BuildPyramid()
+  {
+    reduceShader_.Bind();
+    glBindTextureUnit(0, depthTexture_);
+    glBindTextureUnit(1, pyramid_);
+    for (uint32_t level = 0; level < levels_; level++)
+    {
+      const glm::ivec2 levelSize = glm::max(size_ >> static_cast<int>(level), glm::ivec2(1));
+      reduceShader_.SetInt("u_level", static_cast<int32_t>(level));
+      glBindImageTexture(0, pyramid_, static_cast<GLint>(level), GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+      glDispatchCompute((levelSize.x + reduceGroupSize - 1) / reduceGroupSize, (levelSize.y + reduceGroupSize - 1) / reduceGroupSize, 1);
+      glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindTextureUnit(0, 0);
+    glBindTextureUnit(1, 0);
+  }
+
+  CullView InstanceCuller::View(const glm::mat4& viewProj, bool occlusion) const
+  {
+    CullView view
+    {
+      .occlusion = occlusion && hasDepth_,
+      .depthViewProj = depthViewProj_,
+      .depthSize = size_,
+      .depthLevels = levels_,
+    };
+    const Frustum frustum = Frustum::FromMatrix(viewProj);
+    for (int i = 0; i < 6; i++)
+    {
+      view.planes[i] = frustum.planes[i] / glm::length(glm::vec3(frustum.planes[i]));
+    }
+    return view;
+  }
+
+  void InstanceCuller::Cull(const CullView& view, const CullBuffers& buffers)
+  {
+    if (buffers.numDraws == 0)
+    {
+      return;
+    }
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, buffers.instances.buffer, buffers.instances.offset, buffers.instances.size);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, buffers.candidates.buffer, buffers.candidates.offset, buffers.candidates.size);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, buffers.bounds.buffer, buffers.bounds.offset, buffers.bounds.size);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 3, buffers.draws.buffer, buffers.draws.offset, buffers.draws.size);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 4, buffers.drawOrder.buffer, buffers.drawOrder.offset, buffers.drawOrder.size);
+    if (view.occlusion)
+    {
+      glBindTextureUnit(0, pyramid_);
+    }
+
+    cullShader_.Set4FloatArray("u_planes[0]", view.planes);
+    cullShader_.SetBool("u_occlusion", view.occlusion);
+    cullShader_.SetMat4("u_depthViewProj", view.depthViewProj);
+    cullShader_.SetIVec2("u_depthSize", view.depthSize);
+    cullShader_.SetInt("u_depthLevels", static_cast<int32_t>(view.depthLevels));
+    cullShader_.Bind();
+    glDispatchCompute(buffers.numDraws, 1, 1);
+
+    // the draws read the commands and the draw order next
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindTextureUnit(0, 0);
+  }
+
+  void InstanceCuller::CullCPU(const CullView& view, const CullArrays& arrays, ThreadPool& pool)
+  {
+    if (view.occlusion && levelData_.empty())
+    {
+      glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+      levelData_.resize(levels_);
+      for (uint32_t level = 0; level < levels_; level++)
+      {
+        const glm::ivec2 levelSize = glm::max(size_ >> static_cast<int>(level), glm::ivec2(1));
+        levelData_[level].resize(static_cast<size_t>(levelSize.x) * levelSize.y);
+        glGetTextureImage(pyramid_, static_cast<GLint>(level), GL_RED, GL_FLOAT,
+          static_cast<GLsizei>(levelData_[level].size() * sizeof(float)), levelData_[level].data());
+      }
+    }
+
+    pool.ParallelFor(arrays.numDraws, [&](uint32_t draw)
+      {
+        DrawElementsIndirectCommand& command = arrays.draws[draw];
+        const uint32_t base = command.baseInstance;
+        const detail::CullRunArgs args
+        {
+          .view = &view,
+          .levels = &levelData_,
+          .instances = arrays.instances,
+          .candidates = arrays.candidates + base,
+          .bounds = arrays.bounds[draw],
+          .drawOrder = arrays.drawOrder + base,
+        };
+        command.instanceCount = cullRun_(args, 0, command.instanceCount, 0);
+      });
+  }
+}
\ No newline at end of file
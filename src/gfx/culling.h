@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include "macros.h"
+#include "shader.h"
+
+class ThreadPool;
+
+namespace GFX
+{
+  // per-object data read by standard.vert.glsl and cull_instances.comp.glsl, laid out for std430
+  struct InstanceData
+  {
+    glm::mat4 model;
+    glm::vec4 color;
+    glm::vec3 glow;
+    uint32_t flags;
+  };
+
+  constexpr uint32_t instanceVisible = 1;
+
+  // the layout glMultiDrawElementsIndirect reads
+  struct DrawElementsIndirectCommand
+  {
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+  };
+
+  // a sphere around a mesh's vertices in its model space, xyz is the center and w the radius
+  using MeshBounds = glm::vec4;
+
+  // a part of a buffer, as glBindBufferRange takes it
+  struct BufferRange
+  {
+    uint32_t buffer{};
+    size_t offset{};
+    size_t size{};
+  };
+
+  // what InstanceCuller::Cull reads and writes. Each draw's command comes in with instanceCount candidates, which
+  // are instance indices starting at baseInstance in candidates, and leaves with the visible ones moved to the front
+  // of the same range of drawOrder, in the same order, and instanceCount lowered to match
+  struct CullBuffers
+  {
+    uint32_t numDraws{};
+    BufferRange instances;    // InstanceData
+    BufferRange candidates;   // uint32_t
+    BufferRange bounds;       // MeshBounds of each draw's mesh
+    BufferRange draws;        // DrawElementsIndirectCommand
+    BufferRange drawOrder;    // uint32_t
+  };
+
+  // the same data for CullCPU, mapped or in memory
+  struct CullArrays
+  {
+    uint32_t numDraws{};
+    const InstanceData* instances{};
+    const uint32_t* candidates{};
+    const MeshBounds* bounds{};
+    DrawElementsIndirectCommand* draws{};
+    uint32_t* drawOrder{};
+  };
+
+  // the view being culled for, and the depth pyramid of the frame before it if there is one
+  struct CullView
+  {
+    glm::vec4 planes[6]{};   // normalized, so their distances compare with radii
+    bool occlusion{};
+    glm::mat4 depthViewProj{ 1 };
+    glm::ivec2 depthSize{};
+    uint32_t depthLevels{};
+  };
+
+  // how CullCPU runs its candidates
+  enum class CullKernel
+  {
+    AUTO,   // AVX2 if the CPU supports it, scalar otherwise
+    SCALAR,
+    AVX2,
+  };
+
+  [[nodiscard]] const char* ToString(CullKernel kernel);
+
+  namespace detail
+  {
+    struct CullRunArgs;
+
+    // culls candidates [i0, i1) of one draw, see culling_kernel.h
+    using CullRunFn = uint32_t(*)(const CullRunArgs& args, uint32_t i0, uint32_t i1, uint32_t written);
+  }
+
+  // drops invisible objects, objects outside the view, and objects hidden behind the previous frame's depth from
+  // indirect draws. Cull runs a compute shader that writes the draws where they are, so no visibility comes back to
+  // the CPU. CullCPU does the same arithmetic in the same order on the CPU and gives the same draws, for drivers
+  // without the compute path and for checking it.
+  // Occlusion uses a max depth pyramid of the last CaptureDepth, tested with the view that depth was drawn from:
+  // objects are only dropped if they were behind it then, so objects that come into sight show up a frame late
+  class InstanceCuller
+  {
+  public:
+    // an unavailable kernel falls back to scalar. Every kernel gives the same draws
+    explicit InstanceCuller(CullKernel kernel = CullKernel::AUTO);
+    ~InstanceCuller();
+
+    NOCOPY_NOMOVE(InstanceCuller)
+
+    [[nodiscard]] CullKernel Kernel() const { return kernel_; }
+
+    // copies the depth of the bound draw framebuffer inside the viewport, which viewProj drew, and builds the
+    // pyramid from it. Framebuffers without depth, or with a format the copy cannot match, turn occlusion off
+    void CaptureDepth(const glm::mat4& viewProj);
+    void ClearDepth();
+
+    [[nodiscard]] CullView View(const glm::mat4& viewProj, bool occlusion) const;
+
+    void Cull(const CullView& view, const CullBuffers& buffers);
+
+    // reads the pyramid back the first time it is needed after a capture, which waits for the GPU
+    void CullCPU(const CullView& view, const CullArrays& arrays, ThreadPool& pool);
+
+  private:
+    void BuildPyramid();
+
+    Shader cullShader_;
+    Shader reduceShader_;
+    CullKernel kernel_;
+    detail::CullRunFn cullRun_;
+
+    uint32_t depthTexture_{};
+    uint32_t depthFormat_{};
+    uint32_t pyramid_{};
+    glm::ivec2 size_{};
+    uint32_t levels_{};
+    bool hasDepth_{};
+    glm::mat4 depthViewProj_{ 1 };
+
+    // the pyramid's levels for CullCPU, empty until it reads them back
+    std::vector<std::vector<float>> levelData_;
+  };
+}
\ No newline at end of file
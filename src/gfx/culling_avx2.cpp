@@ -0,0 +1,157 @@
+// only built with AVX2 code generation enabled, and only called after a runtime check
+#ifdef ENGINE_AVX2
+#include "culling_kernel.h"
+#include <bit>
+#include <immintrin.h>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace GFX::detail
+{
+  namespace
+  {
+    // rows x, y and z of column c of eight model matrices, one lane per instance
+    void LoadColumn(const InstanceData* const (&lanes)[cullLanes], int c, __m256& x, __m256& y, __m256& z)
+    {
+      __m128 a0 = _mm_loadu_ps(glm::value_ptr(lanes[0]->model) + 4 * c);
+      __m128 a1 = _mm_loadu_ps(glm::value_ptr(lanes[1]->model) + 4 * c);
+      __m128 a2 = _mm_loadu_ps(glm::value_ptr(lanes[2]->model) + 4 * c);
+      __m128 a3 = _mm_loadu_ps(glm::value_ptr(lanes[3]->model) + 4 * c);
+      __m128 b0 = _mm_loadu_ps(glm::value_ptr(lanes[4]->model) + 4 * c);
+      __m128 b1 = _mm_loadu_ps(glm::value_ptr(lanes[5]->model) + 4 * c);
+      __m128 b2 = _mm_loadu_ps(glm::value_ptr(lanes[6]->model) + 4 * c);
+      __m128 b3 = _mm_loadu_ps(glm::value_ptr(lanes[7]->model) + 4 * c);
+      _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+      _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+      x = _mm256_set_m128(b0, a0);
+      y = _mm256_set_m128(b1, a1);
+      z = _mm256_set_m128(b2, a2);
+    }
+
+    // m[0] * x + m[1] * y + m[2] * z + m[3] for one row r of m, as Transform in culling.cpp sums it
+    __m256 TransformRow(const glm::mat4& m, int r, __m256 x, __m256 y, __m256 z)
+    {
+      const __m256 sum = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[0][r]), x), _mm256_mul_ps(_mm256_set1_ps(m[1][r]), y));
+      return _mm256_add_ps(_mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(m[2][r]), z)), _mm256_set1_ps(m[3][r]));
+    }
+
+    // the lanes of live that Occluded in culling.cpp drops: the corners are projected on all lanes at once, then the
+    // ones still on screen read the pyramid one at a time
+    uint32_t OccludedLanes(const CullView& view, const std::vector<std::vector<float>>& levels, __m256 cx, __m256 cy, __m256 cz,
+      __m256 radius, uint32_t live)
+    {
+      const __m256 negRadius = _mm256_xor_ps(radius, _mm256_set1_ps(-0.0f));
+      const __m256 zero = _mm256_setzero_ps();
+      __m256 loX = _mm256_set1_ps(1e30f);
+      __m256 loY = loX;
+      __m256 nearest = loX;
+      __m256 hiX = _mm256_set1_ps(-1e30f);
+      __m256 hiY = hiX;
+      __m256 behind = zero;
+      for (int i = 0; i < 8; i++)
+      {
+        const __m256 x = _mm256_add_ps(cx, i & 1 ? radius : negRadius);
+        const __m256 y = _mm256_add_ps(cy, i & 2 ? radius : negRadius);
+        const __m256 z = _mm256_add_ps(cz, i & 4 ? radius : negRadius);
+        const __m256 w = TransformRow(view.depthViewProj, 3, x, y, z);
+        behind = _mm256_or_ps(behind, _mm256_cmp_ps(w, zero, _CMP_LE_OQ));
+        const __m256 ndcX = _mm256_div_ps(TransformRow(view.depthViewProj, 0, x, y, z), w);
+        const __m256 ndcY = _mm256_div_ps(TransformRow(view.depthViewProj, 1, x, y, z), w);
+        const __m256 ndcZ = _mm256_div_ps(TransformRow(view.depthViewProj, 2, x, y, z), w);
+        loX = _mm256_min_ps(ndcX, loX);
+        loY = _mm256_min_ps(ndcY, loY);
+        hiX = _mm256_max_ps(ndcX, hiX);
+        hiY = _mm256_max_ps(ndcY, hiY);
+        nearest = _mm256_min_ps(ndcZ, nearest);
+      }
+      const __m256 minusOne = _mm256_set1_ps(-1.0f);
+      const __m256 plusOne = _mm256_set1_ps(1.0f);
+      const __m256 offScreen = _mm256_or_ps(
+        _mm256_or_ps(_mm256_cmp_ps(hiX, minusOne, _CMP_LT_OQ), _mm256_cmp_ps(hiY, minusOne, _CMP_LT_OQ)),
+        _mm256_or_ps(_mm256_cmp_ps(loX, plusOne, _CMP_GT_OQ), _mm256_cmp_ps(loY, plusOne, _CMP_GT_OQ)));
+      live &= ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_or_ps(behind, offScreen)));
+      if (live == 0)
+      {
+        return 0;
+      }
+
+      float lx[cullLanes], ly[cullLanes], hx[cullLanes], hy[cullLanes], nz[cullLanes];
+      _mm256_storeu_ps(lx, loX);
+      _mm256_storeu_ps(ly, loY);
+      _mm256_storeu_ps(hx, hiX);
+      _mm256_storeu_ps(hy, hiY);
+      _mm256_storeu_ps(nz, nearest);
+      uint32_t occluded = 0;
+      for (uint32_t lanes = live; lanes != 0; lanes &= lanes - 1)
+      {
+        const int l = std::countr_zero(lanes);
+        if (BehindDepth(view, levels, { lx[l], ly[l] }, { hx[l], hy[l] }, nz[l]))
+        {
+          occluded |= 1u << l;
+        }
+      }
+      return occluded;
+    }
+  }
+
+  uint32_t CullRunAVX2(const CullRunArgs& args, uint32_t i0, uint32_t i1, uint32_t written)
+  {
+    // the same operations in the same order as Visible in culling.cpp, on eight candidates at once
+    const CullView& view = *args.view;
+    const __m256 bx = _mm256_set1_ps(args.bounds.x);
+    const __m256 by = _mm256_set1_ps(args.bounds.y);
+    const __m256 bz = _mm256_set1_ps(args.bounds.z);
+    const __m256 bw = _mm256_set1_ps(args.bounds.w);
+    uint32_t i = i0;
+    for (; i1 - i >= cullLanes; i += cullLanes)
+    {
+      const InstanceData* lanes[cullLanes];
+      uint32_t live = 0;
+      for (uint32_t l = 0; l < cullLanes; l++)
+      {
+        lanes[l] = &args.instances[args.candidates[i + l]];
+        live |= (lanes[l]->flags & instanceVisible) != 0 ? 1u << l : 0;
+      }
+      if (live == 0)
+      {
+        continue;
+      }
+
+      __m256 m0x, m0y, m0z, m1x, m1y, m1z, m2x, m2y, m2z, m3x, m3y, m3z;
+      LoadColumn(lanes, 0, m0x, m0y, m0z);
+      LoadColumn(lanes, 1, m1x, m1y, m1z);
+      LoadColumn(lanes, 2, m2x, m2y, m2z);
+      LoadColumn(lanes, 3, m3x, m3y, m3z);
+      const __m256 cx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0x, bx), _mm256_mul_ps(m1x, by)), _mm256_mul_ps(m2x, bz)), m3x);
+      const __m256 cy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0y, bx), _mm256_mul_ps(m1y, by)), _mm256_mul_ps(m2y, bz)), m3y);
+      const __m256 cz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0z, bx), _mm256_mul_ps(m1z, by)), _mm256_mul_ps(m2z, bz)), m3z);
+
+      // std::max(a, b) keeps a on ties and NaNs, _mm256_max_ps(b, a) does the same
+      const __m256 l0 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0x, m0x), _mm256_mul_ps(m0y, m0y)), _mm256_mul_ps(m0z, m0z));
+      const __m256 l1 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m1x, m1x), _mm256_mul_ps(m1y, m1y)), _mm256_mul_ps(m1z, m1z));
+      const __m256 l2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m2x, m2x), _mm256_mul_ps(m2y, m2y)), _mm256_mul_ps(m2z, m2z));
+      const __m256 radius = _mm256_mul_ps(bw, _mm256_sqrt_ps(_mm256_max_ps(l2, _mm256_max_ps(l1, l0))));
+      const __m256 negRadius = _mm256_xor_ps(radius, _mm256_set1_ps(-0.0f));
+
+      __m256 outside = _mm256_setzero_ps();
+      for (const glm::vec4& plane : view.planes)
+      {
+        const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+          _mm256_mul_ps(_mm256_set1_ps(plane.x), cx), _mm256_mul_ps(_mm256_set1_ps(plane.y), cy)),
+          _mm256_mul_ps(_mm256_set1_ps(plane.z), cz)), _mm256_set1_ps(plane.w));
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, negRadius, _CMP_LT_OQ));
+      }
+      live &= ~static_cast<uint32_t>(_mm256_movemask_ps(outside));
+      if (live != 0 && view.occlusion)
+      {
+        live &= ~OccludedLanes(view, *args.levels, cx, cy, cz, radius, live);
+      }
+
+      for (; live != 0; live &= live - 1)
+      {
+        args.drawOrder[written++] = args.candidates[i + static_cast<uint32_t>(std::countr_zero(live))];
+      }
+    }
+    return CullRunScalar(args, i, i1, written);
+  }
+}
+#endif
\ No newline at end of file
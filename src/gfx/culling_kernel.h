@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/vec2.hpp>
+#include "culling.h"
+
+// internal interface between InstanceCuller::CullCPU and its per-ISA kernels
+namespace GFX::detail
+{
+  constexpr uint32_t cullLanes = 8;
+
+  // one draw's candidates and where its visible ones go
+  struct CullRunArgs
+  {
+    const CullView* view{};
+    const std::vector<std::vector<float>>* levels{};   // the depth pyramid, only read with view->occlusion
+    const InstanceData* instances{};
+    const uint32_t* candidates{};
+    MeshBounds bounds{};
+    uint32_t* drawOrder{};
+  };
+
+  // whether the depth was nearer than nearest everywhere in the box from lo to hi, in the depth's NDC. The box has to
+  // be on screen
+  bool BehindDepth(const CullView& view, const std::vector<std::vector<float>>& levels, glm::vec2 lo, glm::vec2 hi, float nearest);
+
+  // culls candidates [i0, i1) and writes the visible ones to drawOrder in order from index written on, returns the
+  // number written after them. Every kernel keeps the same candidates
+  uint32_t CullRunScalar(const CullRunArgs& args, uint32_t i0, uint32_t i1, uint32_t written);
+#ifdef ENGINE_AVX2
+  uint32_t CullRunAVX2(const CullRunArgs& args, uint32_t i0, uint32_t i1, uint32_t written);
+#endif
+}
\ No newline at end of file
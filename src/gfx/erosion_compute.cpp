@@ -0,0 +1,167 @@
+#include "erosion_compute.h"
+
+#include <cmath>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+#include <glad/gl.h>
+
+namespace GFX
+{
+  namespace
+  {
+    // matches local_size_x and local_size_y of the erosion compute shaders
+    constexpr uint32_t groupSize = 16;
+  }
+
+  ComputeEroder::ComputeEroder(uint32_t width, uint32_t height, const Erosion::GridParams& grid, const Erosion::ThermalParams& thermal)
+    : width_(width),
+      height_(height),
+      pitch_(Erosion::Heightfield::PitchFor(width)),
+      gridParams_(grid),
+      thermalParams_(thermal),
+      gridFlux_(LoadComputeProgram("grid_flux.comp.glsl")),
+      gridErode_(LoadComputeProgram("grid_erode.comp.glsl")),
+      gridTransport_(LoadComputeProgram("grid_transport.comp.glsl")),
+      thermalOutflow_(LoadComputeProgram("thermal_outflow.comp.glsl")),
+      thermalRelax_(LoadComputeProgram("thermal_relax.comp.glsl"))
+  {
+    const GLsizeiptr bytes = static_cast<GLsizeiptr>(pitch_) * height * sizeof(float);
+    glCreateBuffers(NUM_BUFFERS, buffers_);
+    for (uint32_t buffer : buffers_)
+    {
+      glNamedBufferStorage(buffer, bytes, nullptr, GL_DYNAMIC_STORAGE_BIT);
+      glClearNamedBufferData(buffer, GL_R32F, GL_RED, GL_FLOAT, nullptr);
+    }
+
+    for (Shader* shader : { &gridFlux_, &gridErode_, &gridTransport_, &thermalOutflow_, &thermalRelax_ })
+    {
+      shader->SetUInt("u_width", width);
+      shader->SetUInt("u_height", height);
+      shader->SetUInt("u_pitch", pitch_);
+    }
+
+    for (Shader* shader : { &gridFlux_, &gridErode_, &gridTransport_ })
+    {
+      shader->SetFloat("u_timeStep", grid.timeStep);
+    }
+    gridFlux_.SetFloat("u_rainRate", grid.rainRate);
+    gridFlux_.SetFloat("u_pipeArea", grid.pipeArea);
+    gridFlux_.SetFloat("u_gravity", grid.gravity);
+    gridErode_.SetFloat("u_rainRate", grid.rainRate);
+    gridErode_.SetFloat("u_sedimentCapacity", grid.sedimentCapacity);
+    gridErode_.SetFloat("u_dissolveRate", grid.dissolveRate);
+    gridErode_.SetFloat("u_depositRate", grid.depositRate);
+    gridErode_.SetFloat("u_minTilt", grid.minTilt);
+    gridErode_.SetFloat("u_maxErosionDepth", grid.maxErosionDepth);
+    gridTransport_.SetFloat("u_evaporationRate", grid.evaporationRate);
+
+    // the diagonal talus is rounded on the CPU, as ThermalEroder does
+    for (Shader* shader : { &thermalOutflow_, &thermalRelax_ })
+    {
+      shader->SetFloat("u_talus", thermal.talus);
+      shader->SetFloat("u_talusDiag", thermal.talus * std::sqrt(2.0f));
+    }
+    thermalOutflow_.SetFloat("u_rate", thermal.rate);
+  }
+
+  ComputeEroder::~ComputeEroder()
+  {
+    glDeleteBuffers(NUM_BUFFERS, buffers_);
+    for (Shader* shader : { &gridFlux_, &gridErode_, &gridTransport_, &thermalOutflow_, &thermalRelax_ })
+    {
+      glDeleteProgram(shader->program);
+    }
+  }
+
+  void ComputeEroder::Upload(const Erosion::Heightfield& map)
+  {
+    if (map.width != width_ || map.height != height_)
+    {
+      throw std::runtime_error(std::format("compute eroder is {}x{}, the map {}x{}", width_, height_, map.width, map.height));
+    }
+
+    for (uint32_t buffer : buffers_)
+    {
+      glClearNamedBufferData(buffer, GL_R32F, GL_RED, GL_FLOAT, nullptr);
+    }
+    glNamedBufferSubData(buffers_[TERRAIN], 0, static_cast<GLsizeiptr>(map.data.size() * sizeof(float)), map.data.data());
+    iteration_ = 0;
+  }
+
+  void ComputeEroder::Update()
+  {
+    for (uint32_t i = 0; i < gridParams_.stepsPerUpdate; i++)
+    {
+      StepGrid();
+    }
+
+    iteration_++;
+    if (thermalParams_.interval == 0 || thermalParams_.iterations == 0 || iteration_ % thermalParams_.interval != 0)
+    {
+      return;
+    }
+    for (uint32_t i = 0; i < thermalParams_.iterations; i++)
+    {
+      StepThermal();
+    }
+  }
+
+  void ComputeEroder::StepGrid()
+  {
+    // the passes depend on each other's writes the same way the CPU passes do, so each one waits for the last
+    BindBuffers();
+    Dispatch(gridFlux_);
+    Dispatch(gridErode_);
+    std::swap(buffers_[TERRAIN], buffers_[TERRAIN_OUT]);
+
+    BindBuffers();
+    Dispatch(gridTransport_);
+    std::swap(buffers_[SEDIMENT], buffers_[SEDIMENT_OUT]);
+  }
+
+  void ComputeEroder::StepThermal()
+  {
+    BindBuffers();
+    Dispatch(thermalOutflow_);
+    Dispatch(thermalRelax_);
+    std::swap(buffers_[TERRAIN], buffers_[TERRAIN_OUT]);
+  }
+
+  void ComputeEroder::Download(ComputeField field, Erosion::Heightfield& out) const
+  {
+    if (out.width != width_ || out.height != height_)
+    {
+      out = Erosion::Heightfield(width_, height_);
+    }
+
+    const uint32_t buffer = field == ComputeField::TERRAIN ? buffers_[TERRAIN] : field == ComputeField::WATER ? buffers_[WATER] : buffers_[SEDIMENT];
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glGetNamedBufferSubData(buffer, 0, static_cast<GLsizeiptr>(out.data.size() * sizeof(float)), out.data.data());
+  }
+
+  void ComputeEroder::CopyToTexture(uint32_t texture) const
+  {
+    // the buffer's rows are pitch floats apart, the same as a heightfield's
+    glMemoryBarrier(GL_PIXEL_BUFFER_BARRIER_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers_[TERRAIN]);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(pitch_));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTextureSubImage2D(texture, 0, 0, 0, width_, height_, GL_RED, GL_FLOAT, nullptr);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  void ComputeEroder::BindBuffers() const
+  {
+    glBindBuffersBase(GL_SHADER_STORAGE_BUFFER, 0, NUM_BUFFERS, buffers_);
+  }
+
+  void ComputeEroder::Dispatch(const Shader& shader) const
+  {
+    shader.Bind();
+    glDispatchCompute((width_ + groupSize - 1) / groupSize, (height_ + groupSize - 1) / groupSize, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  }
+}
\ No newline at end of file
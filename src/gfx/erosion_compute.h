@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include "macros.h"
+#include "shader.h"
+#include "sim/heightfield.h"
+#include "sim/grid.h"
+#include "sim/thermal.h"
+
+namespace GFX
+{
+  // fields of the compute backend that can be read back
+  enum class ComputeField
+  {
+    TERRAIN,
+    WATER,
+    SEDIMENT,
+  };
+
+  // the grid and thermal stages of Erosion::Simulation as OpenGL 4.6 compute shaders, taking the same parameters.
+  // Every field lives in a storage buffer with the heightfield's pitched row layout, so uploads and readbacks are
+  // plain copies, and each shader is a port of the CPU pass of the same name
+  class ComputeEroder
+  {
+  public:
+    ComputeEroder(uint32_t width, uint32_t height, const Erosion::GridParams& grid, const Erosion::ThermalParams& thermal);
+    ~ComputeEroder();
+
+    NOCOPY_NOMOVE(ComputeEroder)
+
+    [[nodiscard]] uint32_t Width() const { return width_; }
+    [[nodiscard]] uint32_t Height() const { return height_; }
+    [[nodiscard]] uint64_t GetIteration() const { return iteration_; }
+
+    // replaces the terrain and removes all water and sediment, like Simulation::Init
+    void Upload(const Erosion::Heightfield& map);
+
+    // one simulation update: grid.stepsPerUpdate pipe-model steps, then the thermal steps if thermal.interval says so
+    void Update();
+
+    // single steps of the two stages, matching GridEroder::Step and ThermalEroder::Step
+    void StepGrid();
+    void StepThermal();
+
+    // waits for the GPU. out is resized to the eroder's size if it has a different one
+    void Download(ComputeField field, Erosion::Heightfield& out) const;
+
+    // copies the terrain into an R32F texture of the map's size, so it can be drawn without a round trip to the CPU
+    void CopyToTexture(uint32_t texture) const;
+
+  private:
+    // buffer roles, which are also the storage buffer binding points the shaders use
+    enum Buffer : uint32_t
+    {
+      TERRAIN,
+      WATER,
+      FLUX_L,
+      FLUX_R,
+      FLUX_T,
+      FLUX_B,
+      SEDIMENT,
+      VEL_X,
+      VEL_Y,
+      TERRAIN_OUT,
+      SEDIMENT_OUT,
+      OUTFLOW,
+      NUM_BUFFERS,
+    };
+
+    void BindBuffers() const;
+    void Dispatch(const Shader& shader) const;
+
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t pitch_;
+    Erosion::GridParams gridParams_;
+    Erosion::ThermalParams thermalParams_;
+    uint64_t iteration_ = 0;
+
+    uint32_t buffers_[NUM_BUFFERS]{};
+
+    Shader gridFlux_;
+    Shader gridErode_;
+    Shader gridTransport_;
+    Shader thermalOutflow_;
+    Shader thermalRelax_;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "frustum.h"
+
+#include <glm/geometric.hpp>
+
+namespace GFX
+{
+  Frustum Frustum::FromMatrix(const glm::mat4& matrix)
+  {
+    // Gribb and Hartmann: each plane is the sum or difference of the last row and one of the others
+    const glm::vec4 rowX = { matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0] };
+    const glm::vec4 rowY = { matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1] };
+    const glm::vec4 rowZ = { matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2] };
+    const glm::vec4 rowW = { matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3] };
+
+    Frustum frustum;
+    frustum.planes[0] = rowW + rowX;
+    frustum.planes[1] = rowW - rowX;
+    frustum.planes[2] = rowW + rowY;
+    frustum.planes[3] = rowW - rowY;
+    frustum.planes[4] = rowW + rowZ;
+    frustum.planes[5] = rowW - rowZ;
+    return frustum;
+  }
+
+  bool Frustum::Intersects(const glm::vec3& lo, const glm::vec3& hi) const
+  {
+    for (const glm::vec4& plane : planes)
+    {
+      // the corner furthest along the plane's normal
+      const glm::vec3 corner =
+      {
+        plane.x >= 0 ? hi.x : lo.x,
+        plane.y >= 0 ? hi.y : lo.y,
+        plane.z >= 0 ? hi.z : lo.z,
+      };
+      if (glm::dot(glm::vec3(plane), corner) + plane.w < 0)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+namespace GFX
+{
+  // the six planes bounding the volume a view-projection matrix maps into clip space, pointing inward
+  struct Frustum
+  {
+    glm::vec4 planes[6]{};
+
+    // planes of the space that matrix transforms from, so a viewProj * model matrix gives a frustum in model space.
+    // The near plane is the -w <= z one, which also contains everything a [0, 1] depth range keeps
+    static Frustum FromMatrix(const glm::mat4& matrix);
+
+    // false only if the box is entirely outside one of the planes, so boxes near the corners may pass
+    [[nodiscard]] bool Intersects(const glm::vec3& lo, const glm::vec3& hi) const;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "heightmap_texture.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <glad/gl.h>
+
+namespace GFX
+{
+  HeightmapTexture::HeightmapTexture(uint32_t width, uint32_t height)
+    : width_(width),
+      height_(height),
+      // a region holds a whole map's heights and gradients where that is affordable. Larger updates spill into direct uploads
+      ring_(std::min(static_cast<size_t>(width) * height * 3 * sizeof(float), maxFrameBytes))
+  {
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture_);
+    glTextureStorage2D(texture_, 1, GL_R32F, width, height);
+    glCreateTextures(GL_TEXTURE_2D, 1, &normalTexture_);
+    glTextureStorage2D(normalTexture_, 1, GL_RG32F, width, height);
+
+    for (GLuint texture : { texture_, normalTexture_ })
+    {
+      glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+      glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+    }
+  }
+
+  HeightmapTexture::~HeightmapTexture()
+  {
+    glDeleteTextures(1, &normalTexture_);
+    glDeleteTextures(1, &texture_);
+  }
+
+  void HeightmapTexture::Update(const Erosion::Heightfield& map, const Erosion::NormalMap& normals, const Erosion::DirtyTiles& dirty)
+  {
+    stats_.bytes = 0;
+    stats_.rects = 0;
+    stats_.stalls = 0;
+    if (!dirty.Any())
+    {
+      return;
+    }
+
+    // uploads that do not fit spill into direct ones, so the ring never has to grow
+    const uint64_t stalls = ring_.Stalls();
+    ring_.BeginFrame(0);
+    stats_.stalls = static_cast<uint32_t>(ring_.Stalls() - stalls);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring_.Buffer());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    dirty.ForEachRect([&](const Erosion::DirtyRect& rect)
+      {
+        Upload(texture_, map.data.data(), map.pitch, 1, rect);
+
+        // the gradients next to the rect read its heights too
+        Upload(normalTexture_, normals.data.data(), normals.pitch, 2, normals.Affected(rect));
+        stats_.rects++;
+      });
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    ring_.EndFrame();
+    stats_.totalBytes += stats_.bytes;
+  }
+
+  void HeightmapTexture::Upload(uint32_t texture, const float* field, uint32_t pitch, uint32_t channels, const Erosion::DirtyRect& rect)
+  {
+    const GLenum format = channels == 2 ? GL_RG : GL_RED;
+    const uint32_t w = rect.x1 - rect.x0;
+    const uint32_t h = rect.y1 - rect.y0;
+    const size_t rowFloats = static_cast<size_t>(pitch) * channels;
+    const float* first = field + rect.y0 * rowFloats + rect.x0 * channels;
+    const size_t rowBytes = w * channels * sizeof(float);
+    const size_t bytes = rowBytes * h;
+
+    if (ring_.Fits(bytes, sizeof(float)))
+    {
+      // pack the rows tightly into the ring, the GPU copies them into the texture later
+      const UploadAllocation allocation = ring_.Allocate(bytes, sizeof(float));
+      std::byte* dst = allocation.data;
+      for (uint32_t y = 0; y < h; y++, dst += rowBytes)
+      {
+        std::memcpy(dst, first + y * rowFloats, rowBytes);
+      }
+      glTextureSubImage2D(texture, 0, rect.x0, rect.y0, w, h, format, GL_FLOAT, reinterpret_cast<const void*>(allocation.offset));
+    }
+    else
+    {
+      // does not fit in what is left of the region, so the driver copies it out of the padded rows instead
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(pitch));
+      glTextureSubImage2D(texture, 0, rect.x0, rect.y0, w, h, format, GL_FLOAT, first);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring_.Buffer());
+    }
+
+    stats_.bytes += bytes;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "macros.h"
+#include "renderer.h"
+#include "upload_ring.h"
+#include "sim/heightfield.h"
+#include "sim/dirty_tiles.h"
+#include "sim/normals.h"
+
+namespace GFX
+{
+  struct HeightmapUploadStats
+  {
+    uint64_t bytes{};         // copied to the texture by the last Update
+    uint32_t rects{};
+    uint32_t stalls{};        // times the last Update waited for the GPU to release a ring region
+    uint64_t totalBytes{};    // over the lifetime of the texture
+  };
+
+  // GPU copy of a simulation heightfield and its normal map, kept current by uploading only the tiles that changed.
+  // Uploads are staged in an UploadRing, so the copy to the textures runs asynchronously
+  class HeightmapTexture
+  {
+  public:
+    static constexpr size_t maxFrameBytes = 16 << 20;
+
+    HeightmapTexture(uint32_t width, uint32_t height);
+    ~HeightmapTexture();
+
+    NOCOPY_NOMOVE(HeightmapTexture)
+
+    // copies the dirty tiles of map, and the gradients of normals that depend on them. Both must have the size the
+    // texture was created with, and normals must already be updated from the same dirty tiles
+    void Update(const Erosion::Heightfield& map, const Erosion::NormalMap& normals, const Erosion::DirtyTiles& dirty);
+
+    [[nodiscard]] Heightmap GetHeightmap() const { return { width_, height_, texture_, normalTexture_ }; }
+    [[nodiscard]] const HeightmapUploadStats& Stats() const { return stats_; }
+
+  private:
+    // copies rect of a field with channels floats per cell and rows pitch cells apart into texture, through the
+    // ring if what is left of its region has room and straight from field otherwise
+    void Upload(uint32_t texture, const float* field, uint32_t pitch, uint32_t channels, const Erosion::DirtyRect& rect);
+
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t texture_{};
+    uint32_t normalTexture_{};
+
+    UploadRing ring_;
+
+    HeightmapUploadStats stats_;
+  };
+}
\ No newline at end of file
@@ -5,6 +5,13 @@
 #include <format>
 #include <concepts>
 #include <atomic>
+#include <vector>
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <thread>
+#include <cstring>
+#include <limits>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -14,7 +21,12 @@
 #include "shader.h"
 #include "mesh.h"
 #include "camera.h"
+#include "frustum.h"
+#include "terrain_quadtree.h"
+#include "upload_ring.h"
+#include "culling.h"
 #include "components.h"
+#include "utility/radix_sort.h"
 
 static void GLAPIENTRY glErrorCallback(
   GLenum source,
@@ -83,13 +95,49 @@ namespace GFX
 {
   namespace
   {
-    struct RenderTuple
+    // draw sort keys hold, from the most significant bits down, the pass, the mesh's index in RendererImpl::meshes
+    // and the squared distance to the viewer. Opaque objects come first, front to back so the depth test rejects
+    // what they cover, then translucent ones back to front. Runs of keys with the same pass and mesh become one draw
+    constexpr uint64_t opaquePass = 0;
+    constexpr uint64_t translucentPass = 1;
+    constexpr uint64_t hiddenKey = UINT64_MAX;   // empty slots and meshes, sorts after everything that may be drawn
+
+    uint64_t DrawKey(uint64_t pass, uint32_t mesh, float distanceSquared)
     {
-      glm::mat4 model;
-      MeshHandle mesh;
-      Renderable renderable;
+      // non-negative floats order like their bits
+      const auto depth = std::bit_cast<uint32_t>(distanceSquared);
+      return pass << 60 | static_cast<uint64_t>(mesh) << 32 | (pass == translucentPass ? ~depth : depth);
+    }
+
+    // slots of the instance array a thread has reserved for its Submit calls
+    struct SubmitBlock
+    {
+      const void* renderer{};
+      uint64_t frame{};
+      uint32_t next{};
+      uint32_t end{};
     };
 
+    // replaces buffer with one of at least size bytes that keeps its first used bytes. Capacity doubles, so
+    // buffers that grow a little at a time are rarely reallocated
+    void GrowBuffer(GLuint& buffer, size_t& capacity, size_t used, size_t size, GLbitfield flags)
+    {
+      if (size <= capacity)
+      {
+        return;
+      }
+      capacity = std::max(size, 2 * capacity);
+      GLuint grown{};
+      glCreateBuffers(1, &grown);
+      glNamedBufferStorage(grown, capacity, nullptr, flags);
+      if (used > 0)
+      {
+        glCopyNamedBufferSubData(buffer, grown, 0, 0, used);
+      }
+      glDeleteBuffers(1, &buffer);
+      buffer = grown;
+    }
+
     constexpr int gl_index_type()
     {
       if constexpr (std::same_as<index_t, uint32_t>)
@@ -114,7 +162,57 @@ namespace GFX
     Shader environmentShader{};
     Shader heightmapShader{};
 
-    std::vector<RenderTuple> renderables;
+    // terrain: one indexed grid patch that every quadtree node is drawn with, followed by its top left quarter for
+    // quarter nodes, and the nodes picked for the view
+    GLuint terrainVao{};
+    GLuint patchIndexBuffer{};
+    uint32_t patchSize{};
+    uint32_t patchIndexCount{};
+    uint32_t quarterIndexCount{};
+    UploadRing nodeRing{ 64 << 10 };
+    TerrainSelection terrainSelection;
+
+    // every mesh's vertices and indices, so objects of different meshes can be drawn by a single indirect draw
+    GLuint meshVertexBuffer{};
+    GLuint meshIndexBuffer{};
+    size_t meshVertexBytes{};
+    size_t meshIndexBytes{};
+    size_t meshVertexCapacity{};
+    size_t meshIndexCapacity{};
+    std::vector<MeshHandle> meshes;   // in the order they were added, which is by firstIndex
+    std::vector<MeshBounds> meshBounds;
+
+    // each frame's objects: Submit writes their instance data straight into the ring, and EndDraw follows it with
+    // the order to draw them in and a draw of each mesh's run of them.
+    // Threads reserve slots submitBlock at a time, so they rarely touch the shared counter and write to their own
+    // cache lines. A thread's last block may be left partly empty, so the instance array has room for a block per
+    // thread on top of the objects, and the empty slots keep hiddenKey
+    static constexpr uint32_t submitBlock = 64;
+    const uint32_t maxSubmitThreads = std::max(std::thread::hardware_concurrency(), 16u);
+    UploadRing objectRing{ 1 << 20 };
+    UploadAllocation instances{};
+    InstanceData* submitted{};   // where Submit writes instances, the ring or cpuInstances
+    uint32_t numInstances{};
+    uint64_t frame{};
+    glm::vec3 drawViewPos{};
+    std::atomic_uint32_t droppedObjects{ 0 };
+    size_t storageAlignment{};
+    std::vector<uint64_t> drawKeys;
+    std::vector<uint32_t> drawSlots;
+    ThreadPool sortPool;
+    RadixSortScratch sortScratch;
+
+    // the sorted objects of each mesh and pass are one draw's candidates, which the culler drops the invisible,
+    // outside and occluded ones from. The ring is write only, so the CPU backend culls copies and uploads the result
+    InstanceCuller culler;
+    CullBackend cullBackend = CullBackend::GPU;
+    CullBackend frameCullBackend = CullBackend::GPU;   // the backend as of BeginDraw
+    bool occlusionCulling = true;
+    std::vector<InstanceData> cpuInstances;
+    std::vector<uint32_t> cpuDrawOrder;
+    std::vector<DrawElementsIndirectCommand> drawCommands;
+    std::vector<MeshBounds> drawBounds;
+
     glm::vec3 sunDir = { 0, -1, 0 };
     float blendDay = 0;
     double gTime = 10.0;
@@ -140,6 +238,13 @@ namespace GFX
       glVertexArrayAttribBinding(standardVao, 1, 0);
       glVertexArrayAttribBinding(standardVao, 2, 0);
 
+      // the terrain's positions come from the patch's indices and the heightmap, so it has no attributes
+      glCreateVertexArrays(1, &terrainVao);
+
+      GLint alignment{};
+      glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+      storageAlignment = std::max(alignment, 16);
+
       standardShader = LoadVertexFragmentProgram("standard.vert.glsl", "standard.frag.glsl");
       environmentShader = LoadVertexFragmentProgram("environment.vert.glsl", "environment.frag.glsl");
       heightmapShader = LoadVertexFragmentProgram("heightmap.vert.glsl", "heightmap.frag.glsl");
@@ -159,6 +264,7 @@ namespace GFX
     {
       glDeleteVertexArrays(1, &emptyVao);
       glDeleteVertexArrays(1, &standardVao);
+      glDeleteVertexArrays(1, &terrainVao);
       // everything else is leaked because this class is instantiated once and destroyed when the program terminates
     }
 
@@ -218,18 +324,113 @@ namespace GFX
       glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
-    void BeginDraw(uint32_t numObjects)
+    MeshHandle GenerateMeshHandle(const Mesh& mesh)
+    {
+      const size_t vertexBytes = sizeof(Vertex) * mesh.vertices.size();
+      const size_t indexBytes = sizeof(index_t) * mesh.indices.size();
+      MeshHandle handle
+      {
+        .count = static_cast<uint32_t>(mesh.indices.size()),
+        .firstIndex = static_cast<uint32_t>(meshIndexBytes / sizeof(index_t)),
+        .baseVertex = static_cast<int32_t>(meshVertexBytes / sizeof(Vertex)),
+      };
+
+      GrowBuffer(meshVertexBuffer, meshVertexCapacity, meshVertexBytes, meshVertexBytes + vertexBytes, GL_DYNAMIC_STORAGE_BIT);
+      GrowBuffer(meshIndexBuffer, meshIndexCapacity, meshIndexBytes, meshIndexBytes + indexBytes, GL_DYNAMIC_STORAGE_BIT);
+      glNamedBufferSubData(meshVertexBuffer, meshVertexBytes, vertexBytes, mesh.vertices.data());
+      glNamedBufferSubData(meshIndexBuffer, meshIndexBytes, indexBytes, mesh.indices.data());
+      meshVertexBytes += vertexBytes;
+      meshIndexBytes += indexBytes;
+
+      glVertexArrayVertexBuffer(standardVao, 0, meshVertexBuffer, 0, sizeof(Vertex));
+      glVertexArrayElementBuffer(standardVao, meshIndexBuffer);
+      meshes.push_back(handle);
+
+      // a sphere around the vertices' bounding box, which is close enough for the boxes and spheres objects are made of
+      glm::vec3 lo(std::numeric_limits<float>::max());
+      glm::vec3 hi(std::numeric_limits<float>::lowest());
+      for (const Vertex& vertex : mesh.vertices)
+      {
+        lo = glm::min(lo, vertex.position);
+        hi = glm::max(hi, vertex.position);
+      }
+      const glm::vec3 center = mesh.vertices.empty() ? glm::vec3(0) : (lo + hi) * 0.5f;
+      float radiusSquared = 0;
+      for (const Vertex& vertex : mesh.vertices)
+      {
+        const glm::vec3 offset = vertex.position - center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+      }
+      meshBounds.push_back(MeshBounds(center, std::sqrt(radiusSquared)));
+      return handle;
+    }
+
+    void BeginDraw(const Camera& camera, uint32_t numObjects)
     {
       drawIndex.store(0);
-      renderables.resize(numObjects);
+      droppedObjects.store(0);
+      frame++;
+      drawViewPos = camera.viewInfo.position;
+      numInstances = numObjects + submitBlock * maxSubmitThreads;
+      drawKeys.assign(numInstances, hiddenKey);
+      drawSlots.resize(numInstances);
+
+      // room for the instances, the candidates, the draw order and a draw and mesh bounds per mesh and pass, each
+      // starting on a binding boundary
+      const size_t numDraws = std::min<size_t>(numObjects, 2 * meshes.size());
+      objectRing.BeginFrame(numInstances * (sizeof(InstanceData) + 2 * sizeof(uint32_t)) +
+        numDraws * (sizeof(DrawElementsIndirectCommand) + sizeof(MeshBounds)) + 5 * storageAlignment);
+      instances = objectRing.Allocate(numInstances * sizeof(InstanceData), storageAlignment);
+      frameCullBackend = cullBackend;
+      if (frameCullBackend == CullBackend::CPU)
+      {
+        cpuInstances.resize(numInstances);
+        submitted = cpuInstances.data();
+      }
+      else
+      {
+        submitted = reinterpret_cast<InstanceData*>(instances.data);
+      }
     }
 
+    // called from any number of threads at once, each object goes to its own slot of the mapped instance data
     void Submit(const Transform& transform,
       const MeshHandle& mesh,
       const Renderable& renderable)
     {
-      uint32_t myIndex = drawIndex.fetch_add(1);
-      renderables[myIndex] = { transform.GetModel(), mesh, renderable };
+      // per thread, which is only safe while a thread does not interleave two calls
+      thread_local SubmitBlock block;
+      if (block.renderer != this || block.frame != frame || block.next == block.end)
+      {
+        const uint32_t start = drawIndex.fetch_add(submitBlock, std::memory_order_relaxed);
+        if (start >= numInstances)
+        {
+          // more threads submitted than there are blocks set aside for
+          assert(false && "renderer ran out of submission slots");
+          droppedObjects.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        block = { this, frame, start, std::min(start + submitBlock, numInstances) };
+      }
+      const uint32_t slot = block.next++;
+
+      const glm::mat4 model = transform.GetModel();
+      submitted[slot] =
+      {
+        .model = model,
+        .color = renderable.color,
+        .glow = renderable.glow,
+        .flags = renderable.visible ? instanceVisible : 0,
+      };
+      drawSlots[slot] = slot;
+      if (mesh.count > 0)
+      {
+        // meshes are in firstIndex order, and an empty one shares its first index with the next one
+        const auto meshIndex = static_cast<uint32_t>(std::upper_bound(meshes.begin(), meshes.end(), mesh.firstIndex,
+          [](uint32_t index, const MeshHandle& m) { return index < m.firstIndex; }) - meshes.begin() - 1);
+        const glm::vec3 toView = glm::vec3(model[3]) - drawViewPos;
+        drawKeys[slot] = DrawKey(renderable.color.w < 1.0f ? translucentPass : opaquePass, meshIndex, glm::dot(toView, toView));
+      }
     }
 
     void EndDraw(const Camera& camera, float dt)
@@ -239,6 +440,7 @@ namespace GFX
       glEnable(GL_FRAMEBUFFER_SRGB);
 
       DrawRenderables(camera);
+      objectRing.EndFrame();
       DrawEnvironment(camera);
 
       sunDir.y = -glm::sin(gTime / 10);
@@ -250,29 +452,104 @@ namespace GFX
 
     void DrawRenderables(const Camera& camera)
     {
-      standardShader.Bind();
       standardShader.SetMat4("u_viewProj", camera.GetViewProj());
       standardShader.SetVec3("u_sunDir", sunDir);
       standardShader.SetFloat("u_blendDay", blendDay);
-      glBindVertexArray(standardVao);
 
-      // TODO: sort by mesh to reduce binding
-      for (const auto& [model, mesh, renderable] : renderables)
+      // empty meshes and slots sort last, everything else is a candidate for culling
+      const uint32_t numReserved = std::min(drawIndex.load(), numInstances);
+      RadixSortPairs(std::span(drawKeys).first(numReserved), std::span(drawSlots).first(numReserved), sortScratch, sortPool);
+      const auto numCandidates = static_cast<uint32_t>(std::lower_bound(drawKeys.begin(), drawKeys.begin() + numReserved, hiddenKey) - drawKeys.begin());
+      if (numCandidates == 0)
+      {
+        return;
+      }
+
+      // one instanced draw per run of objects with the same pass and mesh, which culling shortens
+      drawCommands.clear();
+      drawBounds.clear();
+      uint32_t runStart = 0;
+      for (uint32_t i = 1; i <= numCandidates; i++)
       {
-        if (!renderable.visible)
+        if (i < numCandidates && (drawKeys[i] >> 32) == (drawKeys[runStart] >> 32))
         {
           continue;
         }
 
-        standardShader.SetMat4("u_model", model);
-        standardShader.SetVec4("u_color", renderable.color);
-        standardShader.SetVec3("u_glow", renderable.glow);
-        glVertexArrayVertexBuffer(standardVao, 0, mesh.vertexBuffer, 0, sizeof(Vertex));
-        glVertexArrayElementBuffer(standardVao, mesh.indexBuffer);
-        glDrawElements(GL_TRIANGLES, mesh.count, gl_index_type(), nullptr);
+        const uint32_t meshIndex = (drawKeys[runStart] >> 32) & 0x0FFFFFFF;
+        const MeshHandle& mesh = meshes[meshIndex];
+        drawCommands.push_back(
+          {
+            .count = mesh.count,
+            .instanceCount = i - runStart,
+            .firstIndex = mesh.firstIndex,
+            .baseVertex = mesh.baseVertex,
+            .baseInstance = runStart,
+          });
+        drawBounds.push_back(meshBounds[meshIndex]);
+        runStart = i;
       }
 
-      renderables.clear();
+      // the shader finds instances through the draw order, so only the keys move and the instances stay where Submit put them
+      const auto numDraws = static_cast<uint32_t>(drawCommands.size());
+      const size_t orderBytes = numCandidates * sizeof(uint32_t);
+      const size_t drawBytes = numDraws * sizeof(DrawElementsIndirectCommand);
+      const UploadAllocation order = objectRing.Allocate(orderBytes, storageAlignment);
+      const UploadAllocation draws = objectRing.Allocate(drawBytes, storageAlignment);
+      const CullView view = culler.View(camera.GetViewProj(), occlusionCulling);
+      if (frameCullBackend == CullBackend::CPU)
+      {
+        cpuDrawOrder.resize(numCandidates);
+        culler.CullCPU(view,
+          {
+            .numDraws = numDraws,
+            .instances = cpuInstances.data(),
+            .candidates = drawSlots.data(),
+            .bounds = drawBounds.data(),
+            .draws = drawCommands.data(),
+            .drawOrder = cpuDrawOrder.data(),
+          }, sortPool);
+        std::copy_n(cpuInstances.data(), numReserved, reinterpret_cast<InstanceData*>(instances.data));
+        std::memcpy(order.data, cpuDrawOrder.data(), orderBytes);
+        std::memcpy(draws.data, drawCommands.data(), drawBytes);
+      }
+      else
+      {
+        const UploadAllocation candidates = objectRing.Allocate(orderBytes, storageAlignment);
+        const UploadAllocation bounds = objectRing.Allocate(numDraws * sizeof(MeshBounds), storageAlignment);
+        std::memcpy(candidates.data, drawSlots.data(), orderBytes);
+        std::memcpy(bounds.data, drawBounds.data(), numDraws * sizeof(MeshBounds));
+        std::memcpy(draws.data, drawCommands.data(), drawBytes);
+        const uint32_t ring = objectRing.Buffer();
+        culler.Cull(view,
+          {
+            .numDraws = numDraws,
+            .instances = { ring, instances.offset, numInstances * sizeof(InstanceData) },
+            .candidates = { ring, candidates.offset, orderBytes },
+            .bounds = { ring, bounds.offset, numDraws * sizeof(MeshBounds) },
+            .draws = { ring, draws.offset, drawBytes },
+            .drawOrder = { ring, order.offset, orderBytes },
+          });
+      }
+
+      standardShader.Bind();
+      glBindVertexArray(standardVao);
+      glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, objectRing.Buffer(), instances.offset, numInstances * sizeof(InstanceData));
+      glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, objectRing.Buffer(), order.offset, orderBytes);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, objectRing.Buffer());
+      glMultiDrawElementsIndirect(GL_TRIANGLES, gl_index_type(), reinterpret_cast<const void*>(draws.offset), static_cast<GLsizei>(numDraws), 0);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    void SetCulling(CullBackend backend, bool occlusion)
+    {
+      cullBackend = backend;
+      occlusionCulling = occlusion;
+    }
+
+    void CaptureDepth(const Camera& camera)
+    {
+      culler.CaptureDepth(camera.GetViewProj());
     }
 
     void DrawEnvironment(const Camera& camera)
@@ -286,21 +563,103 @@ namespace GFX
       glDrawArrays(GL_TRIANGLES, 0, 3);
     }
 
-    void DrawHeightmap(const Camera& camera, Heightmap heightmap)
+    // a grid of size^2 quads whose vertex IDs are y * (size + 1) + x, so the vertex shader can place them, and then
+    // the quads of its top left quarter again
+    void BuildPatch(uint32_t size)
+    {
+      const uint32_t stride = size + 1;
+      std::vector<uint32_t> indices;
+      indices.reserve(6 * size * size + 6 * (size / 2) * (size / 2));
+      for (uint32_t quads : { size, size / 2 })
+      {
+        for (uint32_t y = 0; y < quads; y++)
+        {
+          for (uint32_t x = 0; x < quads; x++)
+          {
+            const uint32_t v00 = y * stride + x;
+            const uint32_t v10 = v00 + 1;
+            const uint32_t v01 = v00 + stride;
+            const uint32_t v11 = v01 + 1;
+            indices.insert(indices.end(), { v00, v11, v10, v01, v11, v00 });
+          }
+        }
+      }
+
+      glDeleteBuffers(1, &patchIndexBuffer);
+      glCreateBuffers(1, &patchIndexBuffer);
+      glNamedBufferStorage(patchIndexBuffer, indices.size() * sizeof(uint32_t), indices.data(), 0);
+      glVertexArrayElementBuffer(terrainVao, patchIndexBuffer);
+      patchSize = size;
+      patchIndexCount = 6 * size * size;
+      quarterIndexCount = static_cast<uint32_t>(indices.size()) - patchIndexCount;
+    }
+
+    TerrainDrawStats DrawHeightmap(const Camera& camera, Heightmap heightmap, const TerrainQuadtree& quadtree)
     {
+      assert(quadtree.Width() == heightmap.width && quadtree.Height() == heightmap.height);
+
+      constexpr float terrainScale = 10;
       glm::mat4 model(1);
-      model = glm::scale(model, glm::vec3(10));
+      model = glm::scale(model, glm::vec3(terrainScale));
+
+      // LOD distances are measured in the heightmap's model space
+      const glm::vec3 viewPos = camera.viewInfo.position / terrainScale;
+      quadtree.Select(Frustum::FromMatrix(camera.GetViewProj() * model), viewPos, terrainSelection);
+
+      const auto& nodes = terrainSelection.nodes;
+      const auto& quarters = terrainSelection.quarters;
+      TerrainDrawStats stats
+      {
+        .nodes = static_cast<uint32_t>(nodes.size() + quarters.size()),
+        .culledNodes = terrainSelection.culled,
+      };
+      if (stats.nodes == 0)
+      {
+        return stats;
+      }
+
+      if (patchSize != quadtree.PatchSize())
+      {
+        BuildPatch(quadtree.PatchSize());
+      }
+      // whole nodes first, then quarters
+      nodeRing.BeginFrame(stats.nodes * sizeof(TerrainNode));
+      const UploadAllocation nodeData = nodeRing.Allocate(stats.nodes * sizeof(TerrainNode), storageAlignment);
+      std::copy(nodes.begin(), nodes.end(), reinterpret_cast<TerrainNode*>(nodeData.data));
+      std::copy(quarters.begin(), quarters.end(), reinterpret_cast<TerrainNode*>(nodeData.data) + nodes.size());
+
+      glm::vec2 morphRanges[TerrainQuadtree::maxLevels]{};
+      for (uint32_t level = 0; level < quadtree.NumLevels(); level++)
+      {
+        morphRanges[level] = quadtree.MorphRange(level);
+      }
 
       glBindTextureUnit(0, heightmap.texture);
+      glBindTextureUnit(1, heightmap.normalTexture);
+      glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, nodeRing.Buffer(), nodeData.offset, stats.nodes * sizeof(TerrainNode));
 
       heightmapShader.Bind();
       heightmapShader.SetMat4("u_viewProj", camera.GetViewProj());
       heightmapShader.SetMat4("u_model", model);
       heightmapShader.SetUInt("u_width", heightmap.width);
       heightmapShader.SetUInt("u_height", heightmap.height);
-
-      glBindVertexArray(emptyVao);
-      glDrawArrays(GL_TRIANGLES, 0, 6 * heightmap.width * heightmap.height);
+      heightmapShader.SetUInt("u_patchSize", patchSize);
+      heightmapShader.SetVec2("u_viewPos", { viewPos.x, viewPos.z });
+      heightmapShader.SetFloat("u_viewHeight", quadtree.ViewHeight(viewPos));
+      heightmapShader.Set2FloatArray("u_morphRanges[0]", morphRanges);
+      heightmapShader.SetVec3("u_sunDir", sunDir);
+      heightmapShader.SetFloat("u_blendDay", blendDay);
+
+      // one instance per node, the base instance says where a draw's nodes start
+      glBindVertexArray(terrainVao);
+      glDrawElementsInstancedBaseInstance(GL_TRIANGLES, patchIndexCount, GL_UNSIGNED_INT, nullptr,
+        static_cast<GLsizei>(nodes.size()), 0);
+      glDrawElementsInstancedBaseInstance(GL_TRIANGLES, quarterIndexCount, GL_UNSIGNED_INT,
+        reinterpret_cast<const void*>(patchIndexCount * sizeof(uint32_t)), static_cast<GLsizei>(quarters.size()), static_cast<GLuint>(nodes.size()));
+      nodeRing.EndFrame();
+
+      stats.triangles = (patchIndexCount * nodes.size() + quarterIndexCount * quarters.size()) / 3;
+      return stats;
     }
   };
 
@@ -316,21 +675,12 @@ namespace GFX
 
   MeshHandle Renderer::GenerateMeshHandle(const Mesh& mesh)
   {
-    MeshHandle handle;
-    handle.count = mesh.vertices.size();
-    
-    glCreateBuffers(1, &handle.vertexBuffer);
-    glNamedBufferStorage(handle.vertexBuffer, sizeof(Vertex) * mesh.vertices.size(), mesh.vertices.data(), 0);
-
-    glCreateBuffers(1, &handle.indexBuffer);
-    glNamedBufferStorage(handle.indexBuffer, sizeof(index_t) * mesh.indices.size(), mesh.indices.data(), 0);
-
-    return handle;
+    return impl_->GenerateMeshHandle(mesh);
   }
 
-  void Renderer::BeginDraw(uint32_t numObjects)
+  void Renderer::BeginDraw(const Camera& camera, uint32_t numObjects)
   {
-    impl_->BeginDraw(numObjects);
+    impl_->BeginDraw(camera, numObjects);
   }
 
   void Renderer::Submit(const Transform& transform,
@@ -345,8 +695,18 @@ namespace GFX
     impl_->EndDraw(camera, dt);
   }
 
-  void Renderer::DrawHeightmap(const Camera& camera, Heightmap heightmap)
+  void Renderer::SetCulling(CullBackend backend, bool occlusion)
+  {
+    impl_->SetCulling(backend, occlusion);
+  }
+
+  void Renderer::CaptureDepth(const Camera& camera)
+  {
+    impl_->CaptureDepth(camera);
+  }
+
+  TerrainDrawStats Renderer::DrawHeightmap(const Camera& camera, Heightmap heightmap, const TerrainQuadtree& quadtree)
   {
-    impl_->DrawHeightmap(camera, heightmap);
+    return impl_->DrawHeightmap(camera, heightmap, quadtree);
   }
 }
\ No newline at end of file
@@ -11,12 +11,28 @@ namespace GFX
 {
   struct Camera;
   struct Mesh;
+  class TerrainQuadtree;
 
   struct Heightmap
   {
     uint32_t width{ 1 };
     uint32_t height{ 1 };
     uint32_t texture{};
+    uint32_t normalTexture{};   // the height gradient per texel, in heights per texel
+  };
+
+  // where objects are culled. Both give the same draws, CPU reads the depth pyramid back every frame it is captured
+  enum class CullBackend
+  {
+    GPU,
+    CPU,
+  };
+
+  struct TerrainDrawStats
+  {
+    uint32_t nodes{};
+    uint32_t culledNodes{};
+    uint64_t triangles{};
   };
 
   class Renderer
@@ -27,15 +43,25 @@ namespace GFX
 
     NOCOPY_NOMOVE(Renderer)
 
+    // appends the mesh to the vertices and indices shared by every mesh, which lets EndDraw draw all objects at once
     [[nodiscard]] MeshHandle GenerateMeshHandle(const Mesh& mesh);
 
-    void BeginDraw(uint32_t numObjects);
+    // objects are sorted by their distance from camera. Submit may be called from many threads at once, but each
+    // thread must finish one call before starting the next, so unsequenced execution policies are not allowed
+    void BeginDraw(const Camera& camera, uint32_t numObjects);
     void Submit(const Transform& transform,
       const MeshHandle& mesh,
       const Renderable& renderable);
     void EndDraw(const Camera& camera, float dt);
 
-    void DrawHeightmap(const Camera& camera, Heightmap heightmap);
+    // objects are always culled against the view. With occlusion they are also culled against the depth of the last
+    // CaptureDepth, which should come after the frame's last draw that writes depth
+    void SetCulling(CullBackend backend, bool occlusion);
+    void CaptureDepth(const Camera& camera);
+
+    // draws the heightmap with the level of detail the quadtree picks for the view. The quadtree must be for a map
+    // of the heightmap's size
+    TerrainDrawStats DrawHeightmap(const Camera& camera, Heightmap heightmap, const TerrainQuadtree& quadtree);
 
   private:
     struct RendererImpl* impl_;
@@ -1,5 +1,6 @@
 #include "shader.h"
 
+#include <cassert>
 #include <span>
 #include <string_view>
 #include <stdexcept>
@@ -210,4 +211,25 @@ namespace GFX
       .uniforms = InitUniforms(program)
     };
   }
+
+  Shader LoadComputeProgram(std::string_view csFile)
+  {
+    std::string computeSource = LoadFile(csFile);
+
+    auto computeShader = CompileShader(GL_COMPUTE_SHADER, computeSource);
+    Defer a = [computeShader]() { glDeleteShader(computeShader); };
+
+    auto program = glCreateProgram();
+
+    glAttachShader(program, computeShader);
+
+    try { LinkProgram(program); }
+    catch (std::runtime_error& e) { glDeleteProgram(program); throw e; }
+
+    return Shader
+    {
+      .program = program,
+      .uniforms = InitUniforms(program)
+    };
+  }
 }
\ No newline at end of file
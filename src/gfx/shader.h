@@ -36,4 +36,5 @@ namespace GFX
   };
 
   Shader LoadVertexFragmentProgram(std::string_view vsFile, std::string_view fsFile);
+  Shader LoadComputeProgram(std::string_view csFile);
 }
\ No newline at end of file
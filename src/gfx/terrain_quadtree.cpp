@@ -0,0 +1,209 @@
+#include "terrain_quadtree.h"
+
+#include <algorithm>
+#include <format>
+#include <limits>
+#include <stdexcept>
+
+namespace GFX
+{
+  namespace
+  {
+    // whether any part of the box is within LOD distance radius of the viewer
+    bool InRange(const glm::vec2& viewPos, float viewHeight, float radius, const glm::vec3& lo, const glm::vec3& hi)
+    {
+      const float dx = std::max({ lo.x - viewPos.x, 0.0f, viewPos.x - hi.x });
+      const float dz = std::max({ lo.z - viewPos.y, 0.0f, viewPos.y - hi.z });
+      return dx * dx + dz * dz + viewHeight * viewHeight <= radius * radius;
+    }
+  }
+
+  TerrainQuadtree::TerrainQuadtree(uint32_t width, uint32_t height, uint32_t patchSize)
+    : width_(width),
+      height_(height),
+      patchSize_(patchSize)
+  {
+    if (patchSize == 0 || patchSize % 2 != 0)
+    {
+      throw std::runtime_error(std::format("terrain patch size must be positive and even, not {}", patchSize));
+    }
+
+    // levels up to the first one whose single node covers the whole map
+    for (uint32_t level = 0; level < maxLevels; level++)
+    {
+      const uint64_t nodeSize = static_cast<uint64_t>(patchSize) << level;
+      Level& l = levels_.emplace_back();
+      l.nodesX = static_cast<uint32_t>((width + nodeSize - 1) / nodeSize);
+      l.nodesY = static_cast<uint32_t>((height + nodeSize - 1) / nodeSize);
+      l.bounds.resize(static_cast<size_t>(l.nodesX) * l.nodesY);
+      if (l.nodesX == 1 && l.nodesY == 1)
+      {
+        break;
+      }
+    }
+    if (levels_.back().nodesX != 1 || levels_.back().nodesY != 1)
+    {
+      throw std::runtime_error(std::format("a {}x{} map needs more than {} levels of {} quad patches", width, height, maxLevels, patchSize));
+    }
+  }
+
+  void TerrainQuadtree::Update(const Erosion::Heightfield& map, const Erosion::DirtyTiles& dirty)
+  {
+    dirty.ForEachRect([&](const Erosion::DirtyRect& rect) { Update(map, rect); });
+  }
+
+  void TerrainQuadtree::Update(const Erosion::Heightfield& map, const Erosion::DirtyRect& rect)
+  {
+    if (map.width != width_ || map.height != height_)
+    {
+      throw std::runtime_error(std::format("terrain quadtree is for a {}x{} map, not {}x{}", width_, height_, map.width, map.height));
+    }
+    if (rect.Empty())
+    {
+      return;
+    }
+
+    // the vertices of a node sit on texel corners, and linear filtering blends the texels on both sides of them,
+    // so leaf c samples texels c * patchSize - 1 through (c + 1) * patchSize
+    Level& leaves = levels_[0];
+    uint32_t nx0 = rect.x0 > 0 ? (rect.x0 - 1) / patchSize_ : 0;
+    uint32_t ny0 = rect.y0 > 0 ? (rect.y0 - 1) / patchSize_ : 0;
+    uint32_t nx1 = std::min(rect.x1 / patchSize_, leaves.nodesX - 1);
+    uint32_t ny1 = std::min(rect.y1 / patchSize_, leaves.nodesY - 1);
+
+    for (uint32_t ny = ny0; ny <= ny1; ny++)
+    {
+      const uint32_t y0 = ny * patchSize_ > 0 ? ny * patchSize_ - 1 : 0;
+      const uint32_t y1 = std::min((ny + 1) * patchSize_ + 1, height_);
+      for (uint32_t nx = nx0; nx <= nx1; nx++)
+      {
+        const uint32_t x0 = nx * patchSize_ > 0 ? nx * patchSize_ - 1 : 0;
+        const uint32_t x1 = std::min((nx + 1) * patchSize_ + 1, width_);
+
+        float lo = map.At(x0, y0);
+        float hi = lo;
+        for (uint32_t y = y0; y < y1; y++)
+        {
+          const float* row = map.Row(y);
+          for (uint32_t x = x0; x < x1; x++)
+          {
+            lo = std::min(lo, row[x]);
+            hi = std::max(hi, row[x]);
+          }
+        }
+        leaves.bounds[ny * leaves.nodesX + nx] = { lo, hi };
+      }
+    }
+
+    // the parents of the changed nodes, up to the root, merge their children's bounds
+    for (size_t level = 1; level < levels_.size(); level++)
+    {
+      const Level& children = levels_[level - 1];
+      Level& parents = levels_[level];
+      nx0 /= 2;
+      ny0 /= 2;
+      nx1 = std::min(nx1 / 2, parents.nodesX - 1);
+      ny1 = std::min(ny1 / 2, parents.nodesY - 1);
+
+      for (uint32_t ny = ny0; ny <= ny1; ny++)
+      {
+        for (uint32_t nx = nx0; nx <= nx1; nx++)
+        {
+          NodeBounds bounds = children.bounds[2 * ny * children.nodesX + 2 * nx];
+          for (uint32_t cy = 2 * ny; cy < std::min(2 * ny + 2, children.nodesY); cy++)
+          {
+            for (uint32_t cx = 2 * nx; cx < std::min(2 * nx + 2, children.nodesX); cx++)
+            {
+              const NodeBounds& child = children.bounds[cy * children.nodesX + cx];
+              bounds.minHeight = std::min(bounds.minHeight, child.minHeight);
+              bounds.maxHeight = std::max(bounds.maxHeight, child.maxHeight);
+            }
+          }
+          parents.bounds[ny * parents.nodesX + nx] = bounds;
+        }
+      }
+    }
+  }
+
+  void TerrainQuadtree::Select(const Frustum& frustum, const glm::vec3& viewPos, TerrainSelection& selection) const
+  {
+    selection.Clear();
+    const uint32_t root = NumLevels() - 1;
+    SelectNode(root, 0, 0, frustum, { viewPos.x, viewPos.z }, ViewHeight(viewPos), selection);
+  }
+
+  float TerrainQuadtree::ViewHeight(const glm::vec3& viewPos) const
+  {
+    const NodeBounds& root = levels_.back().bounds.front();
+    return std::max({ viewPos.y - root.maxHeight, 0.0f, root.minHeight - viewPos.y });
+  }
+
+  bool TerrainQuadtree::SelectNode(uint32_t level, uint32_t x, uint32_t y, const Frustum& frustum, const glm::vec2& viewPos, float viewHeight,
+    TerrainSelection& selection) const
+  {
+    glm::vec3 lo;
+    glm::vec3 hi;
+    NodeBox(level, x, y, lo, hi);
+    if (!frustum.Intersects(lo, hi))
+    {
+      selection.culled++;
+      return true;
+    }
+    if (!InRange(viewPos, viewHeight, LodRange(level), lo, hi))
+    {
+      return false;
+    }
+
+    const uint32_t nodeSize = patchSize_ << level;
+    if (level == 0 || !InRange(viewPos, viewHeight, LodRange(level - 1), lo, hi))
+    {
+      selection.nodes.push_back({ .origin = { x * nodeSize, y * nodeSize }, .level = level });
+      return true;
+    }
+
+    // children that are too far for their own level get this node's detail, a quarter of the patch at a time
+    const Level& children = levels_[level - 1];
+    for (uint32_t cy = 2 * y; cy < std::min(2 * y + 2, children.nodesY); cy++)
+    {
+      for (uint32_t cx = 2 * x; cx < std::min(2 * x + 2, children.nodesX); cx++)
+      {
+        if (!SelectNode(level - 1, cx, cy, frustum, viewPos, viewHeight, selection))
+        {
+          selection.quarters.push_back({ .origin = { cx * (nodeSize / 2), cy * (nodeSize / 2) }, .level = level });
+        }
+      }
+    }
+    return true;
+  }
+
+  void TerrainQuadtree::NodeBox(uint32_t level, uint32_t x, uint32_t y, glm::vec3& lo, glm::vec3& hi) const
+  {
+    const uint32_t nodeSize = patchSize_ << level;
+    const uint32_t x0 = x * nodeSize;
+    const uint32_t y0 = y * nodeSize;
+    const uint32_t x1 = std::min(x0 + nodeSize, width_);
+    const uint32_t y1 = std::min(y0 + nodeSize, height_);
+    const NodeBounds& bounds = Bounds(level, x, y);
+    lo = { static_cast<float>(x0) / width_ - 0.5f, bounds.minHeight, static_cast<float>(y0) / height_ - 0.5f };
+    hi = { static_cast<float>(x1) / width_ - 0.5f, bounds.maxHeight, static_cast<float>(y1) / height_ - 0.5f };
+  }
+
+  float TerrainQuadtree::LodRange(uint32_t level) const
+  {
+    // the root is drawn at any distance
+    if (level + 1 >= NumLevels())
+    {
+      return std::numeric_limits<float>::max();
+    }
+    // the widest side of a patch, in model space, so the distance holds on maps that are not square
+    const float patchWidth = static_cast<float>(patchSize_) / static_cast<float>(std::min(width_, height_));
+    return lodDistance_ * patchWidth * static_cast<float>(1u << level);
+  }
+
+  glm::vec2 TerrainQuadtree::MorphRange(uint32_t level) const
+  {
+    const float end = LodRange(level);
+    const float start = level > 0 ? LodRange(level - 1) : 0.0f;
+    return { end - (end - start) * morphRegion, end };
+  }
+}
\ No newline at end of file
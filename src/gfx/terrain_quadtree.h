@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include "frustum.h"
+#include "sim/heightfield.h"
+#include "sim/dirty_tiles.h"
+
+namespace GFX
+{
+  struct NodeBounds
+  {
+    float minHeight{};
+    float maxHeight{};
+  };
+
+  // a node picked for drawing, laid out as the heightmap shader reads it
+  struct TerrainNode
+  {
+    glm::uvec2 origin{};   // texel of the node's corner
+    uint32_t level{};      // the node's quads are 2^level texels wide
+    uint32_t padding{};
+  };
+
+  // the nodes picked for a view
+  struct TerrainSelection
+  {
+    std::vector<TerrainNode> nodes;      // drawn with the whole patch
+    std::vector<TerrainNode> quarters;   // quarters of a node, drawn with a quarter of the patch at the node's level
+    uint32_t culled{};                   // nodes rejected by the frustum
+
+    void Clear()
+    {
+      nodes.clear();
+      quarters.clear();
+      culled = 0;
+    }
+  };
+
+  // CDLOD quadtree over a heightmap. Every node is drawn with the same patch of patchSize^2 quads, or a quarter of it,
+  // so a node at level L covers patchSize * 2^L texels, and the nodes picked for a view get coarser with distance in steps of LodRange.
+  // The height range of every node is kept for culling and updated from the simulation's dirty tiles. Positions are
+  // in the heightmap's model space: x and z span [-0.5, 0.5] and y is the height, which is how the heightmap shader
+  // lays the terrain out.
+  // LOD distances are measured across the map plus a single vertical term, the viewer's height above the terrain's
+  // height range. Neighbouring nodes then differ by at most one level and meet without cracks however steep the
+  // terrain is, as long as the LOD distance stays above minLodDistance
+  class TerrainQuadtree
+  {
+  public:
+    static constexpr uint32_t defaultPatchSize = 64;
+    static constexpr uint32_t maxLevels = 16;
+
+    // fraction of a level's distance range over which its vertices morph into the next level's
+    static constexpr float morphRegion = 0.3f;
+
+    // smallest LOD distance, in patch widths, that keeps a node's diagonal shorter than the gap between the ranges of
+    // two levels, which needs more than 2 * sqrt(2)
+    static constexpr float minLodDistance = 3.0f;
+
+    // patchSize must be even, so quarter patches line up with the next level's quads
+    TerrainQuadtree(uint32_t width, uint32_t height, uint32_t patchSize = defaultPatchSize);
+
+    // recomputes the bounds of the nodes that sample any of the dirty tiles
+    void Update(const Erosion::Heightfield& map, const Erosion::DirtyTiles& dirty);
+
+    // recomputes the bounds of the nodes that sample any texel in rect
+    void Update(const Erosion::Heightfield& map, const Erosion::DirtyRect& rect);
+
+    // picks the nodes to draw for a view from viewPos, leaving out those outside the frustum
+    void Select(const Frustum& frustum, const glm::vec3& viewPos, TerrainSelection& selection) const;
+
+    // the vertical part of LOD distances from viewPos: how far it is above or below the terrain's height range
+    [[nodiscard]] float ViewHeight(const glm::vec3& viewPos) const;
+
+    // distance up to which nodes of a level are drawn, beyond it the next level takes over
+    [[nodiscard]] float LodRange(uint32_t level) const;
+
+    // distances over which a level's vertices morph into the next level's
+    [[nodiscard]] glm::vec2 MorphRange(uint32_t level) const;
+
+    // level 0 nodes are drawn up to distance patch widths from the viewer, and each level twice as far as the last.
+    // Clamped to minLodDistance
+    void SetLodDistance(float distance) { lodDistance_ = std::max(distance, minLodDistance); }
+    [[nodiscard]] float GetLodDistance() const { return lodDistance_; }
+
+    [[nodiscard]] uint32_t Width() const { return width_; }
+    [[nodiscard]] uint32_t Height() const { return height_; }
+    [[nodiscard]] uint32_t PatchSize() const { return patchSize_; }
+    [[nodiscard]] uint32_t NumLevels() const { return static_cast<uint32_t>(levels_.size()); }
+    [[nodiscard]] const NodeBounds& Bounds(uint32_t level, uint32_t x, uint32_t y) const
+    {
+      return levels_[level].bounds[y * levels_[level].nodesX + x];
+    }
+
+  private:
+    struct Level
+    {
+      uint32_t nodesX{};
+      uint32_t nodesY{};
+      std::vector<NodeBounds> bounds;
+    };
+
+    // returns false when the node is beyond its level's range, so its parent's detail is enough there
+    bool SelectNode(uint32_t level, uint32_t x, uint32_t y, const Frustum& frustum, const glm::vec2& viewPos, float viewHeight,
+      TerrainSelection& selection) const;
+    void NodeBox(uint32_t level, uint32_t x, uint32_t y, glm::vec3& lo, glm::vec3& hi) const;
+
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t patchSize_;
+    float lodDistance_ = 4.0f;
+    std::vector<Level> levels_;
+  };
+}
\ No newline at end of file
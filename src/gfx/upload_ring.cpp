@@ -0,0 +1,119 @@
+#include "upload_ring.h"
+
+#include <algorithm>
+#include <cassert>
+#include <format>
+#include <stdexcept>
+
+#include <glad/gl.h>
+
+namespace GFX
+{
+  UploadRing::UploadRing(size_t frameBytes, uint32_t frames)
+    : frames_(frames), fences_(frames)
+  {
+    if (frames == 0)
+    {
+      throw std::runtime_error("an upload ring needs at least one frame");
+    }
+    Create(std::max<size_t>(frameBytes, 1));
+  }
+
+  UploadRing::~UploadRing()
+  {
+    Destroy();
+  }
+
+  void UploadRing::BeginFrame(size_t bytes)
+  {
+    current_ = (current_ + 1) % frames_;
+    used_ = 0;
+    open_ = true;
+
+    if (bytes > frameBytes_)
+    {
+      // every region is in use by some frame, so all of them have to be done before the buffer goes
+      const size_t grown = std::max(bytes, 2 * frameBytes_);
+      Destroy();
+      Create(grown);
+      return;
+    }
+
+    // the region was last written frames_ frames ago, so the GPU is normally done reading it
+    if (GLsync& fence = fences_[current_])
+    {
+      if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+      {
+        stalls_++;
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+      }
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+
+  UploadAllocation UploadRing::Allocate(size_t bytes, size_t alignment)
+  {
+    assert(open_);
+    const size_t begin = (used_ + alignment - 1) / alignment * alignment;
+    if (!Fits(bytes, alignment))
+    {
+      throw std::runtime_error(std::format("upload ring frame of {} bytes cannot fit {} more", frameBytes_, bytes));
+    }
+    used_ = begin + bytes;
+
+    const size_t offset = current_ * frameBytes_ + begin;
+    return { mapped_ + offset, offset };
+  }
+
+  bool UploadRing::Fits(size_t bytes, size_t alignment) const
+  {
+    const size_t begin = (used_ + alignment - 1) / alignment * alignment;
+    return begin + bytes <= frameBytes_;
+  }
+
+  void UploadRing::EndFrame()
+  {
+    if (!open_)
+    {
+      return;
+    }
+    assert(fences_[current_] == nullptr);
+    fences_[current_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    open_ = false;
+  }
+
+  void UploadRing::Create(size_t frameBytes)
+  {
+    // offsets are aligned within a region, so regions start on the strictest alignment a binding can need
+    GLint alignment = 256;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    const size_t regionAlignment = std::max<size_t>(alignment, 256);
+    frameBytes_ = (frameBytes + regionAlignment - 1) / regionAlignment * regionAlignment;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &buffer_);
+    glNamedBufferStorage(buffer_, frameBytes_ * frames_, nullptr, flags);
+    mapped_ = static_cast<std::byte*>(glMapNamedBufferRange(buffer_, 0, frameBytes_ * frames_, flags));
+  }
+
+  void UploadRing::Destroy()
+  {
+    for (GLsync& fence : fences_)
+    {
+      if (fence)
+      {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+        glDeleteSync(fence);
+        fence = nullptr;
+      }
+    }
+    if (buffer_)
+    {
+      glUnmapNamedBuffer(buffer_);
+      glDeleteBuffers(1, &buffer_);
+      buffer_ = 0;
+      mapped_ = nullptr;
+    }
+  }
+}
\ No newline at end of file
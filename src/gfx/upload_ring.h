@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "macros.h"
+
+struct __GLsync;
+
+namespace GFX
+{
+  // space reserved in the current frame's region, mapped at data and found at offset in the ring's buffer
+  struct UploadAllocation
+  {
+    std::byte* data{};
+    size_t offset{};
+  };
+
+  // one persistently mapped buffer split into a region per frame in flight. The CPU writes the current frame's
+  // region while the GPU reads the others, and a fence on each region keeps the CPU from overwriting data that is
+  // still being read. The mapping is coherent, so written data needs no flush before it is drawn with
+  class UploadRing
+  {
+  public:
+    static constexpr uint32_t defaultFrames = 3;
+
+    explicit UploadRing(size_t frameBytes, uint32_t frames = defaultFrames);
+    ~UploadRing();
+
+    NOCOPY_NOMOVE(UploadRing)
+
+    // makes the next region current, waiting for the GPU to finish with it if it has to. If the region is smaller
+    // than bytes, the ring is reallocated bigger once the GPU is done with all of it
+    void BeginFrame(size_t bytes);
+
+    // reserves bytes in the current region, starting on a multiple of alignment. BeginFrame must have asked for
+    // enough room, including the alignment padding
+    UploadAllocation Allocate(size_t bytes, size_t alignment);
+
+    // whether Allocate(bytes, alignment) would fit in what is left of the current region
+    [[nodiscard]] bool Fits(size_t bytes, size_t alignment) const;
+
+    // fences the current region, after the last command that reads it. Does nothing if no frame was begun
+    void EndFrame();
+
+    [[nodiscard]] uint32_t Buffer() const { return buffer_; }
+    [[nodiscard]] size_t FrameBytes() const { return frameBytes_; }
+
+    // times BeginFrame waited for the GPU since the ring was created
+    [[nodiscard]] uint64_t Stalls() const { return stalls_; }
+
+  private:
+    void Create(size_t frameBytes);
+    void Destroy();
+
+    uint32_t frames_;
+    size_t frameBytes_{};
+    uint32_t buffer_{};
+    std::byte* mapped_{};
+    std::vector<__GLsync*> fences_;
+
+    uint32_t current_{ UINT32_MAX };
+    size_t used_{};
+    bool open_{};
+    uint64_t stalls_{};
+  };
+}
\ No newline at end of file
@@ -20,6 +20,8 @@
 #include "gfx/renderer.h"
 #include "gfx/mesh.h"
 #include "gfx/camera.h"
+#include "gfx/heightmap_texture.h"
+#include "gfx/terrain_quadtree.h"
 #include "engine.h"
 #include "world.h"
 #include "sim/erosion.h"
@@ -111,8 +113,11 @@ auto main() -> int
 
   //world.MakeBox({ 5, 5, 5 }, { 1, 2, 1 });
 
-  Erosion::Simulation simulation(100, 100);
+  Erosion::Simulation simulation({ .width = 100, .height = 100 });
   simulation.Init(0);
+  GFX::HeightmapTexture heightmapTexture(simulation.GetHeightfield().width, simulation.GetHeightfield().height);
+  GFX::TerrainQuadtree terrainQuadtree(simulation.GetHeightfield().width, simulation.GetHeightfield().height);
+  GFX::TerrainDrawStats terrainStats;
 
   double prevFrame = glfwGetTime();
   while (!glfwWindowShouldClose(window))
@@ -188,6 +193,19 @@ auto main() -> int
           world.mouseSensitivity = sensTemp / 100;
         }
 
+        float lodDistance = terrainQuadtree.GetLodDistance();
+        if (ImGui::SliderFloat("Terrain detail", &lodDistance, GFX::TerrainQuadtree::minLodDistance, 16))
+        {
+          terrainQuadtree.SetLodDistance(lodDistance);
+        }
+
+        static bool occlusionCulling = true;
+        static bool cpuCulling = false;
+        if (ImGui::Checkbox("Occlusion culling", &occlusionCulling) | ImGui::Checkbox("Cull on CPU", &cpuCulling))
+        {
+          renderer.SetCulling(cpuCulling ? GFX::CullBackend::CPU : GFX::CullBackend::GPU, occlusionCulling);
+        }
+
         ImGui::TreePop();
       }
 
@@ -254,16 +272,33 @@ auto main() -> int
       break;
     }
     
+    simulation.Update(dt);
+    simulation.UpdateNormals();
+    heightmapTexture.Update(simulation.GetHeightfield(), simulation.GetNormals(), simulation.GetDirtyTiles());
+    terrainQuadtree.Update(simulation.GetHeightfield(), simulation.GetDirtyTiles());
+    simulation.ClearDirty();
+
+    {
+      const GFX::HeightmapUploadStats& stats = heightmapTexture.Stats();
+      ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_Always);
+      ImGui::Begin("Stats", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoInputs);
+      ImGui::Text("Heightmap upload: %.1f KiB in %u rects, %u stalls", stats.bytes / 1024.0, stats.rects, stats.stalls);
+      ImGui::Text("Terrain: %u nodes (%u culled), %.2f M triangles", terrainStats.nodes, terrainStats.culledNodes, terrainStats.triangles / 1e6);
+      ImGui::End();
+    }
+
     // draw everything
+    world.entityManager.UpdateTransforms();
     auto& objects = world.entityManager.GetObjects();
-    renderer.BeginDraw(objects.size());
-    std::for_each(std::execution::par_unseq, objects.begin(), objects.end(), [&renderer](const auto& obj)
+    renderer.BeginDraw(world.camera, static_cast<uint32_t>(objects.size()));
+    std::for_each(std::execution::par, objects.begin(), objects.end(), [&renderer](const auto& obj)
       {
         renderer.Submit(obj.transform, obj.mesh, obj.renderable);
       });
     renderer.EndDraw(world.camera, dt);
 
-    renderer.DrawHeightmap(world.camera, simulation.GetHeightmap());
+    terrainStats = renderer.DrawHeightmap(world.camera, heightmapTexture.GetHeightmap(), terrainQuadtree);
+    renderer.CaptureDepth(world.camera);
 
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
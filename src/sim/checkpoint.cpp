@@ -0,0 +1,377 @@
+#include "checkpoint.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include "../utility/thread_pool.h"
+
+namespace Erosion
+{
+  namespace
+  {
+    static_assert(std::endian::native == std::endian::little, "checkpoints are stored little-endian");
+
+    constexpr char magic[8] = { 'E', 'R', 'O', 'S', 'C', 'K', 'P', 'T' };
+    constexpr uint32_t version = 1;
+    constexpr uint64_t fieldAlignment = 64;
+
+    // cells per independently coded chunk, so both directions can run in parallel
+    constexpr uint32_t chunkCells = 1 << 18;
+
+    struct FileHeader
+    {
+      char magic[8];
+      uint32_t version;
+      uint32_t numFields;
+      uint32_t width;
+      uint32_t height;
+      uint32_t pitch;
+      uint32_t mode;
+      uint64_t seed;
+      uint64_t iteration;
+    };
+
+    struct FileFieldEntry
+    {
+      uint32_t id;
+      uint32_t encoding;    // a CheckpointCompression
+      uint64_t offset;
+      uint64_t size;
+    };
+
+    // a DELTA_RLE field starts with this, then the stored size of every chunk, then the chunks back to back
+    struct ChunkTableHeader
+    {
+      uint32_t chunkCells;
+      uint32_t numChunks;
+    };
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+      return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void EncodeChunk(const float* cells, size_t count, std::vector<std::byte>& planes, std::vector<std::byte>& out)
+    {
+      // neighboring cells share most of their high bits, so the xor leaves the upper byte planes mostly zero
+      planes.resize(count * 4);
+      uint32_t prev = 0;
+      for (size_t i = 0; i < count; i++)
+      {
+        const uint32_t bits = std::bit_cast<uint32_t>(cells[i]);
+        const uint32_t delta = bits ^ prev;
+        prev = bits;
+        for (size_t p = 0; p < 4; p++)
+        {
+          planes[p * count + i] = static_cast<std::byte>(delta >> (8 * p));
+        }
+      }
+
+      // tokens 0-127 are followed by that many plus one literal bytes, 128-255 stand for 3-130 zero bytes
+      out.clear();
+      const size_t n = planes.size();
+      const auto isZero = [&](size_t i) { return i < n && planes[i] == std::byte{ 0 }; };
+      for (size_t i = 0; i < n;)
+      {
+        size_t zeros = 0;
+        while (zeros < 130 && isZero(i + zeros))
+        {
+          zeros++;
+        }
+        if (zeros >= 3)
+        {
+          out.push_back(static_cast<std::byte>(128 + zeros - 3));
+          i += zeros;
+          continue;
+        }
+
+        size_t end = i;
+        while (end < n && end - i < 128 && !(isZero(end) && isZero(end + 1) && isZero(end + 2)))
+        {
+          end++;
+        }
+        out.push_back(static_cast<std::byte>(end - i - 1));
+        out.insert(out.end(), planes.begin() + static_cast<std::ptrdiff_t>(i), planes.begin() + static_cast<std::ptrdiff_t>(end));
+        i = end;
+      }
+    }
+
+    void DecodeChunk(const std::byte* in, size_t size, float* cells, size_t count, std::vector<std::byte>& planes)
+    {
+      planes.resize(count * 4);
+      size_t o = 0;
+      for (size_t i = 0; i < size;)
+      {
+        const uint32_t token = static_cast<uint32_t>(in[i++]);
+        const size_t run = token < 128 ? token + 1 : token - 128 + 3;
+        if (o + run > planes.size() || (token < 128 && i + run > size))
+        {
+          throw std::runtime_error("corrupt checkpoint chunk");
+        }
+        if (token < 128)
+        {
+          std::memcpy(planes.data() + o, in + i, run);
+          i += run;
+        }
+        else
+        {
+          std::memset(planes.data() + o, 0, run);
+        }
+        o += run;
+      }
+      if (o != planes.size())
+      {
+        throw std::runtime_error("corrupt checkpoint chunk");
+      }
+
+      uint32_t prev = 0;
+      for (size_t i = 0; i < count; i++)
+      {
+        uint32_t delta = 0;
+        for (size_t p = 0; p < 4; p++)
+        {
+          delta |= static_cast<uint32_t>(planes[p * count + i]) << (8 * p);
+        }
+        prev ^= delta;
+        cells[i] = std::bit_cast<float>(prev);
+      }
+    }
+  }
+
+  void WriteCheckpoint(const std::string& path, const CheckpointInfo& info, std::span<const CheckpointField> fields,
+    CheckpointCompression compression, ThreadPool& pool)
+  {
+    struct Encoded
+    {
+      CheckpointCompression encoding = CheckpointCompression::NONE;
+      std::vector<std::vector<std::byte>> chunks;
+      uint64_t size{};
+    };
+
+    const uint64_t cells = static_cast<uint64_t>(info.pitch) * info.height;
+    const uint32_t numChunks = static_cast<uint32_t>((cells + chunkCells - 1) / chunkCells);
+    std::vector<Encoded> encoded(fields.size());
+    for (size_t f = 0; f < fields.size(); f++)
+    {
+      if (fields[f].data->size() != cells)
+      {
+        throw std::runtime_error(std::format("checkpoint field {} has {} cells instead of {}", static_cast<uint32_t>(fields[f].id), fields[f].data->size(), cells));
+      }
+
+      Encoded& e = encoded[f];
+      e.size = cells * sizeof(float);
+      if (compression != CheckpointCompression::DELTA_RLE)
+      {
+        continue;
+      }
+
+      e.chunks.resize(numChunks);
+      pool.ParallelFor(numChunks, [&](uint32_t c)
+        {
+          std::vector<std::byte> planes;
+          const uint64_t begin = static_cast<uint64_t>(c) * chunkCells;
+          EncodeChunk(fields[f].data->data() + begin, std::min<uint64_t>(chunkCells, cells - begin), planes, e.chunks[c]);
+        });
+
+      uint64_t size = sizeof(ChunkTableHeader) + numChunks * sizeof(uint64_t);
+      for (const auto& chunk : e.chunks)
+      {
+        size += chunk.size();
+      }
+
+      // noise does not compress, keep such fields raw so loading them is a plain copy
+      if (size < e.size)
+      {
+        e.encoding = CheckpointCompression::DELTA_RLE;
+        e.size = size;
+      }
+      else
+      {
+        e.chunks.clear();
+      }
+    }
+
+    std::vector<FileFieldEntry> entries(fields.size());
+    uint64_t total = sizeof(FileHeader) + entries.size() * sizeof(FileFieldEntry);
+    for (size_t f = 0; f < fields.size(); f++)
+    {
+      total = AlignUp(total, fieldAlignment);
+      entries[f] = { static_cast<uint32_t>(fields[f].id), static_cast<uint32_t>(encoded[f].encoding), total, encoded[f].size };
+      total += encoded[f].size;
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.numFields = static_cast<uint32_t>(fields.size());
+    header.width = info.width;
+    header.height = info.height;
+    header.pitch = info.pitch;
+    header.mode = info.mode;
+    header.seed = info.seed;
+    header.iteration = info.iteration;
+
+    // the file goes out front to back straight from the field buffers, without staging a copy of the whole thing.
+    // The gaps between fields are zeroed so the output is deterministic
+    std::vector<std::span<const std::byte>> pieces;
+    const auto add = [&](const void* data, uint64_t size) { pieces.push_back({ static_cast<const std::byte*>(data), size }); };
+    static constexpr std::byte padding[fieldAlignment]{};
+    add(&header, sizeof(header));
+    add(entries.data(), entries.size() * sizeof(FileFieldEntry));
+
+    std::vector<ChunkTableHeader> tables(fields.size(), { chunkCells, numChunks });
+    std::vector<std::vector<uint64_t>> chunkSizes(fields.size());
+    uint64_t cursor = sizeof(header) + entries.size() * sizeof(FileFieldEntry);
+    for (size_t f = 0; f < fields.size(); f++)
+    {
+      add(padding, entries[f].offset - cursor);
+      if (encoded[f].encoding == CheckpointCompression::NONE)
+      {
+        add(fields[f].data->data(), encoded[f].size);
+      }
+      else
+      {
+        for (const auto& chunk : encoded[f].chunks)
+        {
+          chunkSizes[f].push_back(chunk.size());
+        }
+        add(&tables[f], sizeof(ChunkTableHeader));
+        add(chunkSizes[f].data(), chunkSizes[f].size() * sizeof(uint64_t));
+        for (const auto& chunk : encoded[f].chunks)
+        {
+          add(chunk.data(), chunk.size());
+        }
+      }
+      cursor = entries[f].offset + entries[f].size;
+    }
+
+    // a preempted write leaves the previous checkpoint intact
+    const std::string tempPath = path + ".tmp";
+    {
+      std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+      for (const auto& piece : pieces)
+      {
+        file.write(reinterpret_cast<const char*>(piece.data()), static_cast<std::streamsize>(piece.size()));
+      }
+      if (!file)
+      {
+        throw std::runtime_error(std::format("failed to write '{}'", tempPath));
+      }
+    }
+    // otherwise a crash soon after the rename can leave the new name pointing at data that never reached the disk
+    MappedFile(tempPath, MappedFile::Mode::READ_WRITE).Sync();
+    std::filesystem::rename(tempPath, path);
+  }
+
+  CheckpointReader::CheckpointReader(const std::string& path)
+    : file_(path, MappedFile::Mode::READ)
+  {
+    if (file_.Size() < sizeof(FileHeader))
+    {
+      throw std::runtime_error(std::format("'{}' is too small to be a checkpoint", path));
+    }
+    view_ = file_.Map(0, file_.Size());
+
+    FileHeader header{};
+    std::memcpy(&header, view_.Data(), sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0)
+    {
+      throw std::runtime_error(std::format("'{}' is not a checkpoint", path));
+    }
+    if (header.version != version)
+    {
+      throw std::runtime_error(std::format("'{}' is a version {} checkpoint, only version {} is supported", path, header.version, version));
+    }
+
+    info_ = { header.width, header.height, header.pitch, header.mode, header.seed, header.iteration };
+    const uint64_t cells = static_cast<uint64_t>(info_.pitch) * info_.height;
+    if (sizeof(FileHeader) + static_cast<uint64_t>(header.numFields) * sizeof(FileFieldEntry) > file_.Size())
+    {
+      throw std::runtime_error(std::format("'{}' is truncated", path));
+    }
+
+    std::vector<FileFieldEntry> entries(header.numFields);
+    std::memcpy(entries.data(), view_.Data() + sizeof(FileHeader), entries.size() * sizeof(FileFieldEntry));
+    for (const FileFieldEntry& entry : entries)
+    {
+      if (entry.encoding != static_cast<uint32_t>(CheckpointCompression::NONE) && entry.encoding != static_cast<uint32_t>(CheckpointCompression::DELTA_RLE))
+      {
+        throw std::runtime_error(std::format("'{}' has field {} in unknown encoding {}", path, entry.id, entry.encoding));
+      }
+      const bool raw = entry.encoding == static_cast<uint32_t>(CheckpointCompression::NONE);
+      // written so that a huge offset or size cannot wrap around and pass
+      if (entry.offset > file_.Size() || entry.size > file_.Size() - entry.offset || (raw && entry.size != cells * sizeof(float)))
+      {
+        throw std::runtime_error(std::format("'{}' is truncated or corrupt", path));
+      }
+      fields_.push_back({ entry.id, entry.encoding, entry.offset, entry.size });
+    }
+  }
+
+  bool CheckpointReader::HasField(CheckpointFieldId id) const
+  {
+    return std::any_of(fields_.begin(), fields_.end(), [&](const FieldEntry& field) { return field.id == static_cast<uint32_t>(id); });
+  }
+
+  void CheckpointReader::ReadField(CheckpointFieldId id, FieldBuffer& out, ThreadPool& pool) const
+  {
+    const auto field = std::find_if(fields_.begin(), fields_.end(), [&](const FieldEntry& f) { return f.id == static_cast<uint32_t>(id); });
+    if (field == fields_.end())
+    {
+      throw std::runtime_error(std::format("checkpoint has no field {}", static_cast<uint32_t>(id)));
+    }
+
+    const uint64_t cells = static_cast<uint64_t>(info_.pitch) * info_.height;
+    if (out.size() != cells)
+    {
+      throw std::runtime_error(std::format("checkpoint field has {} cells, the destination {}", cells, out.size()));
+    }
+
+    const std::byte* data = view_.Data() + field->offset;
+    if (field->encoding == static_cast<uint32_t>(CheckpointCompression::NONE))
+    {
+      std::memcpy(out.data(), data, field->size);
+      return;
+    }
+
+    ChunkTableHeader table{};
+    if (field->size < sizeof(table))
+    {
+      throw std::runtime_error("corrupt checkpoint chunk table");
+    }
+    std::memcpy(&table, data, sizeof(table));
+    const uint64_t tableBytes = sizeof(table) + static_cast<uint64_t>(table.numChunks) * sizeof(uint64_t);
+    if (table.chunkCells == 0 || (cells + table.chunkCells - 1) / table.chunkCells != table.numChunks || tableBytes > field->size)
+    {
+      throw std::runtime_error("corrupt checkpoint chunk table");
+    }
+
+    std::vector<uint64_t> starts(table.numChunks + 1, tableBytes);
+    for (uint32_t c = 0; c < table.numChunks; c++)
+    {
+      uint64_t size{};
+      std::memcpy(&size, data + sizeof(table) + c * sizeof(uint64_t), sizeof(size));
+      // every start stays within the field, so the running sum cannot overflow
+      if (size > field->size - starts[c])
+      {
+        throw std::runtime_error("corrupt checkpoint chunk table");
+      }
+      starts[c + 1] = starts[c] + size;
+    }
+    if (starts.back() != field->size)
+    {
+      throw std::runtime_error("corrupt checkpoint chunk table");
+    }
+
+    pool.ParallelFor(table.numChunks, [&](uint32_t c)
+      {
+        std::vector<std::byte> planes;
+        const uint64_t begin = static_cast<uint64_t>(c) * table.chunkCells;
+        DecodeChunk(data + starts[c], starts[c + 1] - starts[c], out.data() + begin, std::min<uint64_t>(table.chunkCells, cells - begin), planes);
+      });
+  }
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+#include "heightfield.h"
+#include "../utility/mapped_file.h"
+#include "../macros.h"
+
+class ThreadPool;
+
+namespace Erosion
+{
+  enum class CheckpointCompression
+  {
+    NONE,
+    DELTA_RLE,   // xor with the previous cell, split into byte planes, then zero bytes run-length coded
+  };
+
+  enum class CheckpointFieldId : uint32_t
+  {
+    TERRAIN,
+    WATER,
+    SEDIMENT,
+    FLUX_L,
+    FLUX_R,
+    FLUX_T,
+    FLUX_B,
+  };
+
+  // everything about a simulation that is not a per-cell field
+  struct CheckpointInfo
+  {
+    uint32_t width{};
+    uint32_t height{};
+    uint32_t pitch{};
+    uint32_t mode{};
+    uint64_t seed{};
+    uint64_t iteration{};
+  };
+
+  struct CheckpointField
+  {
+    CheckpointFieldId id{};
+    const FieldBuffer* data{};   // pitch * height floats
+  };
+
+  // writes the file front to back in one sequential pass, uncompressed fields straight from their buffers.
+  // Compression runs in chunks on the pool. The file is written under a temporary name and renamed over path when complete
+  void WriteCheckpoint(const std::string& path, const CheckpointInfo& info, std::span<const CheckpointField> fields,
+    CheckpointCompression compression, ThreadPool& pool);
+
+  // maps a checkpoint file and decodes fields straight out of the mapping
+  class CheckpointReader
+  {
+  public:
+    // throws std::runtime_error if the file is not a checkpoint of a supported version
+    explicit CheckpointReader(const std::string& path);
+
+    NOCOPY_NOMOVE(CheckpointReader)
+
+    [[nodiscard]] const CheckpointInfo& Info() const { return info_; }
+    [[nodiscard]] bool HasField(CheckpointFieldId id) const;
+
+    // out must hold Info().pitch * Info().height floats. Throws if the field is missing or corrupt
+    void ReadField(CheckpointFieldId id, FieldBuffer& out, ThreadPool& pool) const;
+
+  private:
+    struct FieldEntry
+    {
+      uint32_t id;
+      uint32_t encoding;
+      uint64_t offset;
+      uint64_t size;
+    };
+
+    MappedFile file_;
+    MappedFile::View view_;
+    CheckpointInfo info_;
+    std::vector<FieldEntry> fields_;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "dirty_tiles.h"
+#include <algorithm>
+
+namespace Erosion
+{
+  DirtyTiles::DirtyTiles(uint32_t width, uint32_t height, uint32_t tileSize)
+    : width_(width),
+      height_(height),
+      tileSize_(tileSize),
+      tilesX_((width + tileSize - 1) / tileSize),
+      tilesY_((height + tileSize - 1) / tileSize),
+      dirty_(static_cast<size_t>(tilesX_) * tilesY_, 0)
+  {
+  }
+
+  void DirtyTiles::Mark(const DirtyRect& rect)
+  {
+    if (rect.Empty())
+    {
+      return;
+    }
+
+    const uint32_t tx0 = rect.x0 / tileSize_;
+    const uint32_t ty0 = rect.y0 / tileSize_;
+    const uint32_t tx1 = std::min((rect.x1 + tileSize_ - 1) / tileSize_, tilesX_);
+    const uint32_t ty1 = std::min((rect.y1 + tileSize_ - 1) / tileSize_, tilesY_);
+    for (uint32_t ty = ty0; ty < ty1; ty++)
+    {
+      for (uint32_t tx = tx0; tx < tx1; tx++)
+      {
+        uint8_t& tile = dirty_[tx + static_cast<size_t>(ty) * tilesX_];
+        numDirty_ += tile ^ 1;
+        tile = 1;
+      }
+    }
+  }
+
+  void DirtyTiles::MarkAll()
+  {
+    std::fill(dirty_.begin(), dirty_.end(), uint8_t(1));
+    numDirty_ = static_cast<uint32_t>(dirty_.size());
+  }
+
+  void DirtyTiles::Clear()
+  {
+    std::fill(dirty_.begin(), dirty_.end(), uint8_t(0));
+    numDirty_ = 0;
+  }
+
+  void DirtyTiles::BuildRects() const
+  {
+    rects_.clear();
+    if (numDirty_ == 0)
+    {
+      return;
+    }
+
+    // runs of dirty tiles within a row become rects, which grow downwards while the next row has the same run
+    std::vector<size_t> open;
+    std::vector<size_t> next;
+    for (uint32_t ty = 0; ty < tilesY_; ty++)
+    {
+      const uint32_t y0 = ty * tileSize_;
+      const uint32_t y1 = std::min(y0 + tileSize_, height_);
+      const uint8_t* row = dirty_.data() + static_cast<size_t>(ty) * tilesX_;
+
+      next.clear();
+      size_t o = 0;
+      for (uint32_t tx = 0; tx < tilesX_;)
+      {
+        if (!row[tx])
+        {
+          tx++;
+          continue;
+        }
+
+        const uint32_t runStart = tx;
+        while (tx < tilesX_ && row[tx])
+        {
+          tx++;
+        }
+
+        const uint32_t x0 = runStart * tileSize_;
+        const uint32_t x1 = std::min(tx * tileSize_, width_);
+
+        // open rects are sorted by x, so the one matching this run can only be ahead of the cursor
+        while (o < open.size() && rects_[open[o]].x1 <= x0)
+        {
+          o++;
+        }
+        if (o < open.size() && rects_[open[o]].x0 == x0 && rects_[open[o]].x1 == x1)
+        {
+          rects_[open[o]].y1 = y1;
+          next.push_back(open[o]);
+        }
+        else
+        {
+          rects_.push_back({ x0, y0, x1, y1 });
+          next.push_back(rects_.size() - 1);
+        }
+      }
+      std::swap(open, next);
+    }
+  }
+}
\ No newline at end of file
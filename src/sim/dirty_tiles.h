@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "heightfield.h"
+
+namespace Erosion
+{
+  // coarse record of which parts of a heightfield changed, in tileSize^2 blocks
+  class DirtyTiles
+  {
+  public:
+    static constexpr uint32_t defaultTileSize = 64;
+
+    DirtyTiles() = default;
+    DirtyTiles(uint32_t width, uint32_t height, uint32_t tileSize = defaultTileSize);
+
+    void Mark(const DirtyRect& rect);
+    void MarkAll();
+    void Clear();
+
+    [[nodiscard]] bool Any() const { return numDirty_ > 0; }
+    [[nodiscard]] uint32_t NumDirty() const { return numDirty_; }
+    [[nodiscard]] uint32_t TileSize() const { return tileSize_; }
+
+    // calls fn(const DirtyRect&) for a set of disjoint rects covering the dirty tiles, clipped to the map.
+    // Adjacent dirty tiles are merged so that a fully dirty map is a single rect
+    template<typename Fn>
+    void ForEachRect(Fn&& fn) const
+    {
+      BuildRects();
+      for (const DirtyRect& rect : rects_)
+      {
+        fn(rect);
+      }
+    }
+
+  private:
+    void BuildRects() const;
+
+    uint32_t width_{};
+    uint32_t height_{};
+    uint32_t tileSize_{ defaultTileSize };
+    uint32_t tilesX_{};
+    uint32_t tilesY_{};
+    uint32_t numDirty_{};
+    std::vector<uint8_t> dirty_;
+
+    // scratch for ForEachRect
+    mutable std::vector<DirtyRect> rects_;
+  };
+}
\ No newline at end of file
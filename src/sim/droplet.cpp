@@ -0,0 +1,363 @@
+#include "droplet.h"
+#include "droplet_kernel.h"
+#include <cmath>
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <stdexcept>
+#include <glm/glm.hpp>
+#include "../utility/thread_pool.h"
+#include "../utility/cpu_features.h"
+
+namespace Erosion
+{
+  namespace detail
+  {
+    uint32_t StepBatchScalar(const DropletKernelArgs& args, ParticleBatch& b, uint32_t alive)
+    {
+      constexpr uint32_t lanes = ParticleBatch::lanes;
+      const DropletParams& params = *args.params;
+
+      // per-lane results of the read phase
+      uint32_t node[lanes]{};
+      float u[lanes]{};
+      float v[lanes]{};
+      float amount[lanes]{};
+      bool deposit[lanes]{};
+      uint32_t write = 0;
+      uint32_t moved = 0;
+
+      for (uint32_t i = 0; i < lanes; i++)
+      {
+        if ((alive & (1u << i)) == 0)
+        {
+          continue;
+        }
+
+        // bilinear height and gradient of the cell containing the droplet
+        const uint32_t nodeX = static_cast<uint32_t>(b.posX[i]);
+        const uint32_t nodeY = static_cast<uint32_t>(b.posY[i]);
+        node[i] = nodeX + nodeY * args.pitch;
+        u[i] = b.posX[i] - static_cast<float>(nodeX);
+        v[i] = b.posY[i] - static_cast<float>(nodeY);
+
+        const float* h = args.map + node[i];
+        const float h00 = h[0];
+        const float h10 = h[1];
+        const float h01 = h[args.pitch];
+        const float h11 = h[args.pitch + 1];
+        const float gradX = (h10 - h00) * (1 - v[i]) + (h11 - h01) * v[i];
+        const float gradY = (h01 - h00) * (1 - u[i]) + (h11 - h10) * u[i];
+        const float height = h00 * (1 - u[i]) * (1 - v[i]) + h10 * u[i] * (1 - v[i]) + h01 * (1 - u[i]) * v[i] + h11 * u[i] * v[i];
+
+        float dirX = b.dirX[i] * params.inertia - gradX * (1 - params.inertia);
+        float dirY = b.dirY[i] * params.inertia - gradY * (1 - params.inertia);
+        const float len = std::sqrt(dirX * dirX + dirY * dirY);
+        if (len == 0)
+        {
+          continue;
+        }
+        dirX /= len;
+        dirY /= len;
+        b.dirX[i] = dirX;
+        b.dirY[i] = dirY;
+        b.posX[i] += dirX;
+        b.posY[i] += dirY;
+
+        if (!(b.posX[i] >= args.bounds.lo.x && b.posY[i] >= args.bounds.lo.y && b.posX[i] < args.bounds.hi.x && b.posY[i] < args.bounds.hi.y))
+        {
+          continue;
+        }
+
+        const uint32_t newX = static_cast<uint32_t>(b.posX[i]);
+        const uint32_t newY = static_cast<uint32_t>(b.posY[i]);
+        const float nu = b.posX[i] - static_cast<float>(newX);
+        const float nv = b.posY[i] - static_cast<float>(newY);
+        const float* n = args.map + newX + newY * args.pitch;
+        const float newHeight = n[0] * (1 - nu) * (1 - nv) + n[1] * nu * (1 - nv) + n[args.pitch] * (1 - nu) * nv + n[args.pitch + 1] * nu * nv;
+
+        const float deltaHeight = newHeight - height;
+        const float capacity = std::max(-deltaHeight * b.speed[i] * b.water[i] * params.sedimentCapacityFactor, params.minSedimentCapacity);
+
+        deposit[i] = b.sediment[i] > capacity || deltaHeight > 0;
+        if (deposit[i])
+        {
+          // fill the pit we just left when going uphill, otherwise drop the excess sediment
+          amount[i] = deltaHeight > 0 ? std::min(deltaHeight, b.sediment[i]) : (b.sediment[i] - capacity) * params.depositSpeed;
+          b.sediment[i] -= amount[i];
+        }
+        else
+        {
+          // never erode more than the height difference, or a pit would be dug behind the droplet
+          amount[i] = std::min((capacity - b.sediment[i]) * params.erodeSpeed, -deltaHeight);
+          b.sediment[i] += amount[i];
+        }
+
+        b.speed[i] = std::sqrt(std::max(b.speed[i] * b.speed[i] - deltaHeight * params.gravity, 0.0f));
+        b.water[i] *= 1 - params.evaporateSpeed;
+        write |= 1u << i;
+        if (++b.age[i] < params.maxLifetime)
+        {
+          moved |= 1u << i;
+        }
+      }
+
+      for (uint32_t i = 0; i < lanes; i++)
+      {
+        if ((write & (1u << i)) == 0)
+        {
+          continue;
+        }
+
+        float* h = args.map + node[i];
+        if (deposit[i])
+        {
+          h[0] += amount[i] * (1 - u[i]) * (1 - v[i]);
+          h[1] += amount[i] * u[i] * (1 - v[i]);
+          h[args.pitch] += amount[i] * (1 - u[i]) * v[i];
+          h[args.pitch + 1] += amount[i] * u[i] * v[i];
+        }
+        else
+        {
+          for (const BrushSpan& span : args.brush)
+          {
+            float* row = h + span.dx + span.dy * static_cast<int64_t>(args.pitch);
+            for (uint32_t j = 0; j < span.count; j++)
+            {
+              row[j] -= amount[i] * span.weights[j];
+            }
+          }
+        }
+      }
+
+      return moved;
+    }
+  }
+
+  const char* ToString(DropletBackend backend)
+  {
+    switch (backend)
+    {
+    case DropletBackend::AUTO: return "auto";
+    case DropletBackend::SCALAR: return "scalar";
+    case DropletBackend::AVX2: return "avx2";
+    default: return "unknown";
+    }
+  }
+
+  DropletEroder::DropletEroder(const DropletParams& params, DropletBackend backend)
+    : params_(params)
+  {
+#ifdef EROSION_AVX2
+    const bool avx2 = HasAVX2();
+#else
+    const bool avx2 = false;
+#endif
+    backend_ = (backend == DropletBackend::AUTO || backend == DropletBackend::AVX2) && avx2 ? DropletBackend::AVX2 : DropletBackend::SCALAR;
+    stepBatch_ = detail::StepBatchScalar;
+#ifdef EROSION_AVX2
+    if (backend_ == DropletBackend::AVX2)
+    {
+      stepBatch_ = detail::StepBatchAVX2;
+    }
+#endif
+
+    // each row of the disc is contiguous, so it is split into spans of up to eight taps
+    const int32_t r = params_.brushRadius;
+    float weightSum = 0;
+    for (int32_t dy = -r; dy <= r; dy++)
+    {
+      for (int32_t dx = -r; dx <= r; dx++)
+      {
+        const float dist = std::sqrt(static_cast<float>(dx * dx + dy * dy));
+        if (dist > static_cast<float>(r))
+        {
+          continue;
+        }
+
+        if (brush_.empty() || brush_.back().dy != dy || brush_.back().count == ParticleBatch::lanes)
+        {
+          brush_.push_back({ .dx = dx, .dy = dy });
+        }
+
+        const float weight = 1 - dist / static_cast<float>(r + 1);
+        brush_.back().weights[brush_.back().count++] = weight;
+        weightSum += weight;
+      }
+    }
+
+    for (auto& span : brush_)
+    {
+      for (uint32_t j = 0; j < span.count; j++)
+      {
+        span.weights[j] /= weightSum;
+      }
+    }
+  }
+
+  DropletEroder::~DropletEroder() = default;
+
+  DropletBounds DropletEroder::MapBounds(const Heightfield& map) const
+  {
+    return
+    {
+      .lo = glm::vec2(static_cast<float>(Margin())),
+      .hi = glm::vec2(static_cast<float>(map.width - Margin() - 1), static_cast<float>(map.height - Margin() - 1)),
+    };
+  }
+
+  DirtyRect DropletEroder::Reach(const Heightfield& map, const DropletBounds& bounds) const
+  {
+    // the brush and the bilinear deposit stay within Margin() of a droplet's cell
+    const float margin = static_cast<float>(Margin());
+    return
+    {
+      .x0 = static_cast<uint32_t>(std::max(std::floor(bounds.lo.x - margin), 0.0f)),
+      .y0 = static_cast<uint32_t>(std::max(std::floor(bounds.lo.y - margin), 0.0f)),
+      .x1 = static_cast<uint32_t>(std::min(std::ceil(bounds.hi.x + margin), static_cast<float>(map.width))),
+      .y1 = static_cast<uint32_t>(std::min(std::ceil(bounds.hi.y + margin), static_cast<float>(map.height))),
+    };
+  }
+
+  uint64_t DropletEroder::Erode(Heightfield& map, std::span<const glm::vec2> spawnPositions) const
+  {
+    return Simulate(map, spawnPositions, MapBounds(map));
+  }
+
+  uint64_t DropletEroder::ErodeTiled(Heightfield& map, std::span<const glm::vec2> spawnPositions, ThreadPool& pool, uint32_t tileSize, DirtyTiles* dirty) const
+  {
+    // a droplet touches cells up to Margin() away from its position. Tiles of the same phase are a whole tile apart,
+    // so each may grow by just under half a tile minus that reach without overlapping its neighbors. Smaller tiles
+    // than this would overlap even without an apron
+    if (tileSize < 2 * (Margin() + 1))
+    {
+      throw std::runtime_error(std::format("tile size {} is below the minimum of {}", tileSize, 2 * (Margin() + 1)));
+    }
+    const float apron = static_cast<float>(std::max(static_cast<int32_t>(tileSize / 2) - static_cast<int32_t>(Margin()) - 1, 0));
+    const DropletBounds mapBounds = MapBounds(map);
+
+    const uint32_t tilesX = (map.width + tileSize - 1) / tileSize;
+    const uint32_t tilesY = (map.height + tileSize - 1) / tileSize;
+
+    // counting sort of droplets into tiles, which keeps the spawn order within each tile
+    std::vector<uint32_t> tileStart(tilesX * tilesY + 1, 0);
+    std::vector<uint32_t> tileOf(spawnPositions.size());
+    for (size_t i = 0; i < spawnPositions.size(); i++)
+    {
+      const uint32_t tx = static_cast<uint32_t>(spawnPositions[i].x) / tileSize;
+      const uint32_t ty = static_cast<uint32_t>(spawnPositions[i].y) / tileSize;
+      tileOf[i] = tx + ty * tilesX;
+      tileStart[tileOf[i] + 1]++;
+    }
+    for (size_t t = 1; t < tileStart.size(); t++)
+    {
+      tileStart[t] += tileStart[t - 1];
+    }
+    std::vector<glm::vec2> binned(spawnPositions.size());
+    {
+      std::vector<uint32_t> cursor(tileStart.begin(), tileStart.end() - 1);
+      for (size_t i = 0; i < spawnPositions.size(); i++)
+      {
+        binned[cursor[tileOf[i]]++] = spawnPositions[i];
+      }
+    }
+
+    auto tileBounds = [&](uint32_t tile)
+    {
+      const glm::vec2 origin = glm::vec2(static_cast<float>(tile % tilesX * tileSize), static_cast<float>(tile / tilesX * tileSize));
+      return DropletBounds
+      {
+        .lo = glm::max(origin - apron, mapBounds.lo),
+        .hi = glm::min(origin + static_cast<float>(tileSize) + apron, mapBounds.hi),
+      };
+    };
+
+    std::vector<uint32_t> phaseTiles;
+    std::vector<uint64_t> tileSteps;
+    uint64_t steps = 0;
+    for (uint32_t phase = 0; phase < 4; phase++)
+    {
+      phaseTiles.clear();
+      for (uint32_t ty = phase / 2; ty < tilesY; ty += 2)
+      {
+        for (uint32_t tx = phase % 2; tx < tilesX; tx += 2)
+        {
+          const uint32_t tile = tx + ty * tilesX;
+          if (tileStart[tile] != tileStart[tile + 1])
+          {
+            phaseTiles.push_back(tile);
+            if (dirty)
+            {
+              dirty->Mark(Reach(map, tileBounds(tile)));
+            }
+          }
+        }
+      }
+
+      tileSteps.assign(phaseTiles.size(), 0);
+      pool.ParallelFor(static_cast<uint32_t>(phaseTiles.size()), [&](uint32_t i)
+        {
+          const uint32_t tile = phaseTiles[i];
+          tileSteps[i] = Simulate(map, std::span(binned).subspan(tileStart[tile], tileStart[tile + 1] - tileStart[tile]), tileBounds(tile));
+        });
+      for (uint64_t tileStep : tileSteps)
+      {
+        steps += tileStep;
+      }
+    }
+
+    return steps;
+  }
+
+  uint64_t DropletEroder::Simulate(Heightfield& map, std::span<const glm::vec2> spawnPositions, const DropletBounds& bounds) const
+  {
+    const detail::DropletKernelArgs args
+    {
+      .map = map.data.data(),
+      .pitch = map.pitch,
+      .bounds = bounds,
+      .params = &params_,
+      .brush = brush_,
+    };
+
+    if (params_.maxLifetime == 0)
+    {
+      return 0;
+    }
+
+    ParticleBatch batch;
+    uint32_t alive = 0;
+    size_t next = 0;
+    uint64_t steps = 0;
+    for (;;)
+    {
+      // lanes whose droplet finished pick up the next one, keeping the batch full until the queue runs dry
+      for (uint32_t i = 0; i < ParticleBatch::lanes && next < spawnPositions.size(); i++)
+      {
+        if ((alive & (1u << i)) == 0)
+        {
+          batch.posX[i] = spawnPositions[next].x;
+          batch.posY[i] = spawnPositions[next].y;
+          batch.dirX[i] = 0;
+          batch.dirY[i] = 0;
+          batch.speed[i] = params_.initialSpeed;
+          batch.water[i] = params_.initialWater;
+          batch.sediment[i] = 0;
+          batch.age[i] = 0;
+          alive |= 1u << i;
+          next++;
+        }
+      }
+
+      if (alive == 0)
+      {
+        break;
+      }
+
+      steps += static_cast<uint64_t>(std::popcount(alive));
+      alive = stepBatch_(args, batch, alive);
+    }
+
+    return steps;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/vec2.hpp>
+#include "heightfield.h"
+#include "dirty_tiles.h"
+#include "../macros.h"
+
+class ThreadPool;
+
+namespace Erosion
+{
+  struct DropletParams
+  {
+    uint32_t dropletsPerUpdate = 4096;
+    uint32_t maxLifetime = 30;
+    int32_t brushRadius = 3;
+    float inertia = 0.05f;              // how much a droplet keeps its direction instead of following the gradient
+    float sedimentCapacityFactor = 4.0f;
+    float minSedimentCapacity = 0.01f;
+    float erodeSpeed = 0.3f;
+    float depositSpeed = 0.3f;
+    float evaporateSpeed = 0.01f;
+    float gravity = 4.0f;
+    float initialWater = 1.0f;
+    float initialSpeed = 1.0f;
+  };
+
+  // structure-of-arrays state of a group of droplets that are stepped together
+  struct ParticleBatch
+  {
+    static constexpr uint32_t lanes = 8;
+
+    alignas(32) float posX[lanes]{};
+    alignas(32) float posY[lanes]{};
+    alignas(32) float dirX[lanes]{};
+    alignas(32) float dirY[lanes]{};
+    alignas(32) float speed[lanes]{};
+    alignas(32) float water[lanes]{};
+    alignas(32) float sediment[lanes]{};
+    alignas(32) uint32_t age[lanes]{};
+  };
+
+  enum class DropletBackend
+  {
+    AUTO,   // AVX2 if the CPU supports it, scalar otherwise
+    SCALAR,
+    AVX2,
+  };
+
+  [[nodiscard]] const char* ToString(DropletBackend backend);
+
+  namespace detail
+  {
+    struct BrushSpan;
+    struct DropletKernelArgs;
+
+    // advances every lane set in alive by one step and returns the lanes that are still alive afterwards.
+    // All lanes read the map before any of them write to it, then the writes are applied in lane order
+    using StepBatchFn = uint32_t(*)(const DropletKernelArgs& args, ParticleBatch& batch, uint32_t alive);
+  }
+
+  // region a droplet may move in, [lo, hi)
+  struct DropletBounds
+  {
+    glm::vec2 lo{};
+    glm::vec2 hi{};
+  };
+
+  // moves droplets downhill over a heightfield, picking up and depositing sediment as they go
+  class DropletEroder
+  {
+  public:
+    // an unavailable backend falls back to scalar
+    explicit DropletEroder(const DropletParams& params, DropletBackend backend = DropletBackend::AUTO);
+    ~DropletEroder();
+
+    NOCOPY_NOMOVE(DropletEroder)
+
+    // droplets are only spawned and simulated inside this margin so the brush never leaves the map
+    [[nodiscard]] uint32_t Margin() const { return static_cast<uint32_t>(params_.brushRadius) + 1; }
+    [[nodiscard]] const DropletParams& Params() const { return params_; }
+    [[nodiscard]] DropletBackend Backend() const { return backend_; }
+
+    [[nodiscard]] DropletBounds MapBounds(const Heightfield& map) const;
+
+    // cells that droplets confined to bounds can modify
+    [[nodiscard]] DirtyRect Reach(const Heightfield& map, const DropletBounds& bounds) const;
+
+    // the eroding functions return the number of droplet steps taken, one per droplet per cell it moved through
+    uint64_t Erode(Heightfield& map, std::span<const glm::vec2> spawnPositions) const;
+
+    // bins droplets into tileSize^2 tiles and runs the tiles in four phases so that no two tiles in the same phase
+    // can touch the same cells. Droplets are confined to their tile plus an apron, so the result does not depend
+    // on the number of threads, but differs slightly from Erode near tile borders. The reach of every tile that ran is marked in dirty.
+    // Throws std::runtime_error if tileSize is below 2 * (Margin() + 1)
+    uint64_t ErodeTiled(Heightfield& map, std::span<const glm::vec2> spawnPositions, ThreadPool& pool, uint32_t tileSize, DirtyTiles* dirty = nullptr) const;
+
+    // runs the droplets to completion, ParticleBatch::lanes at a time
+    uint64_t Simulate(Heightfield& map, std::span<const glm::vec2> spawnPositions, const DropletBounds& bounds) const;
+
+  private:
+    DropletParams params_;
+    DropletBackend backend_;
+    detail::StepBatchFn stepBatch_;
+    std::vector<detail::BrushSpan> brush_;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,180 @@
+// only built with AVX2 code generation enabled, and only called after a runtime check
+#ifdef EROSION_AVX2
+#include "droplet_kernel.h"
+#include <immintrin.h>
+
+namespace Erosion::detail
+{
+  namespace
+  {
+    __m256i LaneMask(uint32_t bits)
+    {
+      const __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+      return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(bits)), laneBits), laneBits);
+    }
+
+    uint32_t MaskBits(__m256 mask)
+    {
+      return static_cast<uint32_t>(_mm256_movemask_ps(mask));
+    }
+
+    // h00 * (1 - u) * (1 - v) + h10 * u * (1 - v) + h01 * (1 - u) * v + h11 * u * v, in the same order as the scalar kernel
+    __m256 Bilinear(__m256 h00, __m256 h10, __m256 h01, __m256 h11, __m256 u, __m256 v)
+    {
+      const __m256 one = _mm256_set1_ps(1.0f);
+      const __m256 iu = _mm256_sub_ps(one, u);
+      const __m256 iv = _mm256_sub_ps(one, v);
+      __m256 h = _mm256_mul_ps(_mm256_mul_ps(h00, iu), iv);
+      h = _mm256_add_ps(h, _mm256_mul_ps(_mm256_mul_ps(h10, u), iv));
+      h = _mm256_add_ps(h, _mm256_mul_ps(_mm256_mul_ps(h01, iu), v));
+      h = _mm256_add_ps(h, _mm256_mul_ps(_mm256_mul_ps(h11, u), v));
+      return h;
+    }
+  }
+
+  uint32_t StepBatchAVX2(const DropletKernelArgs& args, ParticleBatch& b, uint32_t alive)
+  {
+    constexpr uint32_t lanes = ParticleBatch::lanes;
+    const DropletParams& params = *args.params;
+
+    const float* row0 = args.map;
+    const float* row1 = args.map + args.pitch;
+    const __m256i pitch = _mm256_set1_epi32(static_cast<int>(args.pitch));
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    __m256 mask = _mm256_castsi256_ps(LaneMask(alive));
+
+    // sample the cell the droplets are in. Dead lanes are masked out of the gathers since their position may be stale
+    __m256 posX = _mm256_load_ps(b.posX);
+    __m256 posY = _mm256_load_ps(b.posY);
+    const __m256i nodeX = _mm256_cvttps_epi32(posX);
+    const __m256i nodeY = _mm256_cvttps_epi32(posY);
+    const __m256 u = _mm256_sub_ps(posX, _mm256_cvtepi32_ps(nodeX));
+    const __m256 v = _mm256_sub_ps(posY, _mm256_cvtepi32_ps(nodeY));
+    const __m256i node = _mm256_add_epi32(nodeX, _mm256_mullo_epi32(nodeY, pitch));
+
+    const __m256 h00 = _mm256_mask_i32gather_ps(zero, row0, node, mask, 4);
+    const __m256 h10 = _mm256_mask_i32gather_ps(zero, row0 + 1, node, mask, 4);
+    const __m256 h01 = _mm256_mask_i32gather_ps(zero, row1, node, mask, 4);
+    const __m256 h11 = _mm256_mask_i32gather_ps(zero, row1 + 1, node, mask, 4);
+
+    const __m256 iu = _mm256_sub_ps(one, u);
+    const __m256 iv = _mm256_sub_ps(one, v);
+    const __m256 gradX = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(h10, h00), iv), _mm256_mul_ps(_mm256_sub_ps(h11, h01), v));
+    const __m256 gradY = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(h01, h00), iu), _mm256_mul_ps(_mm256_sub_ps(h11, h10), u));
+    const __m256 height = Bilinear(h00, h10, h01, h11, u, v);
+
+    // steer towards the downhill direction
+    const __m256 inertia = _mm256_set1_ps(params.inertia);
+    const __m256 follow = _mm256_set1_ps(1 - params.inertia);
+    __m256 dirX = _mm256_sub_ps(_mm256_mul_ps(_mm256_load_ps(b.dirX), inertia), _mm256_mul_ps(gradX, follow));
+    __m256 dirY = _mm256_sub_ps(_mm256_mul_ps(_mm256_load_ps(b.dirY), inertia), _mm256_mul_ps(gradY, follow));
+    const __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dirX, dirX), _mm256_mul_ps(dirY, dirY)));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(len, zero, _CMP_NEQ_OQ));
+    dirX = _mm256_div_ps(dirX, len);
+    dirY = _mm256_div_ps(dirY, len);
+    posX = _mm256_add_ps(posX, dirX);
+    posY = _mm256_add_ps(posY, dirY);
+
+    _mm256_maskstore_ps(b.dirX, _mm256_castps_si256(mask), dirX);
+    _mm256_maskstore_ps(b.dirY, _mm256_castps_si256(mask), dirY);
+    _mm256_maskstore_ps(b.posX, _mm256_castps_si256(mask), posX);
+    _mm256_maskstore_ps(b.posY, _mm256_castps_si256(mask), posY);
+
+    const __m256 inBounds = _mm256_and_ps(
+      _mm256_and_ps(_mm256_cmp_ps(posX, _mm256_set1_ps(args.bounds.lo.x), _CMP_GE_OQ), _mm256_cmp_ps(posY, _mm256_set1_ps(args.bounds.lo.y), _CMP_GE_OQ)),
+      _mm256_and_ps(_mm256_cmp_ps(posX, _mm256_set1_ps(args.bounds.hi.x), _CMP_LT_OQ), _mm256_cmp_ps(posY, _mm256_set1_ps(args.bounds.hi.y), _CMP_LT_OQ)));
+    mask = _mm256_and_ps(mask, inBounds);
+
+    // height at the new position
+    const __m256i newX = _mm256_cvttps_epi32(posX);
+    const __m256i newY = _mm256_cvttps_epi32(posY);
+    const __m256 nu = _mm256_sub_ps(posX, _mm256_cvtepi32_ps(newX));
+    const __m256 nv = _mm256_sub_ps(posY, _mm256_cvtepi32_ps(newY));
+    const __m256i newNode = _mm256_add_epi32(newX, _mm256_mullo_epi32(newY, pitch));
+    const __m256 newHeight = Bilinear(
+      _mm256_mask_i32gather_ps(zero, row0, newNode, mask, 4),
+      _mm256_mask_i32gather_ps(zero, row0 + 1, newNode, mask, 4),
+      _mm256_mask_i32gather_ps(zero, row1, newNode, mask, 4),
+      _mm256_mask_i32gather_ps(zero, row1 + 1, newNode, mask, 4),
+      nu, nv);
+
+    // sediment transport
+    const __m256 speed = _mm256_load_ps(b.speed);
+    const __m256 water = _mm256_load_ps(b.water);
+    const __m256 sediment = _mm256_load_ps(b.sediment);
+    const __m256 deltaHeight = _mm256_sub_ps(newHeight, height);
+    const __m256 negDeltaHeight = _mm256_xor_ps(deltaHeight, _mm256_set1_ps(-0.0f));
+    const __m256 capacity = _mm256_max_ps(
+      _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(negDeltaHeight, speed), water), _mm256_set1_ps(params.sedimentCapacityFactor)),
+      _mm256_set1_ps(params.minSedimentCapacity));
+
+    const __m256 uphill = _mm256_cmp_ps(deltaHeight, zero, _CMP_GT_OQ);
+    const __m256 deposit = _mm256_or_ps(_mm256_cmp_ps(sediment, capacity, _CMP_GT_OQ), uphill);
+    const __m256 depositAmount = _mm256_blendv_ps(
+      _mm256_mul_ps(_mm256_sub_ps(sediment, capacity), _mm256_set1_ps(params.depositSpeed)),
+      _mm256_min_ps(deltaHeight, sediment),
+      uphill);
+    const __m256 erodeAmount = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(capacity, sediment), _mm256_set1_ps(params.erodeSpeed)), negDeltaHeight);
+    const __m256 amount = _mm256_blendv_ps(erodeAmount, depositAmount, deposit);
+    const __m256 newSediment = _mm256_blendv_ps(_mm256_add_ps(sediment, erodeAmount), _mm256_sub_ps(sediment, depositAmount), deposit);
+
+    const __m256 newSpeed = _mm256_sqrt_ps(_mm256_max_ps(
+      _mm256_sub_ps(_mm256_mul_ps(speed, speed), _mm256_mul_ps(deltaHeight, _mm256_set1_ps(params.gravity))), zero));
+    const __m256 newWater = _mm256_mul_ps(water, _mm256_set1_ps(1 - params.evaporateSpeed));
+
+    _mm256_maskstore_ps(b.sediment, _mm256_castps_si256(mask), newSediment);
+    _mm256_maskstore_ps(b.speed, _mm256_castps_si256(mask), newSpeed);
+    _mm256_maskstore_ps(b.water, _mm256_castps_si256(mask), newWater);
+
+    const __m256i age = _mm256_add_epi32(_mm256_load_si256(reinterpret_cast<const __m256i*>(b.age)), _mm256_set1_epi32(1));
+    _mm256_maskstore_epi32(reinterpret_cast<int*>(b.age), _mm256_castps_si256(mask), age);
+    const __m256i expired = _mm256_cmpeq_epi32(_mm256_max_epu32(age, _mm256_set1_epi32(static_cast<int>(params.maxLifetime))), age);
+
+    const uint32_t write = MaskBits(mask);
+    const uint32_t moved = write & ~MaskBits(_mm256_castsi256_ps(expired));
+
+    // apply the writes in lane order, so overlapping droplets give the same result every run
+    alignas(32) uint32_t nodes[lanes];
+    alignas(32) float us[lanes];
+    alignas(32) float vs[lanes];
+    alignas(32) float amounts[lanes];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(nodes), node);
+    _mm256_store_ps(us, u);
+    _mm256_store_ps(vs, v);
+    _mm256_store_ps(amounts, amount);
+    const uint32_t deposits = MaskBits(deposit);
+
+    for (uint32_t i = 0; i < lanes; i++)
+    {
+      if ((write & (1u << i)) == 0)
+      {
+        continue;
+      }
+
+      float* h = args.map + nodes[i];
+      if (deposits & (1u << i))
+      {
+        h[0] += amounts[i] * (1 - us[i]) * (1 - vs[i]);
+        h[1] += amounts[i] * us[i] * (1 - vs[i]);
+        h[args.pitch] += amounts[i] * (1 - us[i]) * vs[i];
+        h[args.pitch + 1] += amounts[i] * us[i] * vs[i];
+      }
+      else
+      {
+        const __m256 laneAmount = _mm256_set1_ps(amounts[i]);
+        for (const BrushSpan& span : args.brush)
+        {
+          float* row = h + span.dx + span.dy * static_cast<int64_t>(args.pitch);
+          const __m256i spanMask = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(span.count)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+          const __m256 cells = _mm256_maskload_ps(row, spanMask);
+          _mm256_maskstore_ps(row, spanMask, _mm256_sub_ps(cells, _mm256_mul_ps(laneAmount, _mm256_load_ps(span.weights))));
+        }
+      }
+    }
+
+    return moved;
+  }
+}
+#endif
\ No newline at end of file
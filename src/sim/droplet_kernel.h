@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include "droplet.h"
+
+// internal interface between DropletEroder and its per-ISA batch kernels
+namespace Erosion::detail
+{
+  // up to eight horizontally adjacent brush taps, so a vector kernel can update them with one masked load/store
+  struct BrushSpan
+  {
+    int32_t dx{};
+    int32_t dy{};
+    uint32_t count{};
+    alignas(32) float weights[ParticleBatch::lanes]{};
+  };
+
+  struct DropletKernelArgs
+  {
+    float* map{};
+    uint32_t pitch{};   // floats between rows of map
+    DropletBounds bounds{};
+    const DropletParams* params{};
+    std::span<const BrushSpan> brush{};
+  };
+
+  uint32_t StepBatchScalar(const DropletKernelArgs& args, ParticleBatch& batch, uint32_t alive);
+#ifdef EROSION_AVX2
+  uint32_t StepBatchAVX2(const DropletKernelArgs& args, ParticleBatch& batch, uint32_t alive);
+#endif
+}
\ No newline at end of file
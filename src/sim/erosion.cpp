@@ -1,59 +1,261 @@
 #include "erosion.h"
-#include <glad/gl.h>
-#include <memory>
-#include <glm/glm.hpp>
+#include "random.h"
+#include <algorithm>
+#include <format>
+#include <stdexcept>
 
 namespace Erosion
 {
-  Simulation::Simulation(uint32_t w, uint32_t h)
-    : width(w), height(h)
+  Simulation::LevelState::LevelState(const SimulationCreateInfo& createInfo)
+    : map(createInfo.width, createInfo.height),
+      eroder(createInfo.droplet, createInfo.dropletBackend),
+      thermal(createInfo.width, createInfo.height, createInfo.thermal)
   {
-    glCreateTextures(GL_TEXTURE_2D, 1, &textureA);
-    glCreateTextures(GL_TEXTURE_2D, 1, &textureB);
-
-    glTextureStorage2D(textureA, 1, GL_R32F, width, height);
-    glTextureStorage2D(textureB, 1, GL_R32F, width, height);
+    if (createInfo.mode == ErosionMode::GRID)
+    {
+      grid.emplace(createInfo.width, createInfo.height, createInfo.grid, createInfo.gridBackend);
+    }
   }
 
-  Simulation::~Simulation()
+  Simulation::Simulation(const SimulationCreateInfo& createInfo)
+    : width(createInfo.width),
+      height(createInfo.height),
+      mode(createInfo.mode),
+      terrain(createInfo.terrain),
+      fine(createInfo),
+      pool(createInfo.numThreads),
+      tileSize(createInfo.tileSize),
+      dirty(createInfo.width, createInfo.height),
+      normals(createInfo.width, createInfo.height),
+      info(createInfo)
   {
-    glDeleteTextures(1, &textureB);
-    glDeleteTextures(1, &textureA);
+    const uint32_t minTileSize = 2 * (fine.eroder.Margin() + 1);
+    if (tileSize < minTileSize)
+    {
+      throw std::runtime_error(std::format("tile size {} is below the minimum of {} for a brush radius of {}", tileSize, minTileSize, fine.eroder.Params().brushRadius));
+    }
   }
 
+  Simulation::~Simulation() = default;
+
   void Simulation::Init(uint64_t seed)
   {
-    auto map = std::make_unique<float[]>(width * height);
+    this->seed = seed;
+
+    GenerateTerrain(fine.map, terrain, seed, pool);
+
+    if (fine.grid)
+    {
+      fine.grid->Reset();
+    }
+
+    iteration = 0;
+    stats = {};
+    dirty.MarkAll();
+
+    // every level is at least 32 cells across, so the droplets have room to move
+    uint32_t levels = std::max(info.multires.levels, 1u);
+    while (levels > 1 && std::min(width, height) >> (levels - 1) < 32)
+    {
+      levels--;
+    }
+    BeginLevel(info.multires.updatesPerLevel > 0 ? levels - 1 : 0);
+  }
+
+  void Simulation::Update(double dt)
+  {
+    // nothing advances while paused
+    if (dt <= 0)
+    {
+      return;
+    }
+
+    // a coarse level only reaches the map through SyncLevel, which marks all of it
+    LevelState& state = coarse ? *coarse : fine;
+    DirtyTiles* changed = coarse ? nullptr : &dirty;
+
+    UpdateHydraulic(state, changed);
+    iteration++;
+    stats.updates++;
+    UpdateThermal(state, changed);
 
-    for (int y = 0; y < height; y++)
+    if (coarse)
     {
-      for (int x = 0; x < width; x++)
+      AdvanceLevel();
+    }
+  }
+
+  void Simulation::UpdateNormals()
+  {
+    normals.Update(fine.map, dirty, pool);
+  }
+
+  void Simulation::UpdateHydraulic(LevelState& state, DirtyTiles* changed)
+  {
+    switch (mode)
+    {
+    case ErosionMode::DROPLET:
+      UpdateDroplets(state, changed);
+      break;
+    case ErosionMode::GRID:
+      for (uint32_t i = 0; i < state.grid->Params().stepsPerUpdate; i++)
       {
-        //map[x + y * width] = (x ^ y) & (~0u ^ 1) ? 1.0f : 0.0f;
-        map[x + y * width] = glm::distance(glm::vec2(x, y), glm::vec2(height, width) / 2.0f) / 100;
-        //map[x + y * width] = y / 100.0f;
+        state.grid->Step(state.map, pool);
       }
+      stats.gridSteps += state.grid->Params().stepsPerUpdate;
+      if (changed && state.grid->Params().stepsPerUpdate > 0)
+      {
+        changed->MarkAll();
+      }
+      break;
     }
+  }
 
-    glTextureSubImage2D(textureA, 0, 0, 0, width, height, GL_RED, GL_FLOAT, map.get());
-    glTextureSubImage2D(textureB, 0, 0, 0, width, height, GL_RED, GL_FLOAT, map.get());
+  void Simulation::UpdateDroplets(LevelState& state, DirtyTiles* changed)
+  {
+    const uint32_t w = state.map.width;
+    const uint32_t h = state.map.height;
+    const uint32_t margin = state.eroder.Margin();
+    if (w <= 2 * margin + 1 || h <= 2 * margin + 1)
+    {
+      return;
+    }
+
+    const float lo = static_cast<float>(margin);
+    const float hiX = static_cast<float>(w - margin - 1);
+    const float hiY = static_cast<float>(h - margin - 1);
+
+    // every droplet has its own random stream, so the spawns do not depend on how they are split across threads
+    constexpr uint32_t chunkSize = 4096;
+    const uint32_t count = state.eroder.Params().dropletsPerUpdate;
+    spawnPositions.resize(count);
+    pool.ParallelFor((count + chunkSize - 1) / chunkSize, [&](uint32_t chunk)
+      {
+        for (uint32_t i = chunk * chunkSize; i < std::min(chunk * chunkSize + chunkSize, count); i++)
+        {
+          CounterRng rng(seed, iteration, i);
+          spawnPositions[i].x = rng.NextFloat(lo, hiX);
+          spawnPositions[i].y = rng.NextFloat(lo, hiY);
+        }
+      });
 
-    glTextureParameteri(textureA, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTextureParameteri(textureA, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTextureParameteri(textureB, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTextureParameteri(textureB, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTextureParameteri(textureA, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-    glTextureParameteri(textureA, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-    glTextureParameteri(textureB, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-    glTextureParameteri(textureB, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+    stats.dropletSteps += state.eroder.ErodeTiled(state.map, spawnPositions, pool, tileSize, changed);
   }
 
-  void Simulation::Update(double dt)
+  void Simulation::UpdateThermal(LevelState& state, DirtyTiles* changed)
   {
+    const ThermalParams& params = state.thermal.Params();
+    if (params.interval == 0 || params.iterations == 0 || iteration % params.interval != 0)
+    {
+      return;
+    }
+
+    for (uint32_t i = 0; i < params.iterations; i++)
+    {
+      state.thermal.Step(state.map, pool, changed);
+    }
+    stats.thermalSteps += params.iterations;
+  }
+
+  void Simulation::AdvanceLevel()
+  {
+    if (--levelUpdates == 0)
+    {
+      SyncLevel();
+      BeginLevel(level - 1);
+    }
+    else if (info.multires.syncInterval > 0 && levelUpdates % info.multires.syncInterval == 0)
+    {
+      SyncLevel();
+    }
+  }
+
+  void Simulation::BeginLevel(uint32_t newLevel)
+  {
+    level = newLevel;
+    if (level == 0)
+    {
+      coarse.reset();
+      levelBase = {};
+      return;
+    }
+
+    // a coarse cell covers factor^2 cells. Droplets are thinned out so each level erodes about as much per update and
+    // area, and the talus height grows with the cell size so the stable slope stays the same
+    const uint32_t factor = 1u << level;
+    SimulationCreateInfo levelInfo = info;
+    levelInfo.width = (width + factor - 1) / factor;
+    levelInfo.height = (height + factor - 1) / factor;
+    levelInfo.droplet.dropletsPerUpdate = std::max(info.droplet.dropletsPerUpdate / (factor * factor), 1u);
+    levelInfo.thermal.talus *= static_cast<float>(factor);
+
+    // droplet spawns keep being drawn from the same seed and iterations as at full resolution
+    coarse = std::make_unique<LevelState>(levelInfo);
+    Downsample(fine.map, factor, coarse->map, pool);
+    levelBase = coarse->map;
+    levelUpdates = info.multires.updatesPerLevel;
+  }
+
+  void Simulation::SyncLevel()
+  {
+    // levelBase briefly holds the change since the last sync
+    for (size_t i = 0; i < levelBase.data.size(); i++)
+    {
+      levelBase.data[i] = coarse->map.data[i] - levelBase.data[i];
+    }
+    AddUpsampled(levelBase, 1u << level, fine.map, pool);
+    levelBase.data = coarse->map.data;
+    dirty.MarkAll();
   }
 
-  GFX::Heightmap Simulation::GetHeightmap() const
+  void Simulation::SaveCheckpoint(const std::string& path, CheckpointCompression compression)
   {
-    return GFX::Heightmap{ width, height, textureA };
+    if (coarse)
+    {
+      throw std::runtime_error("checkpoints can only be written once the coarse levels are done");
+    }
+
+    std::vector<CheckpointField> fields{ { CheckpointFieldId::TERRAIN, &fine.map.data } };
+    if (fine.grid)
+    {
+      const auto state = fine.grid->State();
+      for (size_t i = 0; i < state.size(); i++)
+      {
+        fields.push_back({ static_cast<CheckpointFieldId>(static_cast<uint32_t>(CheckpointFieldId::WATER) + i), state[i] });
+      }
+    }
+
+    const CheckpointInfo header{ width, height, fine.map.pitch, static_cast<uint32_t>(mode), seed, iteration };
+    WriteCheckpoint(path, header, fields, compression, pool);
+  }
+
+  void Simulation::LoadCheckpoint(const std::string& path)
+  {
+    const CheckpointReader reader(path);
+    const CheckpointInfo& saved = reader.Info();
+    if (saved.width != width || saved.height != height || saved.pitch != fine.map.pitch)
+    {
+      throw std::runtime_error(std::format("'{}' is a {}x{} checkpoint, the simulation is {}x{}", path, saved.width, saved.height, width, height));
+    }
+    if (saved.mode != static_cast<uint32_t>(mode))
+    {
+      throw std::runtime_error(std::format("'{}' was written by a simulation in a different erosion mode", path));
+    }
+
+    reader.ReadField(CheckpointFieldId::TERRAIN, fine.map.data, pool);
+    if (fine.grid)
+    {
+      const auto state = fine.grid->State();
+      for (size_t i = 0; i < state.size(); i++)
+      {
+        reader.ReadField(static_cast<CheckpointFieldId>(static_cast<uint32_t>(CheckpointFieldId::WATER) + i), *state[i], pool);
+      }
+    }
+
+    seed = saved.seed;
+    iteration = saved.iteration;
+    stats = {};
+    BeginLevel(0);
+    dirty.MarkAll();
   }
 }
\ No newline at end of file
@@ -1,34 +1,134 @@
 #pragma once
 #include "../macros.h"
-#include "../gfx/renderer.h"
+#include "heightfield.h"
+#include "dirty_tiles.h"
+#include "droplet.h"
+#include "grid.h"
+#include "thermal.h"
+#include "terrain.h"
+#include "checkpoint.h"
+#include "multires.h"
+#include "normals.h"
+#include "../utility/thread_pool.h"
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
 #include <glm/vec2.hpp>
 
 namespace Erosion
 {
-  struct Particle
+  enum class ErosionMode
   {
-    glm::vec2 pos{};
-    glm::vec2 vel{};
+    DROPLET, // particles carrying sediment downhill
+    GRID,    // shallow water flowing through virtual pipes between cells
+  };
 
+  struct SimulationCreateInfo
+  {
+    uint32_t width{};
+    uint32_t height{};
+    ErosionMode mode = ErosionMode::DROPLET;
+    TerrainParams terrain{};  // what Init fills the map with
+    DropletParams droplet{};
+    GridParams grid{};
+    ThermalParams thermal{};  // runs after the hydraulic mode, whichever it is
+    DropletBackend dropletBackend = DropletBackend::AUTO;
+    GridBackend gridBackend = GridBackend::AUTO;
+    uint32_t numThreads = std::thread::hardware_concurrency();
+    uint32_t tileSize = 64;   // droplet tile size, at least 2 * (DropletEroder::Margin() + 1)
+    MultiresParams multires{};
+  };
+
+  // work done since Init or LoadCheckpoint
+  struct SimulationStats
+  {
+    uint64_t updates{};
+    uint64_t dropletSteps{};   // one per droplet per cell it moved through
+    uint64_t gridSteps{};
+    uint64_t thermalSteps{};
   };
 
   class Simulation
   {
   public:
-    Simulation(uint32_t width, uint32_t height);
+    Simulation(const SimulationCreateInfo& createInfo);
     ~Simulation();
 
     void Init(uint64_t seed);
     void Update(double dt);
-    [[nodiscard]] GFX::Heightmap GetHeightmap() const;
+    [[nodiscard]] const Heightfield& GetHeightfield() const { return fine.map; }
+
+    // the parts of the map that changed since ClearDirty, for mirroring the heightfield elsewhere. Init marks the whole map
+    [[nodiscard]] const DirtyTiles& GetDirtyTiles() const { return dirty; }
+    void ClearDirty() { dirty.Clear(); }
+
+    // surface gradients of the map, for shading. Only kept up to date by UpdateNormals, which recomputes the cells
+    // next to the dirty tiles and must be called before ClearDirty
+    [[nodiscard]] const NormalMap& GetNormals() const { return normals; }
+    void UpdateNormals();
+    [[nodiscard]] ErosionMode GetMode() const { return mode; }
+    [[nodiscard]] uint64_t GetSeed() const { return seed; }
+    [[nodiscard]] uint64_t GetIteration() const { return iteration; }
+    [[nodiscard]] const SimulationStats& GetStats() const { return stats; }
+
+    // pyramid level being eroded, 0 is full resolution. While it is above 0 the map only changes every
+    // multires.syncInterval updates and when the level ends
+    [[nodiscard]] uint32_t GetLevel() const { return level; }
+
+    // writes the map, the grid fields and the seed and iteration the droplet spawns are drawn from.
+    // Loading a checkpoint and continuing gives the same result as never having stopped. Throws while GetLevel() is above 0
+    void SaveCheckpoint(const std::string& path, CheckpointCompression compression = CheckpointCompression::NONE);
+
+    // replaces Init and continues at full resolution. Throws std::runtime_error if the checkpoint is of a different size or mode
+    void LoadCheckpoint(const std::string& path);
 
     NOCOPY_NOMOVE(Simulation)
 
   private:
+    // a map of one pyramid level and the eroders that work on it. They run on the simulation's pool
+    struct LevelState
+    {
+      LevelState(const SimulationCreateInfo& createInfo);
+
+      NOCOPY_NOMOVE(LevelState)
+
+      Heightfield map;
+      DropletEroder eroder;
+      std::optional<GridEroder> grid;
+      ThermalEroder thermal;
+    };
+
+    // the hydraulic and thermal parts of an update. The cells they change are marked in changed if it is not null
+    void UpdateHydraulic(LevelState& state, DirtyTiles* changed);
+    void UpdateDroplets(LevelState& state, DirtyTiles* changed);
+    void UpdateThermal(LevelState& state, DirtyTiles* changed);
+
+    // moves on to the next finer level once the coarse one is done
+    void AdvanceLevel();
+    void BeginLevel(uint32_t newLevel);
+    void SyncLevel();
+
     uint32_t width;
     uint32_t height;
-    uint32_t textureA;
-    uint32_t textureB;
+
+    ErosionMode mode;
+    TerrainParams terrain;
+    LevelState fine;
+    ThreadPool pool;
+    uint32_t tileSize;
+    uint64_t seed = 0;
+    std::vector<glm::vec2> spawnPositions;
+    uint64_t iteration = 0;
+    DirtyTiles dirty;
+    NormalMap normals;
+    SimulationStats stats;
+
+    // the map at a lower resolution, while level is above 0
+    SimulationCreateInfo info;
+    uint32_t level = 0;
+    uint32_t levelUpdates = 0;
+    std::unique_ptr<LevelState> coarse;
+    Heightfield levelBase;   // the coarse map as of the last sync
   };
 }
\ No newline at end of file
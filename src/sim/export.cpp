@@ -0,0 +1,691 @@
+#include "export.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "normals_kernel.h"
+#include "../utility/thread_pool.h"
+#include "../utility/cpu_features.h"
+
+namespace Erosion
+{
+  namespace
+  {
+    static_assert(std::endian::native == std::endian::little, "RAW32 and TIFF32 samples are copied as is");
+
+    // largest stored deflate block
+    constexpr size_t maxStoredBlock = 65535;
+
+    constexpr std::array<uint32_t, 256> crcTable = []
+    {
+      std::array<uint32_t, 256> table{};
+      for (uint32_t i = 0; i < 256; i++)
+      {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+        {
+          c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+      }
+      return table;
+    }();
+
+    uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t size)
+    {
+      uint32_t c = ~crc;
+      for (size_t i = 0; i < size; i++)
+      {
+        c = crcTable[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+      }
+      return ~c;
+    }
+
+    uint32_t Gf2MatrixTimes(const uint32_t* matrix, uint32_t vector)
+    {
+      uint32_t sum = 0;
+      for (; vector != 0; vector >>= 1, matrix++)
+      {
+        if (vector & 1)
+        {
+          sum ^= *matrix;
+        }
+      }
+      return sum;
+    }
+
+    void Gf2MatrixSquare(uint32_t* square, const uint32_t* matrix)
+    {
+      for (int n = 0; n < 32; n++)
+      {
+        square[n] = Gf2MatrixTimes(matrix, matrix[n]);
+      }
+    }
+
+    // crc of a followed by b, given the crcs of both and the length of b. This lets chunks be checksummed in parallel
+    uint32_t Crc32Combine(uint32_t crcA, uint32_t crcB, uint64_t sizeB)
+    {
+      if (sizeB == 0)
+      {
+        return crcA;
+      }
+
+      // operators that append one, two and four zero bits, then repeated squaring for the bits of sizeB
+      uint32_t even[32];
+      uint32_t odd[32];
+      odd[0] = 0xEDB88320u;
+      for (int n = 1; n < 32; n++)
+      {
+        odd[n] = 1u << (n - 1);
+      }
+      Gf2MatrixSquare(even, odd);
+      Gf2MatrixSquare(odd, even);
+
+      while (sizeB != 0)
+      {
+        Gf2MatrixSquare(even, odd);
+        if (sizeB & 1)
+        {
+          crcA = Gf2MatrixTimes(even, crcA);
+        }
+        sizeB >>= 1;
+        if (sizeB == 0)
+        {
+          break;
+        }
+
+        Gf2MatrixSquare(odd, even);
+        if (sizeB & 1)
+        {
+          crcA = Gf2MatrixTimes(odd, crcA);
+        }
+        sizeB >>= 1;
+      }
+      return crcA ^ crcB;
+    }
+
+    constexpr uint32_t adlerBase = 65521;
+
+    uint32_t Adler32(uint32_t adler, const uint8_t* data, size_t size)
+    {
+      uint32_t a = adler & 0xFFFF;
+      uint32_t b = adler >> 16;
+      while (size > 0)
+      {
+        // the largest run whose sums can't overflow before they are reduced
+        const size_t run = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < run; i++)
+        {
+          a += data[i];
+          b += a;
+        }
+        a %= adlerBase;
+        b %= adlerBase;
+        data += run;
+        size -= run;
+      }
+      return a | (b << 16);
+    }
+
+    uint32_t Adler32Combine(uint32_t adlerA, uint32_t adlerB, uint64_t sizeB)
+    {
+      const uint64_t rem = sizeB % adlerBase;
+      uint64_t a = adlerA & 0xFFFF;
+      uint64_t b = rem * a % adlerBase;
+      a += (adlerB & 0xFFFF) + adlerBase - 1;
+      b += (adlerA >> 16) + (adlerB >> 16) + adlerBase - rem;
+      return static_cast<uint32_t>(a % adlerBase) | static_cast<uint32_t>(b % adlerBase) << 16;
+    }
+
+    void PutU16BE(uint8_t* p, uint16_t v)
+    {
+      p[0] = static_cast<uint8_t>(v >> 8);
+      p[1] = static_cast<uint8_t>(v);
+    }
+
+    void PutU32BE(uint8_t* p, uint32_t v)
+    {
+      p[0] = static_cast<uint8_t>(v >> 24);
+      p[1] = static_cast<uint8_t>(v >> 16);
+      p[2] = static_cast<uint8_t>(v >> 8);
+      p[3] = static_cast<uint8_t>(v);
+    }
+
+    bool Quantized(ImageFormat format)
+    {
+      return format != ImageFormat::RAW32 && format != ImageFormat::TIFF32;
+    }
+
+    // rows of a band encoded by one task
+    struct EncodedChunk
+    {
+      std::vector<uint8_t> bytes;
+      uint32_t crc{};         // of bytes, PNG only
+      uint32_t adler = 1;     // of the scanlines before they are split into deflate blocks, PNG only
+      uint64_t rawSize{};
+    };
+
+    void EncodeChunk(ImageFormat format, const float* samples, uint32_t rows, size_t rowSamples, float lo, float scale, bool finalChunk, EncodedChunk& chunk)
+    {
+      // NaN ends up as 0
+      auto quantize = [&](float v) { return static_cast<uint16_t>(std::max(0.0f, std::min((v - lo) * scale, 65535.0f)) + 0.5f); };
+      const size_t count = rows * rowSamples;
+
+      switch (format)
+      {
+      case ImageFormat::RAW32:
+      case ImageFormat::TIFF32:
+        chunk.bytes.resize(count * sizeof(float));
+        std::memcpy(chunk.bytes.data(), samples, chunk.bytes.size());
+        break;
+      case ImageFormat::RAW16:
+        chunk.bytes.resize(count * 2);
+        for (size_t i = 0; i < count; i++)
+        {
+          const uint16_t v = quantize(samples[i]);
+          chunk.bytes[i * 2] = static_cast<uint8_t>(v);
+          chunk.bytes[i * 2 + 1] = static_cast<uint8_t>(v >> 8);
+        }
+        break;
+      case ImageFormat::PGM16:
+        chunk.bytes.resize(count * 2);
+        for (size_t i = 0; i < count; i++)
+        {
+          PutU16BE(chunk.bytes.data() + i * 2, quantize(samples[i]));
+        }
+        break;
+      case ImageFormat::PNG16:
+      {
+        // scanlines with filter type 0, then cut into stored deflate blocks
+        const size_t rowBytes = 1 + rowSamples * 2;
+        std::vector<uint8_t> raw(rows * rowBytes);
+        for (uint32_t y = 0; y < rows; y++)
+        {
+          uint8_t* row = raw.data() + y * rowBytes;
+          row[0] = 0;
+          for (size_t i = 0; i < rowSamples; i++)
+          {
+            PutU16BE(row + 1 + i * 2, quantize(samples[y * rowSamples + i]));
+          }
+        }
+        chunk.rawSize = raw.size();
+        chunk.adler = Adler32(1, raw.data(), raw.size());
+
+        const size_t blocks = (raw.size() + maxStoredBlock - 1) / maxStoredBlock;
+        chunk.bytes.resize(raw.size() + blocks * 5);
+        uint8_t* out = chunk.bytes.data();
+        for (size_t b = 0; b < blocks; b++)
+        {
+          const size_t begin = b * maxStoredBlock;
+          const auto size = static_cast<uint16_t>(std::min(maxStoredBlock, raw.size() - begin));
+          out[0] = finalChunk && b + 1 == blocks ? 1 : 0;
+          out[1] = static_cast<uint8_t>(size);
+          out[2] = static_cast<uint8_t>(size >> 8);
+          out[3] = static_cast<uint8_t>(~size);
+          out[4] = static_cast<uint8_t>(~size >> 8);
+          std::memcpy(out + 5, raw.data() + begin, size);
+          out += 5 + size;
+        }
+        chunk.crc = Crc32(0, chunk.bytes.data(), chunk.bytes.size());
+        break;
+      }
+      }
+    }
+
+    void WriteBytes(std::ofstream& file, const uint8_t* data, size_t size)
+    {
+      file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    }
+
+    void WritePngChunk(std::ofstream& file, const char* type, const uint8_t* data, uint32_t size)
+    {
+      uint8_t length[4];
+      PutU32BE(length, size);
+      uint8_t crc[4];
+      PutU32BE(crc, Crc32(Crc32(0, reinterpret_cast<const uint8_t*>(type), 4), data, size));
+      WriteBytes(file, length, 4);
+      file.write(type, 4);
+      WriteBytes(file, data, size);
+      WriteBytes(file, crc, 4);
+    }
+
+    // classic TIFF is limited to 4 GiB, the directory goes after the strips since their sizes are known up front
+    class TiffDirectory
+    {
+    public:
+      void Add(uint16_t tag, uint16_t type, std::vector<uint32_t> values)
+      {
+        entries_.push_back({ tag, type, std::move(values) });
+      }
+
+      void Write(std::ofstream& file, uint32_t offset) const
+      {
+        const uint32_t directorySize = 2 + static_cast<uint32_t>(entries_.size()) * 12 + 4;
+        std::vector<uint8_t> directory;
+        std::vector<uint8_t> extra;
+        auto put = [](std::vector<uint8_t>& out, uint32_t v, size_t bytes)
+        {
+          for (size_t i = 0; i < bytes; i++)
+          {
+            out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+          }
+        };
+
+        put(directory, static_cast<uint32_t>(entries_.size()), 2);
+        for (const Entry& entry : entries_)
+        {
+          const size_t valueSize = entry.type == typeShort ? 2 : 4;
+          put(directory, entry.tag, 2);
+          put(directory, entry.type, 2);
+          put(directory, static_cast<uint32_t>(entry.values.size()), 4);
+          if (entry.values.size() * valueSize <= 4)
+          {
+            // values that fit are stored in the entry, left-justified
+            std::vector<uint8_t> packed;
+            for (uint32_t v : entry.values)
+            {
+              put(packed, v, valueSize);
+            }
+            packed.resize(4);
+            directory.insert(directory.end(), packed.begin(), packed.end());
+          }
+          else
+          {
+            put(directory, offset + directorySize + static_cast<uint32_t>(extra.size()), 4);
+            for (uint32_t v : entry.values)
+            {
+              put(extra, v, valueSize);
+            }
+          }
+        }
+        put(directory, 0, 4);
+
+        WriteBytes(file, directory.data(), directory.size());
+        WriteBytes(file, extra.data(), extra.size());
+      }
+
+      static constexpr uint16_t typeShort = 3;
+      static constexpr uint16_t typeLong = 4;
+
+    private:
+      struct Entry
+      {
+        uint16_t tag;
+        uint16_t type;
+        std::vector<uint32_t> values;
+      };
+
+      std::vector<Entry> entries_;
+    };
+
+    void Reshape(Heightfield& band, uint32_t width, uint32_t rows)
+    {
+      if (band.width != width || band.height != rows)
+      {
+        band = Heightfield(width, rows);
+      }
+    }
+  }
+
+  const char* ToString(ImageFormat format)
+  {
+    switch (format)
+    {
+    case ImageFormat::RAW16: return "raw16";
+    case ImageFormat::RAW32: return "raw32";
+    case ImageFormat::PGM16: return "pgm16";
+    case ImageFormat::PNG16: return "png16";
+    case ImageFormat::TIFF32: return "tiff32";
+    default: return "";
+    }
+  }
+
+  ImageFormat ImageFormatFromPath(const std::string& path)
+  {
+    std::string extension = path.substr(std::min(path.rfind('.'), path.size()));
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+    if (extension == ".r16" || extension == ".raw")
+    {
+      return ImageFormat::RAW16;
+    }
+    if (extension == ".pgm")
+    {
+      return ImageFormat::PGM16;
+    }
+    if (extension == ".png")
+    {
+      return ImageFormat::PNG16;
+    }
+    if (extension == ".tif" || extension == ".tiff")
+    {
+      return ImageFormat::TIFF32;
+    }
+    return ImageFormat::RAW32;
+  }
+
+  void WriteImage(const std::string& path, ImageFormat format, const ImageSource& source, ThreadPool& pool, uint32_t bandRows)
+  {
+    if (source.channels != 1 && source.channels != 3)
+    {
+      throw std::runtime_error(std::format("images must have 1 or 3 channels, not {}", source.channels));
+    }
+    if (format == ImageFormat::PGM16 && source.channels != 1)
+    {
+      throw std::runtime_error("PGM only holds single-channel images");
+    }
+    if (source.width == 0 || source.height == 0)
+    {
+      throw std::runtime_error("cannot write an empty image");
+    }
+
+    const uint32_t width = source.width;
+    const uint32_t height = source.height;
+    const size_t rowSamples = static_cast<size_t>(width) * source.channels;
+    bandRows = std::clamp(bandRows, 1u, height);
+    const uint32_t numBands = (height + bandRows - 1) / bandRows;
+    std::vector<float> band(rowSamples * bandRows);
+    const uint32_t numChunks = std::min(bandRows, pool.NumThreads() * 4);
+
+    auto forEachBand = [&](auto&& fn)
+    {
+      for (uint32_t y0 = 0; y0 < height; y0 += bandRows)
+      {
+        const uint32_t rows = std::min(bandRows, height - y0);
+        source.read(y0, rows, band.data());
+        fn(y0, rows);
+      }
+    };
+
+    float lo = source.lo;
+    float hi = source.hi;
+    if (Quantized(format) && !(lo < hi))
+    {
+      lo = std::numeric_limits<float>::max();
+      hi = std::numeric_limits<float>::lowest();
+      std::vector<std::pair<float, float>> ranges(numChunks);
+      forEachBand([&](uint32_t, uint32_t rows)
+        {
+          const size_t count = rows * rowSamples;
+          pool.ParallelFor(numChunks, [&](uint32_t c)
+            {
+              auto [chunkLo, chunkHi] = std::make_pair(lo, hi);
+              for (size_t i = count * c / numChunks; i < count * (c + 1) / numChunks; i++)
+              {
+                // comparisons with NaN are false, so NaN samples are skipped
+                chunkLo = band[i] < chunkLo ? band[i] : chunkLo;
+                chunkHi = band[i] > chunkHi ? band[i] : chunkHi;
+              }
+              ranges[c] = { chunkLo, chunkHi };
+            });
+          for (const auto& [chunkLo, chunkHi] : ranges)
+          {
+            lo = std::min(lo, chunkLo);
+            hi = std::max(hi, chunkHi);
+          }
+        });
+
+      if (source.symmetricRange)
+      {
+        hi = std::max(std::abs(lo), std::abs(hi));
+        lo = -hi;
+      }
+    }
+    const float scale = hi > lo ? 65535.0f / (hi - lo) : 0.0f;
+
+    const uint64_t imageBytes = static_cast<uint64_t>(rowSamples) * height * sizeof(float);
+    if (format == ImageFormat::TIFF32 && imageBytes + 4096 + numBands * 8ull > std::numeric_limits<uint32_t>::max())
+    {
+      throw std::runtime_error(std::format("a {}x{} float image is too large for a TIFF file", width, height));
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+      throw std::runtime_error(std::format("failed to open '{}' for writing", path));
+    }
+
+    switch (format)
+    {
+    case ImageFormat::PGM16:
+      file << std::format("P5\n{} {}\n65535\n", width, height);
+      break;
+    case ImageFormat::PNG16:
+    {
+      const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+      WriteBytes(file, signature, sizeof(signature));
+      uint8_t header[13]{};
+      PutU32BE(header, width);
+      PutU32BE(header + 4, height);
+      header[8] = 16;
+      header[9] = source.channels == 3 ? 2 : 0;
+      WritePngChunk(file, "IHDR", header, sizeof(header));
+
+      // zlib header for a stream without compression and without a preset dictionary
+      const uint8_t zlibHeader[2] = { 0x78, 0x01 };
+      WritePngChunk(file, "IDAT", zlibHeader, sizeof(zlibHeader));
+      break;
+    }
+    case ImageFormat::TIFF32:
+    {
+      uint8_t header[8] = { 'I', 'I', 42, 0 };
+      const auto directoryOffset = static_cast<uint32_t>(8 + imageBytes);
+      std::memcpy(header + 4, &directoryOffset, 4);
+      WriteBytes(file, header, sizeof(header));
+      break;
+    }
+    default:
+      break;
+    }
+
+    // every band becomes one IDAT chunk, or one TIFF strip
+    uint32_t adler = 1;
+    std::vector<EncodedChunk> chunks(numChunks);
+    forEachBand([&](uint32_t y0, uint32_t rows)
+      {
+        const bool lastBand = y0 + rows == height;
+        const uint32_t bandChunks = std::min(numChunks, rows);
+        pool.ParallelFor(bandChunks, [&](uint32_t c)
+          {
+            const uint32_t r0 = rows * c / bandChunks;
+            const uint32_t r1 = rows * (c + 1) / bandChunks;
+            EncodeChunk(format, band.data() + r0 * rowSamples, r1 - r0, rowSamples, lo, scale, lastBand && c + 1 == bandChunks, chunks[c]);
+          });
+
+        if (format == ImageFormat::PNG16)
+        {
+          uint64_t size = 0;
+          uint32_t crc = Crc32(0, reinterpret_cast<const uint8_t*>("IDAT"), 4);
+          for (uint32_t c = 0; c < bandChunks; c++)
+          {
+            size += chunks[c].bytes.size();
+            crc = Crc32Combine(crc, chunks[c].crc, chunks[c].bytes.size());
+            adler = Adler32Combine(adler, chunks[c].adler, chunks[c].rawSize);
+          }
+          if (size > std::numeric_limits<int32_t>::max())
+          {
+            throw std::runtime_error("image rows are too long for a PNG chunk, use fewer rows per band");
+          }
+
+          uint8_t length[4];
+          PutU32BE(length, static_cast<uint32_t>(size));
+          WriteBytes(file, length, 4);
+          file.write("IDAT", 4);
+          for (uint32_t c = 0; c < bandChunks; c++)
+          {
+            WriteBytes(file, chunks[c].bytes.data(), chunks[c].bytes.size());
+          }
+          uint8_t crcBytes[4];
+          PutU32BE(crcBytes, crc);
+          WriteBytes(file, crcBytes, 4);
+        }
+        else
+        {
+          for (uint32_t c = 0; c < bandChunks; c++)
+          {
+            WriteBytes(file, chunks[c].bytes.data(), chunks[c].bytes.size());
+          }
+        }
+      });
+
+    if (format == ImageFormat::PNG16)
+    {
+      uint8_t trailer[4];
+      PutU32BE(trailer, adler);
+      WritePngChunk(file, "IDAT", trailer, sizeof(trailer));
+      WritePngChunk(file, "IEND", nullptr, 0);
+    }
+    else if (format == ImageFormat::TIFF32)
+    {
+      std::vector<uint32_t> offsets;
+      std::vector<uint32_t> sizes;
+      for (uint32_t b = 0; b < numBands; b++)
+      {
+        const uint32_t rows = std::min(bandRows, height - b * bandRows);
+        offsets.push_back(static_cast<uint32_t>(8 + static_cast<uint64_t>(b) * bandRows * rowSamples * sizeof(float)));
+        sizes.push_back(static_cast<uint32_t>(rows * rowSamples * sizeof(float)));
+      }
+
+      TiffDirectory directory;
+      directory.Add(256, TiffDirectory::typeLong, { width });
+      directory.Add(257, TiffDirectory::typeLong, { height });
+      directory.Add(258, TiffDirectory::typeShort, std::vector<uint32_t>(source.channels, 32));  // bits per sample
+      directory.Add(259, TiffDirectory::typeShort, { 1 });  // no compression
+      directory.Add(262, TiffDirectory::typeShort, { source.channels == 3 ? 2u : 1u });  // RGB or black is zero
+      directory.Add(273, TiffDirectory::typeLong, std::move(offsets));
+      directory.Add(277, TiffDirectory::typeShort, { source.channels });
+      directory.Add(278, TiffDirectory::typeLong, { bandRows });
+      directory.Add(279, TiffDirectory::typeLong, std::move(sizes));
+      directory.Add(284, TiffDirectory::typeShort, { 1 });  // interleaved
+      directory.Add(339, TiffDirectory::typeShort, std::vector<uint32_t>(source.channels, 3));  // IEEE float
+      directory.Write(file, static_cast<uint32_t>(8 + imageBytes));
+    }
+
+    if (!file)
+    {
+      throw std::runtime_error(std::format("failed to write '{}'", path));
+    }
+  }
+
+  ImageSource HeightImage(uint32_t width, uint32_t height, HeightBandFn read)
+  {
+    auto band = std::make_shared<Heightfield>();
+    return
+    {
+      .width = width,
+      .height = height,
+      .read = [=](uint32_t y0, uint32_t rows, float* out)
+      {
+        Reshape(*band, width, rows);
+        read(y0, *band);
+        for (uint32_t y = 0; y < rows; y++)
+        {
+          std::memcpy(out + static_cast<size_t>(y) * width, band->Row(y), width * sizeof(float));
+        }
+      },
+    };
+  }
+
+  ImageSource NormalImage(uint32_t width, uint32_t height, HeightBandFn read, float cellSize)
+  {
+    // the same Sobel gradients NormalMap computes for the renderer
+#ifdef EROSION_AVX2
+    const auto sobelRow = HasAVX2() ? detail::SobelRowAVX2 : detail::SobelRowScalar;
+#else
+    const auto sobelRow = detail::SobelRowScalar;
+#endif
+
+    auto band = std::make_shared<std::pair<Heightfield, std::vector<float>>>();
+    return
+    {
+      .width = width,
+      .height = height,
+      .channels = 3,
+      .lo = -1.0f,
+      .hi = 1.0f,
+      .read = [=](uint32_t y0, uint32_t rows, float* out)
+      {
+        // one row of context above and below, the filter's rows are clamped to the map at its edges
+        auto& [heights, gradients] = *band;
+        const uint32_t top = y0 > 0 ? y0 - 1 : 0;
+        const uint32_t bottom = std::min(y0 + rows + 1, height);
+        Reshape(heights, width, bottom - top);
+        read(top, heights);
+        gradients.resize(static_cast<size_t>(width) * 2);
+
+        for (uint32_t y = 0; y < rows; y++)
+        {
+          const uint32_t by = y0 + y - top;
+          const uint32_t up = by > 0 ? by - 1 : by;
+          const uint32_t down = by + 1 < heights.height ? by + 1 : by;
+          const float yScale = down - up == 2 ? 0.125f : 0.25f;
+          sobelRow(heights.Row(up), heights.Row(by), heights.Row(down), yScale, width, 0, width, gradients.data());
+
+          float* normal = out + static_cast<size_t>(y) * width * 3;
+          for (uint32_t x = 0; x < width; x++, normal += 3)
+          {
+            const float dx = gradients[2 * x] / cellSize;
+            const float dy = gradients[2 * x + 1] / cellSize;
+            const float invLength = 1.0f / std::sqrt(dx * dx + dy * dy + 1.0f);
+            normal[0] = -dx * invLength;
+            normal[1] = -dy * invLength;
+            normal[2] = invLength;
+          }
+        }
+      },
+    };
+  }
+
+  ImageSource DepositionImage(uint32_t width, uint32_t height, HeightBandFn current, HeightBandFn baseline)
+  {
+    auto bands = std::make_shared<std::pair<Heightfield, Heightfield>>();
+    return
+    {
+      .width = width,
+      .height = height,
+      .symmetricRange = true,
+      .read = [=](uint32_t y0, uint32_t rows, float* out)
+      {
+        Reshape(bands->first, width, rows);
+        Reshape(bands->second, width, rows);
+        current(y0, bands->first);
+        baseline(y0, bands->second);
+        for (uint32_t y = 0; y < rows; y++)
+        {
+          for (uint32_t x = 0; x < width; x++)
+          {
+            out[static_cast<size_t>(y) * width + x] = bands->first.At(x, y) - bands->second.At(x, y);
+          }
+        }
+      },
+    };
+  }
+
+  ImageSource FlowImage(const Heightfield& accumulation)
+  {
+    const Heightfield* map = &accumulation;
+    return
+    {
+      .width = accumulation.width,
+      .height = accumulation.height,
+      .read = [=](uint32_t y0, uint32_t rows, float* out)
+      {
+        for (uint32_t y = 0; y < rows; y++)
+        {
+          const float* row = map->Row(y0 + y);
+          for (uint32_t x = 0; x < map->width; x++)
+          {
+            out[static_cast<size_t>(y) * map->width + x] = std::log1p(row[x]);
+          }
+        }
+      },
+    };
+  }
+}
\ No newline at end of file
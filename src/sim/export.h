@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "heightfield.h"
+
+class ThreadPool;
+
+namespace Erosion
+{
+  enum class ImageFormat
+  {
+    RAW16,    // little-endian uint16 samples, no header
+    RAW32,    // little-endian float samples, no header
+    PGM16,    // binary 16-bit grayscale netpbm, single channel only
+    PNG16,    // 16-bit grayscale or RGB PNG. Stored without compression, so it needs no deflate encoder
+    TIFF32,   // uncompressed 32-bit float TIFF, one strip per band
+  };
+
+  [[nodiscard]] const char* ToString(ImageFormat format);
+
+  // .r16 and .raw are RAW16, .png, .pgm, .tif and .tiff are what they say, anything else is RAW32
+  [[nodiscard]] ImageFormat ImageFormatFromPath(const std::string& path);
+
+  // an image that is produced band by band, so it never has to be in memory as a whole
+  struct ImageSource
+  {
+    uint32_t width{};
+    uint32_t height{};
+    uint32_t channels = 1;        // 1 or 3
+
+    // 16-bit formats map [lo, hi] to [0, 65535]. If lo >= hi the range is found with an extra pass over the source
+    float lo{};
+    float hi{};
+    bool symmetricRange = false;  // a found range is widened to be centered on 0
+
+    // fills out with rows [y0, y0 + rows), width * channels interleaved samples per row and no padding
+    std::function<void(uint32_t y0, uint32_t rows, float* out)> read;
+  };
+
+  // reads the source bandRows at a time and encodes each band in parallel chunks on the pool, then appends it to the file
+  void WriteImage(const std::string& path, ImageFormat format, const ImageSource& source, ThreadPool& pool, uint32_t bandRows = 256);
+
+  // fills band with rows [y0, y0 + band.height) of a heightmap
+  using HeightBandFn = std::function<void(uint32_t y0, Heightfield& band)>;
+
+  [[nodiscard]] ImageSource HeightImage(uint32_t width, uint32_t height, HeightBandFn read);
+
+  // unit normals as (x, y, z) in [-1, 1] with z up, from the same Sobel gradients as NormalMap. cellSize is the spacing
+  // of the cells in the units of the heights, the renderer draws the map one unit wide, which makes it 1 / width
+  [[nodiscard]] ImageSource NormalImage(uint32_t width, uint32_t height, HeightBandFn read, float cellSize);
+
+  // current minus baseline: material deposited is positive, material eroded negative
+  [[nodiscard]] ImageSource DepositionImage(uint32_t width, uint32_t height, HeightBandFn current, HeightBandFn baseline);
+
+  // log(1 + accumulation) of a FlowRouter, which keeps the small tributaries visible next to the main rivers
+  [[nodiscard]] ImageSource FlowImage(const Heightfield& accumulation);
+}
\ No newline at end of file
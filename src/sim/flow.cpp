@@ -0,0 +1,911 @@
+#include "flow.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <format>
+#include <functional>
+#include <limits>
+#include <numbers>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+#include "../utility/thread_pool.h"
+
+namespace Erosion
+{
+  namespace
+  {
+    // rows a pass over the map hands to one task
+    constexpr uint32_t rowsPerTask = 16;
+
+    // watershed of the cells that drain off the map edge
+    constexpr uint32_t oceanLabel = 1;
+
+    // distance of the flat cells no way out was found for
+    constexpr uint32_t unreached = std::numeric_limits<uint32_t>::max();
+
+    constexpr float diagonalScale = 0.70710678f;
+
+    // unsigned integers that sort the same way as the floats they are made from
+    uint32_t FloatKey(float value)
+    {
+      const uint32_t bits = std::bit_cast<uint32_t>(value);
+      return bits ^ ((bits & 0x80000000u) != 0 ? 0xFFFFFFFFu : 0x80000000u);
+    }
+
+    // monotone priority queue, the keys popped never decrease. That holds for priority-flood, where every cell is pushed
+    // above the level being flooded. Items sit in the bucket of the highest bit in which their key differs from the last
+    // key popped and only ever move to lower buckets, so each one is touched a few times instead of log n
+    class RadixHeap
+    {
+    public:
+      [[nodiscard]] bool Empty() const { return size_ == 0; }
+
+      void Push(uint32_t key, uint32_t value)
+      {
+        buckets_[Bucket(key)].push_back({ key, value });
+        size_++;
+      }
+
+      uint32_t Pop()
+      {
+        if (buckets_[0].empty())
+        {
+          size_t i = 1;
+          while (buckets_[i].empty())
+          {
+            i++;
+          }
+
+          // everything in the first non-empty bucket agrees with its minimum above bit i - 1, so it all lands lower
+          std::vector<Item>& bucket = buckets_[i];
+          last_ = std::min_element(bucket.begin(), bucket.end(), [](const Item& a, const Item& b) { return a.key < b.key; })->key;
+          for (const Item& item : bucket)
+          {
+            buckets_[Bucket(item.key)].push_back(item);
+          }
+          bucket.clear();
+        }
+
+        const uint32_t value = buckets_[0].back().value;
+        buckets_[0].pop_back();
+        size_--;
+        return value;
+      }
+
+    private:
+      struct Item
+      {
+        uint32_t key;
+        uint32_t value;
+      };
+
+      [[nodiscard]] uint32_t Bucket(uint32_t key) const
+      {
+        return key == last_ ? 0 : static_cast<uint32_t>(32 - std::countl_zero(key ^ last_));
+      }
+
+      std::array<std::vector<Item>, 33> buckets_;
+      uint32_t last_ = 0;
+      size_t size_ = 0;
+    };
+
+    // the same two watersheds touch along their whole boundary, so most edges repeat the ones just before them. A small
+    // direct-mapped table keeps the lowest of each pair it has seen and only passes an edge on when it is evicted
+    template<typename Edge>
+    class SpillCache
+    {
+    public:
+      explicit SpillCache(std::vector<Edge>& edges) : edges_(edges), slots_(size) {}
+
+      void Add(uint32_t a, uint32_t b, float height)
+      {
+        if (a > b)
+        {
+          std::swap(a, b);
+        }
+        Edge& slot = slots_[(a * 0x9E3779B1u ^ b) & (size - 1)];
+        if (slot.a == a && slot.b == b)
+        {
+          slot.height = std::min(slot.height, height);
+          return;
+        }
+        if (slot.a != 0)
+        {
+          edges_.push_back(slot);
+        }
+        slot = { a, b, height };
+      }
+
+      void Flush()
+      {
+        for (const Edge& slot : slots_)
+        {
+          if (slot.a != 0)
+          {
+            edges_.push_back(slot);
+          }
+        }
+      }
+
+    private:
+      static constexpr uint32_t size = 1024;
+
+      std::vector<Edge>& edges_;
+      std::vector<Edge> slots_;
+    };
+
+    uint32_t CheckTileSize(uint32_t tileSize)
+    {
+      if (tileSize < 2)
+      {
+        throw std::runtime_error(std::format("flow tile size {} is smaller than 2", tileSize));
+      }
+      return tileSize;
+    }
+  }
+
+  const char* ToString(FlowMethod method)
+  {
+    switch (method)
+    {
+    case FlowMethod::D8: return "d8";
+    case FlowMethod::DINF: return "dinf";
+    }
+    return "unknown";
+  }
+
+  FlowRouter::FlowRouter(uint32_t width, uint32_t height, const FlowParams& params)
+    : width_(width),
+      height_(height),
+      params_(params),
+      tilesX_((width + CheckTileSize(params.tileSize) - 1) / params.tileSize),
+      tilesY_((height + params.tileSize - 1) / params.tileSize),
+      filled_(width, height),
+      labels_(static_cast<size_t>(width) * height),
+      directions_(static_cast<size_t>(width) * height),
+      shares_(params.method == FlowMethod::DINF ? static_cast<size_t>(width) * height : 0),
+      donors_(static_cast<size_t>(width) * height),
+      accumulation_(width, height)
+  {
+  }
+
+  void FlowRouter::Compute(const Heightfield& map, ThreadPool& pool)
+  {
+    if (map.width != width_ || map.height != height_)
+    {
+      throw std::runtime_error(std::format("flow router is {}x{}, the map {}x{}", width_, height_, map.width, map.height));
+    }
+
+    ForEachBand(pool, height_, rowsPerTask, [&](uint32_t y0, uint32_t y1)
+      {
+        std::copy(map.Row(y0), map.Row(y1), filled_.Row(y0));
+      });
+
+    if (params_.fillDepressions)
+    {
+      FillDepressions(pool);
+    }
+    ComputeDirections(pool);
+    ResolveFlats(pool);
+    Accumulate(pool);
+  }
+
+  // Barnes, Lehman and Mulla 2014 priority-flood with the pit queue, confined to one tile. Every cell on the tile's
+  // perimeter is a seed and starts a watershed of its own, except those on the map edge, which all belong to the
+  // ocean. Cells get the watershed they are reached from and are raised to the level it is flooded to, which is a
+  // lower bound of the final fill. Wherever two watersheds touch, the level at which water crosses is recorded
+  void FlowRouter::FloodTile(uint32_t tile, std::vector<SpillEdge>& edges)
+  {
+    const uint32_t tileSize = params_.tileSize;
+    const uint32_t x0 = tile % tilesX_ * tileSize;
+    const uint32_t y0 = tile / tilesX_ * tileSize;
+    const uint32_t tileWidth = std::min(tileSize, width_ - x0);
+    const uint32_t tileHeight = std::min(tileSize, height_ - y0);
+
+    // a perimeter of at most 4 * tileSize cells makes at most that many watersheds, so the tiles never share a label
+    uint32_t nextLabel = oceanLabel + 1 + tile * 4 * tileSize;
+
+    std::vector<uint8_t> queued(static_cast<size_t>(tileWidth) * tileHeight);
+    SpillCache spills(edges);
+    RadixHeap open;
+    std::vector<uint32_t> pit;
+    size_t pitHead = 0;
+    std::vector<uint32_t> slope;
+
+    // a cell none of whose unqueued neighbors is as low as it drains through the cell that reached it, whatever is
+    // flooded later, so it can be taken right away instead of going through the heap (Zhou, Sun and Fu 2016). On
+    // smooth terrain that is most of the map
+    const auto onSlope = [&](uint32_t lx, uint32_t ly, float height)
+      {
+        for (uint32_t k = 0; k < 8; k++)
+        {
+          const uint32_t nx = lx + static_cast<uint32_t>(flowOffsetX[k]);
+          const uint32_t ny = ly + static_cast<uint32_t>(flowOffsetY[k]);
+          if (nx < tileWidth && ny < tileHeight && !queued[nx + ny * tileWidth] && filled_.At(x0 + nx, y0 + ny) <= height)
+          {
+            return false;
+          }
+        }
+        return true;
+      };
+
+    for (uint32_t ly = 0; ly < tileHeight; ly++)
+    {
+      std::fill_n(&labels_[x0 + static_cast<size_t>(y0 + ly) * width_], tileWidth, 0u);
+
+      const bool border = ly == 0 || ly == tileHeight - 1;
+      for (uint32_t lx = 0; lx < tileWidth; lx += border || lx == tileWidth - 1 ? 1 : tileWidth - 1)
+      {
+        const uint32_t x = x0 + lx;
+        const uint32_t y = y0 + ly;
+        if (x == 0 || y == 0 || x == width_ - 1 || y == height_ - 1)
+        {
+          labels_[x + static_cast<size_t>(y) * width_] = oceanLabel;
+        }
+        queued[lx + static_cast<size_t>(ly) * tileWidth] = 1;
+        open.Push(FloatKey(filled_.At(x, y)), lx + ly * tileWidth);
+      }
+    }
+
+    while (true)
+    {
+      // cells raised to the level being flooded are taken first, they need no ordering among themselves
+      uint32_t cell;
+      if (pitHead < pit.size())
+      {
+        cell = pit[pitHead++];
+      }
+      else if (!slope.empty())
+      {
+        cell = slope.back();
+        slope.pop_back();
+      }
+      else if (!open.Empty())
+      {
+        pit.clear();
+        pitHead = 0;
+        cell = open.Pop();
+      }
+      else
+      {
+        break;
+      }
+
+      const uint32_t lx = cell % tileWidth;
+      const uint32_t ly = cell / tileWidth;
+      uint32_t& label = labels_[x0 + lx + static_cast<size_t>(y0 + ly) * width_];
+      if (label == 0)
+      {
+        label = nextLabel++;
+      }
+      const float level = filled_.At(x0 + lx, y0 + ly);
+
+      for (uint32_t k = 0; k < 8; k++)
+      {
+        const uint32_t nx = lx + static_cast<uint32_t>(flowOffsetX[k]);
+        const uint32_t ny = ly + static_cast<uint32_t>(flowOffsetY[k]);
+        if (nx >= tileWidth || ny >= tileHeight)
+        {
+          continue;
+        }
+
+        const uint32_t neighbor = nx + ny * tileWidth;
+        uint32_t& neighborLabel = labels_[x0 + nx + static_cast<size_t>(y0 + ny) * width_];
+        float& neighborHeight = filled_.At(x0 + nx, y0 + ny);
+        if (queued[neighbor])
+        {
+          // perimeter cells are queued before they have a label, they record the edge once they are taken
+          if (neighborLabel != 0 && neighborLabel != label)
+          {
+            spills.Add(label, neighborLabel, std::max(level, neighborHeight));
+          }
+          continue;
+        }
+
+        queued[neighbor] = 1;
+        neighborLabel = label;
+        if (neighborHeight <= level)
+        {
+          neighborHeight = level;
+          pit.push_back(neighbor);
+        }
+        else if (onSlope(nx, ny, neighborHeight))
+        {
+          slope.push_back(neighbor);
+        }
+        else
+        {
+          open.Push(FloatKey(neighborHeight), neighbor);
+        }
+      }
+    }
+    spills.Flush();
+  }
+
+  // adds the edges from the tile's perimeter into the tiles after it, then keeps the lowest edge between every pair
+  void FlowRouter::LinkTile(uint32_t tile, std::vector<SpillEdge>& edges) const
+  {
+    const uint32_t tileSize = params_.tileSize;
+    const uint32_t x0 = tile % tilesX_ * tileSize;
+    const uint32_t y0 = tile / tilesX_ * tileSize;
+    const uint32_t x1 = std::min(x0 + tileSize, width_);
+    const uint32_t y1 = std::min(y0 + tileSize, height_);
+
+    for (uint32_t y = y0; y < y1; y++)
+    {
+      const bool border = y == y0 || y == y1 - 1;
+      for (uint32_t x = x0; x < x1; x += border || x == x1 - 1 ? 1 : x1 - 1 - x0)
+      {
+        const uint32_t label = labels_[x + static_cast<size_t>(y) * width_];
+        const float level = filled_.At(x, y);
+        for (uint32_t k = 0; k < 8; k++)
+        {
+          const uint32_t nx = x + static_cast<uint32_t>(flowOffsetX[k]);
+          const uint32_t ny = y + static_cast<uint32_t>(flowOffsetY[k]);
+          if (nx >= width_ || ny >= height_ || nx / tileSize + ny / tileSize * tilesX_ <= tile)
+          {
+            continue;
+          }
+
+          const uint32_t neighborLabel = labels_[nx + static_cast<size_t>(ny) * width_];
+          if (neighborLabel != label)
+          {
+            edges.push_back({ std::min(label, neighborLabel), std::max(label, neighborLabel), std::max(level, filled_.At(nx, ny)) });
+          }
+        }
+      }
+    }
+
+    std::sort(edges.begin(), edges.end(), [](const SpillEdge& a, const SpillEdge& b)
+      {
+        return std::tie(a.a, a.b, a.height) < std::tie(b.a, b.b, b.height);
+      });
+    edges.erase(std::unique(edges.begin(), edges.end(), [](const SpillEdge& a, const SpillEdge& b)
+      {
+        return a.a == b.a && a.b == b.b;
+      }), edges.end());
+  }
+
+  // Barnes 2016: the tiles are flooded independently, then the watersheds are joined into a graph whose edges are the
+  // levels at which water crosses between them. The lowest level at which a watershed drains to the ocean is the
+  // largest edge on its best path there, which a Dijkstra search from the ocean finds. Raising every cell to the level
+  // of its watershed then gives the same fill as flooding the whole map at once
+  void FlowRouter::FillDepressions(ThreadPool& pool)
+  {
+    const uint32_t numTiles = tilesX_ * tilesY_;
+    std::vector<std::vector<SpillEdge>> tileEdges(numTiles);
+    pool.ParallelFor(numTiles, [&](uint32_t tile) { FloodTile(tile, tileEdges[tile]); });
+    pool.ParallelFor(numTiles, [&](uint32_t tile) { LinkTile(tile, tileEdges[tile]); });
+
+    // both directions of every edge, grouped by the watershed they start from
+    const uint32_t numLabels = oceanLabel + 1 + numTiles * 4 * params_.tileSize;
+    std::vector<uint32_t> first(numLabels + 1);
+    for (const std::vector<SpillEdge>& edges : tileEdges)
+    {
+      for (const SpillEdge& edge : edges)
+      {
+        first[edge.a + 1]++;
+        first[edge.b + 1]++;
+      }
+    }
+    for (uint32_t label = 0; label < numLabels; label++)
+    {
+      first[label + 1] += first[label];
+    }
+
+    struct Link
+    {
+      uint32_t to;
+      float height;
+    };
+    std::vector<Link> links(first[numLabels]);
+    std::vector<uint32_t> next(first.begin(), first.end() - 1);
+    for (std::vector<SpillEdge>& edges : tileEdges)
+    {
+      for (const SpillEdge& edge : edges)
+      {
+        links[next[edge.a]++] = { edge.b, edge.height };
+        links[next[edge.b]++] = { edge.a, edge.height };
+      }
+      edges = {};
+    }
+
+    std::vector<float> levels(numLabels, std::numeric_limits<float>::infinity());
+    using Entry = std::pair<float, uint32_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<>> queue;
+    levels[oceanLabel] = -std::numeric_limits<float>::infinity();
+    queue.push({ levels[oceanLabel], oceanLabel });
+    while (!queue.empty())
+    {
+      const auto [level, label] = queue.top();
+      queue.pop();
+      if (level > levels[label])
+      {
+        continue;
+      }
+      for (uint32_t i = first[label]; i < first[label + 1]; i++)
+      {
+        const float crossing = std::max(level, links[i].height);
+        if (crossing < levels[links[i].to])
+        {
+          levels[links[i].to] = crossing;
+          queue.push({ crossing, links[i].to });
+        }
+      }
+    }
+
+    ForEachBand(pool, height_, rowsPerTask, [&](uint32_t y0, uint32_t y1)
+      {
+        for (uint32_t y = y0; y < y1; y++)
+        {
+          float* row = filled_.Row(y);
+          const uint32_t* labels = &labels_[static_cast<size_t>(y) * width_];
+          for (uint32_t x = 0; x < width_; x++)
+          {
+            row[x] = std::max(row[x], levels[labels[x]]);
+          }
+        }
+      });
+  }
+
+  void FlowRouter::ComputeDirections(ThreadPool& pool)
+  {
+    constexpr float quarterTurn = std::numbers::pi_v<float> / 4;
+
+    ForEachBand(pool, height_, rowsPerTask, [&](uint32_t y0, uint32_t y1)
+      {
+        for (uint32_t y = y0; y < y1; y++)
+        {
+          for (uint32_t x = 0; x < width_; x++)
+          {
+            const float h = filled_.At(x, y);
+            const size_t cell = x + static_cast<size_t>(y) * width_;
+            const auto inMap = [&](uint32_t k)
+              {
+                return x + static_cast<uint32_t>(flowOffsetX[k]) < width_ && y + static_cast<uint32_t>(flowOffsetY[k]) < height_;
+              };
+            const auto heightAt = [&](uint32_t k)
+              {
+                return filled_.At(x + static_cast<uint32_t>(flowOffsetX[k]), y + static_cast<uint32_t>(flowOffsetY[k]));
+              };
+
+            if (params_.method == FlowMethod::D8)
+            {
+              uint8_t best = flowNone;
+              float bestSlope = 0;
+              for (uint8_t k = 0; k < 8; k++)
+              {
+                if (!inMap(k))
+                {
+                  continue;
+                }
+                const float drop = h - heightAt(k);
+                const float slope = k & 1 ? drop * diagonalScale : drop;
+                if (slope > bestSlope)
+                {
+                  bestSlope = slope;
+                  best = k;
+                }
+              }
+              directions_[cell] = best;
+              continue;
+            }
+
+            // Tarboton's triangular facets between a cardinal and a diagonal neighbor. Within a facet the flow direction
+            // is the steepest one of the plane through the three cells, clamped to the facet's edges
+            uint8_t bestFacet = flowNone;
+            float bestSlope = 0;
+            float bestAcross = 0;
+            float bestAlong = 0;
+            for (uint8_t k = 0; k < 8; k++)
+            {
+              const uint8_t cardinal = k & 1 ? static_cast<uint8_t>((k + 1) % 8) : k;
+              const uint8_t diagonal = k & 1 ? k : k + 1;
+              if (!inMap(cardinal) || !inMap(diagonal))
+              {
+                continue;
+              }
+
+              const float along = h - heightAt(cardinal);
+              const float across = heightAt(cardinal) - heightAt(diagonal);
+              float slope;
+              if (across <= 0)
+              {
+                slope = along;
+              }
+              else if (across >= along)
+              {
+                slope = (h - heightAt(diagonal)) * diagonalScale;
+              }
+              else
+              {
+                slope = std::sqrt(along * along + across * across);
+              }
+
+              if (slope > bestSlope)
+              {
+                bestSlope = slope;
+                bestFacet = k;
+                bestAlong = along;
+                bestAcross = across;
+              }
+            }
+
+            if (bestFacet == flowNone)
+            {
+              directions_[cell] = flowNone;
+              continue;
+            }
+
+            // fraction of the facet's angle the direction is turned from the cardinal towards the diagonal
+            const float turn = bestAcross <= 0 ? 0 : bestAcross >= bestAlong ? 1 : std::atan2(bestAcross, bestAlong) / quarterTurn;
+            float share = bestFacet & 1 ? turn : 1 - turn;
+            uint8_t direction = bestFacet;
+            if (share <= 0)
+            {
+              // all of it goes to the second neighbor, which may not even be downhill of the first
+              direction = static_cast<uint8_t>((bestFacet + 1) % 8);
+              share = 1;
+            }
+            directions_[cell] = direction;
+            shares_[cell] = std::min(share, 1.0f);
+          }
+        }
+      });
+  }
+
+  uint32_t FlowRouter::TileOf(size_t cell) const
+  {
+    const uint32_t x = static_cast<uint32_t>(cell % width_);
+    const uint32_t y = static_cast<uint32_t>(cell / width_);
+    return x / params_.tileSize + y / params_.tileSize * tilesX_;
+  }
+
+  // cells without a lower neighbor inside the map are flats, most of them left by filling. Each one drains to the
+  // nearest cell of the same height that does drain, one step at a time, so water leaves a flat by its shortest way out.
+  // Edge cells drain off the map. With depression filling off, cells in pits are not reached and keep flowNone.
+  // The distances to the way out are searched for tile by tile, and whatever a search can improve in the neighboring
+  // tiles seeds their next search, until nothing improves. Then every cell drains to the first neighbor one step
+  // closer, so the result does not depend on the tiles
+  void FlowRouter::ResolveFlats(ThreadPool& pool)
+  {
+    const auto interior = [&](uint32_t x, uint32_t y)
+      {
+        return x > 0 && y > 0 && x < width_ - 1 && y < height_ - 1;
+      };
+
+    // the watersheds are not needed any more, the distances take their place
+    std::vector<uint32_t>& distances = labels_;
+    ForEachBand(pool, height_, rowsPerTask, [&](uint32_t y0, uint32_t y1)
+      {
+        std::fill(distances.begin() + static_cast<ptrdiff_t>(y0) * width_, distances.begin() + static_cast<ptrdiff_t>(y1) * width_, unreached);
+      });
+
+    // flat cells next to a way out, found in parallel, and the direction to it
+    const uint32_t numTasks = (height_ + rowsPerTask - 1) / rowsPerTask;
+    std::vector<std::vector<std::pair<uint32_t, uint8_t>>> taskOutlets(numTasks);
+    ForEachBand(pool, height_, rowsPerTask, [&](uint32_t y0, uint32_t y1)
+      {
+        std::vector<std::pair<uint32_t, uint8_t>>& outlets = taskOutlets[y0 / rowsPerTask];
+        for (uint32_t y = y0; y < y1; y++)
+        {
+          for (uint32_t x = 0; x < width_; x++)
+          {
+            const size_t cell = x + static_cast<size_t>(y) * width_;
+            if (directions_[cell] != flowNone || !interior(x, y))
+            {
+              continue;
+            }
+            for (uint8_t k = 0; k < 8; k++)
+            {
+              const uint32_t nx = x + static_cast<uint32_t>(flowOffsetX[k]);
+              const uint32_t ny = y + static_cast<uint32_t>(flowOffsetY[k]);
+              if (filled_.At(nx, ny) == filled_.At(x, y) && (directions_[nx + static_cast<size_t>(ny) * width_] != flowNone || !interior(nx, ny)))
+              {
+                outlets.push_back({ static_cast<uint32_t>(cell), k });
+                break;
+              }
+            }
+          }
+        }
+      });
+
+    const uint32_t numTiles = tilesX_ * tilesY_;
+    std::vector<std::vector<FlatStep>> seeds(numTiles);
+    std::vector<std::vector<FlatStep>> crossings(numTiles);
+    for (const std::vector<std::pair<uint32_t, uint8_t>>& outlets : taskOutlets)
+    {
+      for (const auto& [cell, k] : outlets)
+      {
+        directions_[cell] = k;
+        if (params_.method == FlowMethod::DINF)
+        {
+          shares_[cell] = 1;
+        }
+        distances[cell] = 0;
+        seeds[TileOf(cell)].push_back({ cell, 0 });
+      }
+    }
+
+    std::vector<uint32_t> active;
+    while (true)
+    {
+      active.clear();
+      for (uint32_t tile = 0; tile < numTiles; tile++)
+      {
+        if (!seeds[tile].empty())
+        {
+          active.push_back(tile);
+        }
+      }
+      if (active.empty())
+      {
+        break;
+      }
+
+      pool.ParallelFor(static_cast<uint32_t>(active.size()), [&](uint32_t i) { SearchFlats(active[i], seeds[active[i]], crossings[active[i]]); });
+      for (uint32_t tile : active)
+      {
+        for (const FlatStep& step : crossings[tile])
+        {
+          if (step.distance < distances[step.cell])
+          {
+            distances[step.cell] = step.distance;
+            seeds[TileOf(step.cell)].push_back(step);
+          }
+        }
+        crossings[tile].clear();
+      }
+    }
+
+    ForEachBand(pool, height_, rowsPerTask, [&](uint32_t y0, uint32_t y1)
+      {
+        for (uint32_t y = y0; y < y1; y++)
+        {
+          for (uint32_t x = 0; x < width_; x++)
+          {
+            // outlets already drain, and cells with a distance are interior, so all their neighbors are on the map
+            const size_t cell = x + static_cast<size_t>(y) * width_;
+            if (directions_[cell] != flowNone || distances[cell] == unreached)
+            {
+              continue;
+            }
+            for (uint8_t k = 0; k < 8; k++)
+            {
+              const uint32_t nx = x + static_cast<uint32_t>(flowOffsetX[k]);
+              const uint32_t ny = y + static_cast<uint32_t>(flowOffsetY[k]);
+              if (distances[nx + static_cast<size_t>(ny) * width_] == distances[cell] - 1 && filled_.At(nx, ny) == filled_.At(x, y))
+              {
+                directions_[cell] = k;
+                if (params_.method == FlowMethod::DINF)
+                {
+                  shares_[cell] = 1;
+                }
+                break;
+              }
+            }
+          }
+        }
+      });
+  }
+
+  // breadth-first search over the flat cells of one tile, from seeds whose distances are already set. Cells of other
+  // tiles the search reaches are left to the merge between rounds, as only it may touch them
+  void FlowRouter::SearchFlats(uint32_t tile, std::vector<FlatStep>& seeds, std::vector<FlatStep>& crossings)
+  {
+    const uint32_t tileSize = params_.tileSize;
+    const uint32_t x0 = tile % tilesX_ * tileSize;
+    const uint32_t y0 = tile / tilesX_ * tileSize;
+    const uint32_t x1 = std::min(x0 + tileSize, width_);
+    const uint32_t y1 = std::min(y0 + tileSize, height_);
+
+    // the seeds are merged into the queue by distance, which keeps it sorted
+    std::sort(seeds.begin(), seeds.end(), [](const FlatStep& a, const FlatStep& b) { return std::tie(a.distance, a.cell) < std::tie(b.distance, b.cell); });
+    std::vector<FlatStep> queue;
+    size_t head = 0;
+    size_t nextSeed = 0;
+    while (true)
+    {
+      FlatStep step;
+      if (nextSeed < seeds.size() && (head == queue.size() || seeds[nextSeed].distance <= queue[head].distance))
+      {
+        step = seeds[nextSeed++];
+      }
+      else if (head < queue.size())
+      {
+        step = queue[head++];
+      }
+      else
+      {
+        break;
+      }
+
+      // a seed can be beaten by a shorter way found since
+      if (step.distance > labels_[step.cell])
+      {
+        continue;
+      }
+
+      const uint32_t x = step.cell % width_;
+      const uint32_t y = step.cell / width_;
+      for (uint8_t k = 0; k < 8; k++)
+      {
+        const uint32_t nx = x + static_cast<uint32_t>(flowOffsetX[k]);
+        const uint32_t ny = y + static_cast<uint32_t>(flowOffsetY[k]);
+        const size_t neighbor = nx + static_cast<size_t>(ny) * width_;
+        if (nx == 0 || ny == 0 || nx >= width_ - 1 || ny >= height_ - 1 || directions_[neighbor] != flowNone || filled_.At(nx, ny) != filled_.At(x, y))
+        {
+          continue;
+        }
+
+        const FlatStep next = { static_cast<uint32_t>(neighbor), step.distance + 1 };
+        if (nx < x0 || ny < y0 || nx >= x1 || ny >= y1)
+        {
+          crossings.push_back(next);
+        }
+        else if (next.distance < labels_[neighbor])
+        {
+          labels_[neighbor] = next.distance;
+          queue.push_back(next);
+        }
+      }
+    }
+    seeds.clear();
+  }
+
+  void FlowRouter::Accumulate(ThreadPool& pool)
+  {
+    const bool dinf = params_.method == FlowMethod::DINF;
+
+    // receivers of a cell: its direction, and with DINF the next one counterclockwise when it gets a share
+    const auto drainsTo = [&](size_t cell, uint8_t k)
+      {
+        const uint8_t direction = directions_[cell];
+        return direction == k || (dinf && direction != flowNone && shares_[cell] < 1 && (direction + 1) % 8 == k);
+      };
+
+    ForEachBand(pool, height_, rowsPerTask, [&](uint32_t y0, uint32_t y1)
+      {
+        for (uint32_t y = y0; y < y1; y++)
+        {
+          std::fill_n(accumulation_.Row(y), width_, 1.0f);
+          for (uint32_t x = 0; x < width_; x++)
+          {
+            uint8_t count = 0;
+            for (uint8_t k = 0; k < 8; k++)
+            {
+              const uint32_t nx = x + static_cast<uint32_t>(flowOffsetX[k]);
+              const uint32_t ny = y + static_cast<uint32_t>(flowOffsetY[k]);
+              if (nx < width_ && ny < height_ && drainsTo(nx + static_cast<size_t>(ny) * width_, static_cast<uint8_t>((k + 4) % 8)))
+              {
+                count++;
+              }
+            }
+            donors_[x + static_cast<size_t>(y) * width_] = count;
+          }
+        }
+      });
+
+    // the tiles pass the water on among their own cells, and what crosses into another tile is handed to it between
+    // rounds. The rounds do not depend on the number of threads, so neither does the order in which water is summed
+    const uint32_t numTiles = tilesX_ * tilesY_;
+    std::vector<std::vector<FlowStep>> incoming(numTiles);
+    std::vector<std::vector<FlowStep>> outgoing(numTiles);
+    pool.ParallelFor(numTiles, [&](uint32_t tile) { AccumulateTile(tile, true, incoming[tile], outgoing[tile]); });
+
+    std::vector<uint32_t> active;
+    while (true)
+    {
+      active.clear();
+      for (uint32_t tile = 0; tile < numTiles; tile++)
+      {
+        for (const FlowStep& step : outgoing[tile])
+        {
+          incoming[TileOf(step.cell)].push_back(step);
+        }
+        outgoing[tile].clear();
+      }
+      for (uint32_t tile = 0; tile < numTiles; tile++)
+      {
+        if (!incoming[tile].empty())
+        {
+          active.push_back(tile);
+        }
+      }
+      if (active.empty())
+      {
+        break;
+      }
+
+      pool.ParallelFor(static_cast<uint32_t>(active.size()), [&](uint32_t i) { AccumulateTile(active[i], false, incoming[active[i]], outgoing[active[i]]); });
+    }
+  }
+
+  // a cell is done once all of its donors are, then it passes its total on downstream. The first round starts from the
+  // cells without donors, the later ones from the water that came in from other tiles. Done cells are marked so the
+  // scan does not start from them again
+  void FlowRouter::AccumulateTile(uint32_t tile, bool scan, std::vector<FlowStep>& incoming, std::vector<FlowStep>& outgoing)
+  {
+    const bool dinf = params_.method == FlowMethod::DINF;
+    const uint32_t tileSize = params_.tileSize;
+    const uint32_t x0 = tile % tilesX_ * tileSize;
+    const uint32_t y0 = tile / tilesX_ * tileSize;
+    const uint32_t x1 = std::min(x0 + tileSize, width_);
+    const uint32_t y1 = std::min(y0 + tileSize, height_);
+
+    constexpr uint8_t done = 0xFF;
+    std::vector<uint32_t> stack;
+    const auto pass = [&](uint32_t x, uint32_t y, uint8_t k, float amount)
+      {
+        const uint32_t nx = x + static_cast<uint32_t>(flowOffsetX[k]);
+        const uint32_t ny = y + static_cast<uint32_t>(flowOffsetY[k]);
+        const size_t neighbor = nx + static_cast<size_t>(ny) * width_;
+        if (nx < x0 || ny < y0 || nx >= x1 || ny >= y1)
+        {
+          outgoing.push_back({ static_cast<uint32_t>(neighbor), amount });
+          return;
+        }
+        accumulation_.At(nx, ny) += amount;
+        if (--donors_[neighbor] == 0)
+        {
+          stack.push_back(static_cast<uint32_t>(neighbor));
+        }
+      };
+    const auto drain = [&]
+      {
+        while (!stack.empty())
+        {
+          const uint32_t cell = stack.back();
+          stack.pop_back();
+          donors_[cell] = done;
+          const uint8_t k = directions_[cell];
+          if (k == flowNone)
+          {
+            continue;
+          }
+
+          const uint32_t x = cell % width_;
+          const uint32_t y = cell / width_;
+          const float total = accumulation_.At(x, y);
+          if (!dinf || shares_[cell] >= 1)
+          {
+            pass(x, y, k, total);
+          }
+          else
+          {
+            pass(x, y, k, total * shares_[cell]);
+            pass(x, y, static_cast<uint8_t>((k + 1) % 8), total * (1 - shares_[cell]));
+          }
+        }
+      };
+
+    if (scan)
+    {
+      for (uint32_t y = y0; y < y1; y++)
+      {
+        for (uint32_t x = x0; x < x1; x++)
+        {
+          const size_t cell = x + static_cast<size_t>(y) * width_;
+          if (donors_[cell] == 0)
+          {
+            stack.push_back(static_cast<uint32_t>(cell));
+            drain();
+          }
+        }
+      }
+    }
+
+    for (const FlowStep& step : incoming)
+    {
+      accumulation_.At(step.cell % width_, step.cell / width_) += step.amount;
+      if (--donors_[step.cell] == 0)
+      {
+        stack.push_back(step.cell);
+        drain();
+      }
+    }
+    incoming.clear();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "heightfield.h"
+#include "../macros.h"
+
+class ThreadPool;
+
+namespace Erosion
+{
+  enum class FlowMethod
+  {
+    D8,     // all of a cell's water goes to its steepest downhill neighbor
+    DINF,   // water is split between the two neighbors around the steepest downhill direction (Tarboton 1997)
+  };
+
+  [[nodiscard]] const char* ToString(FlowMethod method);
+
+  struct FlowParams
+  {
+    FlowMethod method = FlowMethod::D8;
+    bool fillDepressions = true;    // pits are filled up to where they spill over, so water crosses them instead of stopping
+    uint32_t tileSize = 256;        // filling, flats and accumulation run tile by tile in parallel, then the tiles are merged
+  };
+
+  // neighbor offsets by direction code, counterclockwise from +x in steps of 45 degrees with y pointing down the map.
+  // The opposite of code k is (k + 4) % 8
+  inline constexpr int32_t flowOffsetX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+  inline constexpr int32_t flowOffsetY[8] = { 0, -1, -1, -1, 0, 1, 1, 1 };
+  inline constexpr uint8_t flowNone = 8;   // water leaves the map here, or stops in a pit if depressions are not filled
+
+  // drainage network of a heightmap: where water flows from every cell and how much passes through it
+  class FlowRouter
+  {
+  public:
+    FlowRouter(uint32_t width, uint32_t height, const FlowParams& params);
+
+    NOCOPY_NOMOVE(FlowRouter)
+
+    [[nodiscard]] const FlowParams& Params() const { return params_; }
+
+    void Compute(const Heightfield& map, ThreadPool& pool);
+
+    // the map with its depressions filled, or a copy of it if fillDepressions is off
+    [[nodiscard]] const Heightfield& Filled() const { return filled_; }
+
+    // direction code of every cell, row-major without padding. With DINF it is the first of two receivers
+    [[nodiscard]] const std::vector<uint8_t>& Directions() const { return directions_; }
+
+    // DINF only: the share of the water that goes to Directions(), the rest goes to the next direction counterclockwise
+    [[nodiscard]] const std::vector<float>& Shares() const { return shares_; }
+
+    // number of cells whose water passes through each cell, including itself. Rivers are where this is large
+    [[nodiscard]] const Heightfield& Accumulation() const { return accumulation_; }
+
+  private:
+    struct SpillEdge
+    {
+      uint32_t a;
+      uint32_t b;
+      float height;   // lowest level at which water crosses from watershed a to b
+    };
+
+    struct FlatStep
+    {
+      uint32_t cell;
+      uint32_t distance;  // steps from the cell to its flat's way out
+    };
+
+    struct FlowStep
+    {
+      uint32_t cell;
+      float amount;       // water passed on to the cell by a neighbor in another tile
+    };
+
+    void FillDepressions(ThreadPool& pool);
+    void FloodTile(uint32_t tile, std::vector<SpillEdge>& edges);
+    void LinkTile(uint32_t tile, std::vector<SpillEdge>& edges) const;
+    void ComputeDirections(ThreadPool& pool);
+    void ResolveFlats(ThreadPool& pool);
+    void SearchFlats(uint32_t tile, std::vector<FlatStep>& seeds, std::vector<FlatStep>& crossings);
+    void Accumulate(ThreadPool& pool);
+    void AccumulateTile(uint32_t tile, bool scan, std::vector<FlowStep>& incoming, std::vector<FlowStep>& outgoing);
+    [[nodiscard]] uint32_t TileOf(size_t cell) const;
+
+    uint32_t width_;
+    uint32_t height_;
+    FlowParams params_;
+    uint32_t tilesX_;
+    uint32_t tilesY_;
+
+    Heightfield filled_;
+    std::vector<uint32_t> labels_;      // watershed of every cell while filling, unique across tiles, then the flat distances
+    std::vector<uint8_t> directions_;
+    std::vector<float> shares_;
+    std::vector<uint8_t> donors_;       // neighbors draining into each cell
+    Heightfield accumulation_;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "grid.h"
+#include "grid_kernel.h"
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include "../utility/thread_pool.h"
+#include "../utility/cpu_features.h"
+
+namespace Erosion
+{
+  namespace detail
+  {
+    void FluxRowScalar(const FluxRowArgs& args, uint32_t x0, uint32_t x1)
+    {
+      const GridParams& params = *args.params;
+      const float dt = params.timeStep;
+      const float k = dt * params.pipeArea * params.gravity;
+      const float rain = dt * params.rainRate;
+      const uint32_t w = args.width;
+      const float* b = args.terrain;
+      const float* d = args.water;
+
+      for (uint32_t x = x0; x < x1; x++)
+      {
+        // neighbors beyond the border are the cell itself, which gives them no head difference and thus no flow
+        const uint32_t xl = x > 0 ? x - 1 : x;
+        const uint32_t xr = x + 1 < w ? x + 1 : x;
+        const float h = b[x] + d[x];
+        const float outL = std::max(0.0f, args.fluxL[x] + k * (h - b[xl] - d[xl]));
+        const float outR = std::max(0.0f, args.fluxR[x] + k * (h - b[xr] - d[xr]));
+        const float outT = std::max(0.0f, args.fluxT[x] + k * (h - args.terrainUp[x] - args.waterUp[x]));
+        const float outB = std::max(0.0f, args.fluxB[x] + k * (h - args.terrainDown[x] - args.waterDown[x]));
+
+        // never let more water leave than the cell holds
+        const float total = (outL + outR + outT + outB) * dt;
+        const float scale = std::min(1.0f, (d[x] + rain) / std::max(total, 1e-12f));
+        args.fluxL[x] = outL * scale;
+        args.fluxR[x] = outR * scale;
+        args.fluxT[x] = outT * scale;
+        args.fluxB[x] = outB * scale;
+      }
+    }
+
+    void ErodeRowScalar(const ErodeRowArgs& args, uint32_t x0, uint32_t x1)
+    {
+      const GridParams& params = *args.params;
+      const float dt = params.timeStep;
+      const float rain = dt * params.rainRate;
+      const float maxSpeed = 1 / dt;
+      const uint32_t w = args.width;
+      const float* b = args.terrain;
+      const float* fL = args.fluxL;
+      const float* fR = args.fluxR;
+      const float* fT = args.fluxT;
+      const float* fB = args.fluxB;
+
+      for (uint32_t x = x0; x < x1; x++)
+      {
+        // the flows coming from the left and right neighbors, zero beyond the border
+        const uint32_t xl = x > 0 ? x - 1 : x;
+        const uint32_t xr = x + 1 < w ? x + 1 : x;
+        const float inL = x > 0 ? fR[x - 1] : 0.0f;
+        const float inR = x + 1 < w ? fL[x + 1] : 0.0f;
+
+        const float out = fL[x] + fR[x] + fT[x] + fB[x];
+        const float in = inL + inR + args.inFromT[x] + args.inFromB[x];
+        const float d1 = args.water[x] + rain;
+        const float d2 = std::max(d1 + dt * (in - out), 0.0f);
+
+        // velocity from the net flow through the cell over the average water depth
+        const float depth = std::max((d1 + d2) * 0.5f, 1e-4f);
+        float u = (inL - fL[x] + fR[x] - inR) * 0.5f / depth;
+        float v = (args.inFromT[x] - fT[x] + fB[x] - args.inFromB[x]) * 0.5f / depth;
+
+        // thin films can report huge velocities; the sediment backtrace must not skip more than a cell per step
+        const float speed = std::sqrt(u * u + v * v);
+        const float speedScale = std::min(1.0f, maxSpeed / std::max(speed, 1e-12f));
+        u *= speedScale;
+        v *= speedScale;
+
+        // steeper and faster flow can hold more sediment
+        const float gx = (b[xr] - b[xl]) * 0.5f;
+        const float gy = (args.terrainDown[x] - args.terrainUp[x]) * 0.5f;
+        const float slope2 = gx * gx + gy * gy;
+        const float sinTilt = std::max(std::sqrt(slope2 / (1 + slope2)), params.minTilt);
+        const float depthScale = std::min(d2 / params.maxErosionDepth, 1.0f);
+        const float capacity = params.sedimentCapacity * sinTilt * speed * speedScale * depthScale;
+
+        const float excess = capacity - args.sediment[x];
+        const float rate = excess > 0 ? params.dissolveRate : params.depositRate;
+        const float change = dt * rate * excess;
+
+        args.terrainOut[x] = b[x] - change;
+        args.sediment[x] += change;
+        args.water[x] = d2;
+        args.velX[x] = u;
+        args.velY[x] = v;
+      }
+    }
+  }
+
+  namespace
+  {
+    // rows per task, small enough that a band of every field touched by a pass stays in L2
+    constexpr uint32_t bandRows = 16;
+  }
+
+  const char* ToString(GridBackend backend)
+  {
+    switch (backend)
+    {
+    case GridBackend::AUTO: return "auto";
+    case GridBackend::SCALAR: return "scalar";
+    case GridBackend::AVX2: return "avx2";
+    default: return "unknown";
+    }
+  }
+
+  GridEroder::GridEroder(uint32_t width, uint32_t height, const GridParams& params, GridBackend backend)
+    : width_(width), height_(height), pitch_(Heightfield::PitchFor(width)), params_(params)
+  {
+#ifdef EROSION_AVX2
+    const bool avx2 = HasAVX2();
+#else
+    const bool avx2 = false;
+#endif
+    backend_ = (backend == GridBackend::AUTO || backend == GridBackend::AVX2) && avx2 ? GridBackend::AVX2 : GridBackend::SCALAR;
+    fluxRow_ = detail::FluxRowScalar;
+    erodeRow_ = detail::ErodeRowScalar;
+#ifdef EROSION_AVX2
+    if (backend_ == GridBackend::AVX2)
+    {
+      fluxRow_ = detail::FluxRowAVX2;
+      erodeRow_ = detail::ErodeRowAVX2;
+    }
+#endif
+
+    const size_t size = static_cast<size_t>(pitch_) * height;
+    for (auto* field : { &water_, &sediment_, &fluxL_, &fluxR_, &fluxT_, &fluxB_, &velX_, &velY_, &terrainBack_, &sedimentBack_ })
+    {
+      field->resize(size, 0.0f);
+    }
+    zeroRow_.resize(pitch_, 0.0f);
+  }
+
+  void GridEroder::Reset()
+  {
+    for (auto* field : { &water_, &sediment_, &fluxL_, &fluxR_, &fluxT_, &fluxB_, &velX_, &velY_, &sedimentBack_ })
+    {
+      std::fill(field->begin(), field->end(), 0.0f);
+    }
+  }
+
+  void GridEroder::Step(Heightfield& map, ThreadPool& pool)
+  {
+    // the flux pass reads the neighbors' water and terrain, so both must be complete before water moves
+    ForEachBand(pool, height_, bandRows, [&](uint32_t y0, uint32_t y1) { UpdateFlux(map, y0, y1); });
+    ForEachBand(pool, height_, bandRows, [&](uint32_t y0, uint32_t y1) { UpdateWaterAndErode(map, y0, y1); });
+    std::swap(map.data, terrainBack_);
+    ForEachBand(pool, height_, bandRows, [&](uint32_t y0, uint32_t y1) { TransportSediment(y0, y1); });
+    std::swap(sediment_, sedimentBack_);
+  }
+
+  void GridEroder::UpdateFlux(const Heightfield& map, uint32_t y0, uint32_t y1)
+  {
+    for (uint32_t y = y0; y < y1; y++)
+    {
+      const size_t row = static_cast<size_t>(y) * pitch_;
+      const size_t up = y > 0 ? row - pitch_ : row;
+      const size_t down = y + 1 < height_ ? row + pitch_ : row;
+      const detail::FluxRowArgs args = {
+        .width = width_,
+        .params = &params_,
+        .terrain = map.data.data() + row,
+        .water = water_.data() + row,
+        .terrainUp = map.data.data() + up,
+        .waterUp = water_.data() + up,
+        .terrainDown = map.data.data() + down,
+        .waterDown = water_.data() + down,
+        .fluxL = fluxL_.data() + row,
+        .fluxR = fluxR_.data() + row,
+        .fluxT = fluxT_.data() + row,
+        .fluxB = fluxB_.data() + row,
+      };
+      fluxRow_(args, 0, width_);
+    }
+  }
+
+  void GridEroder::UpdateWaterAndErode(const Heightfield& map, uint32_t y0, uint32_t y1)
+  {
+    for (uint32_t y = y0; y < y1; y++)
+    {
+      const size_t row = static_cast<size_t>(y) * pitch_;
+      const size_t up = y > 0 ? row - pitch_ : row;
+      const size_t down = y + 1 < height_ ? row + pitch_ : row;
+      const detail::ErodeRowArgs args = {
+        .width = width_,
+        .params = &params_,
+        .terrain = map.data.data() + row,
+        .terrainUp = map.data.data() + up,
+        .terrainDown = map.data.data() + down,
+        .fluxL = fluxL_.data() + row,
+        .fluxR = fluxR_.data() + row,
+        .fluxT = fluxT_.data() + row,
+        .fluxB = fluxB_.data() + row,
+        .inFromT = y > 0 ? fluxB_.data() + up : zeroRow_.data(),
+        .inFromB = y + 1 < height_ ? fluxT_.data() + down : zeroRow_.data(),
+        .water = water_.data() + row,
+        .sediment = sediment_.data() + row,
+        .velX = velX_.data() + row,
+        .velY = velY_.data() + row,
+        .terrainOut = terrainBack_.data() + row,
+      };
+      erodeRow_(args, 0, width_);
+    }
+  }
+
+  void GridEroder::TransportSediment(uint32_t y0, uint32_t y1)
+  {
+    const float dt = params_.timeStep;
+    const float evaporation = std::max(1 - params_.evaporationRate * dt, 0.0f);
+    const uint32_t w = width_;
+    const uint32_t p = pitch_;
+    const float maxX = static_cast<float>(w - 1);
+    const float maxY = static_cast<float>(height_ - 1);
+
+    for (uint32_t y = y0; y < y1; y++)
+    {
+      const size_t row = static_cast<size_t>(y) * p;
+      for (uint32_t x = 0; x < w; x++)
+      {
+        // semi-Lagrangian: take the sediment from where the water came from
+        const float px = std::clamp(static_cast<float>(x) - velX_[row + x] * dt, 0.0f, maxX);
+        const float py = std::clamp(static_cast<float>(y) - velY_[row + x] * dt, 0.0f, maxY);
+        const uint32_t x0 = static_cast<uint32_t>(px);
+        const uint32_t y0s = static_cast<uint32_t>(py);
+        const uint32_t x1 = std::min(x0 + 1, w - 1);
+        const uint32_t y1s = std::min(y0s + 1, height_ - 1);
+        const float fx = px - static_cast<float>(x0);
+        const float fy = py - static_cast<float>(y0s);
+
+        const float* s0 = sediment_.data() + static_cast<size_t>(y0s) * p;
+        const float* s1 = sediment_.data() + static_cast<size_t>(y1s) * p;
+        sedimentBack_[row + x] = (s0[x0] * (1 - fx) + s0[x1] * fx) * (1 - fy) + (s1[x0] * (1 - fx) + s1[x1] * fx) * fy;
+        water_[row + x] *= evaporation;
+      }
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "heightfield.h"
+#include "../macros.h"
+
+class ThreadPool;
+
+namespace Erosion
+{
+  // shallow water on a grid of virtual pipes (Mei et al. 2007), cell size 1
+  struct GridParams
+  {
+    uint32_t stepsPerUpdate = 4;
+    float timeStep = 0.02f;
+    float rainRate = 0.01f;
+    float pipeArea = 1.0f;
+    float gravity = 9.81f;
+    float sedimentCapacity = 0.1f;
+    float dissolveRate = 0.5f;
+    float depositRate = 1.0f;
+    float evaporationRate = 0.02f;
+    float minTilt = 0.05f;          // keeps water on flat ground able to carry some sediment
+    float maxErosionDepth = 0.1f;   // water shallower than this carries proportionally less sediment
+  };
+
+  enum class GridBackend
+  {
+    AUTO,   // AVX2 if the CPU supports it, scalar otherwise
+    SCALAR,
+    AVX2,
+  };
+
+  [[nodiscard]] const char* ToString(GridBackend backend);
+
+  namespace detail
+  {
+    struct FluxRowArgs;
+    struct ErodeRowArgs;
+
+    // update cells [x0, x1) of one row of a pass
+    using FluxRowFn = void(*)(const FluxRowArgs& args, uint32_t x0, uint32_t x1);
+    using ErodeRowFn = void(*)(const ErodeRowArgs& args, uint32_t x0, uint32_t x1);
+  }
+
+  class GridEroder
+  {
+  public:
+    // an unavailable backend falls back to scalar. Every backend computes bit-identical results
+    GridEroder(uint32_t width, uint32_t height, const GridParams& params, GridBackend backend = GridBackend::AUTO);
+
+    NOCOPY_NOMOVE(GridEroder)
+
+    [[nodiscard]] const GridParams& Params() const { return params_; }
+    [[nodiscard]] GridBackend Backend() const { return backend_; }
+    [[nodiscard]] const FieldBuffer& Water() const { return water_; }
+    [[nodiscard]] const FieldBuffer& Sediment() const { return sediment_; }
+
+    // the fields that carry over from one step to the next: water, sediment and the four outflows, in that order.
+    // Velocity is recomputed every step
+    [[nodiscard]] std::array<FieldBuffer*, 6> State() { return { &water_, &sediment_, &fluxL_, &fluxR_, &fluxT_, &fluxB_ }; }
+
+    // removes all water and suspended sediment
+    void Reset();
+
+    // advances by one time step. The terrain is double buffered, so map.data is swapped with an internal buffer
+    void Step(Heightfield& map, ThreadPool& pool);
+
+  private:
+    // each pass only writes the cells of its own rows, so rows can be split across threads
+    void UpdateFlux(const Heightfield& map, uint32_t y0, uint32_t y1);
+    void UpdateWaterAndErode(const Heightfield& map, uint32_t y0, uint32_t y1);
+    void TransportSediment(uint32_t y0, uint32_t y1);
+
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t pitch_;    // every field uses the heightfield's row layout
+    GridParams params_;
+    GridBackend backend_;
+    detail::FluxRowFn fluxRow_;
+    detail::ErodeRowFn erodeRow_;
+
+    FieldBuffer water_;
+    FieldBuffer sediment_;
+    FieldBuffer fluxL_;  // outflow towards x - 1
+    FieldBuffer fluxR_;  // outflow towards x + 1
+    FieldBuffer fluxT_;  // outflow towards y - 1
+    FieldBuffer fluxB_;  // outflow towards y + 1
+    FieldBuffer velX_;
+    FieldBuffer velY_;
+
+    // back buffers of the ping-pong fields
+    FieldBuffer terrainBack_;
+    FieldBuffer sedimentBack_;
+
+    // stands in for the fluxes beyond the top and bottom edges
+    FieldBuffer zeroRow_;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+// only built with AVX2 code generation enabled, and only called after a runtime check
+#ifdef EROSION_AVX2
+#include "grid_kernel.h"
+#include <algorithm>
+#include <immintrin.h>
+
+// std::max(a, b) is a < b ? b : a, which is _mm256_max_ps(b, a) even for NaN, and std::min(a, b) is _mm256_min_ps(b, a),
+// so the operands below are swapped relative to the scalar kernel to keep the lanes bit-identical to it
+namespace Erosion::detail
+{
+  void FluxRowAVX2(const FluxRowArgs& args, uint32_t x0, uint32_t x1)
+  {
+    // the edge cells and whatever is left of the interior after the last full vector go through the scalar kernel
+    const uint32_t begin = std::max(x0, 1u);
+    const uint32_t end = std::min(x1, args.width > 0 ? args.width - 1 : 0);
+    if (begin >= end)
+    {
+      FluxRowScalar(args, x0, x1);
+      return;
+    }
+    FluxRowScalar(args, x0, begin);
+
+    const GridParams& params = *args.params;
+    const float dt = params.timeStep;
+    const __m256 vdt = _mm256_set1_ps(dt);
+    const __m256 k = _mm256_set1_ps(dt * params.pipeArea * params.gravity);
+    const __m256 rain = _mm256_set1_ps(dt * params.rainRate);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minTotal = _mm256_set1_ps(1e-12f);
+    const float* b = args.terrain;
+    const float* d = args.water;
+
+    uint32_t x = begin;
+    for (; x + 8 <= end; x += 8)
+    {
+      const __m256 dc = _mm256_loadu_ps(d + x);
+      const __m256 h = _mm256_add_ps(_mm256_loadu_ps(b + x), dc);
+      const auto out = [&](const float* flux, const float* nb, const float* nd)
+      {
+        const __m256 head = _mm256_sub_ps(_mm256_sub_ps(h, _mm256_loadu_ps(nb)), _mm256_loadu_ps(nd));
+        return _mm256_max_ps(_mm256_add_ps(_mm256_loadu_ps(flux + x), _mm256_mul_ps(k, head)), zero);
+      };
+      const __m256 outL = out(args.fluxL, b + x - 1, d + x - 1);
+      const __m256 outR = out(args.fluxR, b + x + 1, d + x + 1);
+      const __m256 outT = out(args.fluxT, args.terrainUp + x, args.waterUp + x);
+      const __m256 outB = out(args.fluxB, args.terrainDown + x, args.waterDown + x);
+
+      const __m256 total = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(outL, outR), outT), outB), vdt);
+      const __m256 scale = _mm256_min_ps(_mm256_div_ps(_mm256_add_ps(dc, rain), _mm256_max_ps(minTotal, total)), one);
+      _mm256_storeu_ps(args.fluxL + x, _mm256_mul_ps(outL, scale));
+      _mm256_storeu_ps(args.fluxR + x, _mm256_mul_ps(outR, scale));
+      _mm256_storeu_ps(args.fluxT + x, _mm256_mul_ps(outT, scale));
+      _mm256_storeu_ps(args.fluxB + x, _mm256_mul_ps(outB, scale));
+    }
+    FluxRowScalar(args, x, x1);
+  }
+
+  void ErodeRowAVX2(const ErodeRowArgs& args, uint32_t x0, uint32_t x1)
+  {
+    const uint32_t begin = std::max(x0, 1u);
+    const uint32_t end = std::min(x1, args.width > 0 ? args.width - 1 : 0);
+    if (begin >= end)
+    {
+      ErodeRowScalar(args, x0, x1);
+      return;
+    }
+    ErodeRowScalar(args, x0, begin);
+
+    const GridParams& params = *args.params;
+    const float dt = params.timeStep;
+    const __m256 vdt = _mm256_set1_ps(dt);
+    const __m256 rain = _mm256_set1_ps(dt * params.rainRate);
+    const __m256 maxSpeed = _mm256_set1_ps(1 / dt);
+    const __m256 minTilt = _mm256_set1_ps(params.minTilt);
+    const __m256 maxErosionDepth = _mm256_set1_ps(params.maxErosionDepth);
+    const __m256 sedimentCapacity = _mm256_set1_ps(params.sedimentCapacity);
+    const __m256 dissolveRate = _mm256_set1_ps(params.dissolveRate);
+    const __m256 depositRate = _mm256_set1_ps(params.depositRate);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minDepth = _mm256_set1_ps(1e-4f);
+    const __m256 minSpeed = _mm256_set1_ps(1e-12f);
+    const float* b = args.terrain;
+
+    uint32_t x = begin;
+    for (; x + 8 <= end; x += 8)
+    {
+      const __m256 fL = _mm256_loadu_ps(args.fluxL + x);
+      const __m256 fR = _mm256_loadu_ps(args.fluxR + x);
+      const __m256 fT = _mm256_loadu_ps(args.fluxT + x);
+      const __m256 fB = _mm256_loadu_ps(args.fluxB + x);
+      const __m256 inL = _mm256_loadu_ps(args.fluxR + x - 1);
+      const __m256 inR = _mm256_loadu_ps(args.fluxL + x + 1);
+      const __m256 inT = _mm256_loadu_ps(args.inFromT + x);
+      const __m256 inB = _mm256_loadu_ps(args.inFromB + x);
+
+      const __m256 out = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(fL, fR), fT), fB);
+      const __m256 in = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(inL, inR), inT), inB);
+      const __m256 d1 = _mm256_add_ps(_mm256_loadu_ps(args.water + x), rain);
+      const __m256 d2 = _mm256_max_ps(zero, _mm256_add_ps(d1, _mm256_mul_ps(vdt, _mm256_sub_ps(in, out))));
+
+      const __m256 depth = _mm256_max_ps(minDepth, _mm256_mul_ps(_mm256_add_ps(d1, d2), half));
+      __m256 u = _mm256_div_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_sub_ps(inL, fL), fR), inR), half), depth);
+      __m256 v = _mm256_div_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_sub_ps(inT, fT), fB), inB), half), depth);
+
+      const __m256 speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(u, u), _mm256_mul_ps(v, v)));
+      const __m256 speedScale = _mm256_min_ps(_mm256_div_ps(maxSpeed, _mm256_max_ps(minSpeed, speed)), one);
+      u = _mm256_mul_ps(u, speedScale);
+      v = _mm256_mul_ps(v, speedScale);
+
+      const __m256 bc = _mm256_loadu_ps(b + x);
+      const __m256 gx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(b + x + 1), _mm256_loadu_ps(b + x - 1)), half);
+      const __m256 gy = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(args.terrainDown + x), _mm256_loadu_ps(args.terrainUp + x)), half);
+      const __m256 slope2 = _mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gy, gy));
+      const __m256 sinTilt = _mm256_max_ps(minTilt, _mm256_sqrt_ps(_mm256_div_ps(slope2, _mm256_add_ps(one, slope2))));
+      const __m256 depthScale = _mm256_min_ps(one, _mm256_div_ps(d2, maxErosionDepth));
+      const __m256 capacity = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(sedimentCapacity, sinTilt), speed), speedScale), depthScale);
+
+      const __m256 s = _mm256_loadu_ps(args.sediment + x);
+      const __m256 excess = _mm256_sub_ps(capacity, s);
+      const __m256 rate = _mm256_blendv_ps(depositRate, dissolveRate, _mm256_cmp_ps(excess, zero, _CMP_GT_OQ));
+      const __m256 change = _mm256_mul_ps(_mm256_mul_ps(vdt, rate), excess);
+
+      _mm256_storeu_ps(args.terrainOut + x, _mm256_sub_ps(bc, change));
+      _mm256_storeu_ps(args.sediment + x, _mm256_add_ps(s, change));
+      _mm256_storeu_ps(args.water + x, d2);
+      _mm256_storeu_ps(args.velX + x, u);
+      _mm256_storeu_ps(args.velY + x, v);
+    }
+    ErodeRowScalar(args, x, x1);
+  }
+}
+#endif
\ No newline at end of file
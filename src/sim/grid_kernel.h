@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include "grid.h"
+
+// internal interface between GridEroder and its per-ISA row kernels
+namespace Erosion::detail
+{
+  // one row of the flux pass. The Up and Down rows are the ones above and below, which are the row itself at the
+  // map's edges, so the neighbors beyond them have no head difference and thus no flow
+  struct FluxRowArgs
+  {
+    uint32_t width{};
+    const GridParams* params{};
+    const float* terrain{};
+    const float* water{};
+    const float* terrainUp{};
+    const float* waterUp{};
+    const float* terrainDown{};
+    const float* waterDown{};
+    float* fluxL{};
+    float* fluxR{};
+    float* fluxT{};
+    float* fluxB{};
+  };
+
+  // one row of the water and erosion pass. inFromT and inFromB are the flows into the row from the rows above and
+  // below, zero beyond the map's edges
+  struct ErodeRowArgs
+  {
+    uint32_t width{};
+    const GridParams* params{};
+    const float* terrain{};
+    const float* terrainUp{};
+    const float* terrainDown{};
+    const float* fluxL{};
+    const float* fluxR{};
+    const float* fluxT{};
+    const float* fluxB{};
+    const float* inFromT{};
+    const float* inFromB{};
+    float* water{};
+    float* sediment{};
+    float* velX{};
+    float* velY{};
+    float* terrainOut{};
+  };
+
+  // update cells [x0, x1) of a row. Every kernel computes bit-identical results
+  void FluxRowScalar(const FluxRowArgs& args, uint32_t x0, uint32_t x1);
+  void ErodeRowScalar(const ErodeRowArgs& args, uint32_t x0, uint32_t x1);
+#ifdef EROSION_AVX2
+  void FluxRowAVX2(const FluxRowArgs& args, uint32_t x0, uint32_t x1);
+  void ErodeRowAVX2(const ErodeRowArgs& args, uint32_t x0, uint32_t x1);
+#endif
+}
\ No newline at end of file
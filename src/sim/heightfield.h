@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+namespace Erosion
+{
+  // allocator for vectors whose storage must start on an Alignment-byte boundary
+  template<typename T, size_t Alignment>
+  struct AlignedAllocator
+  {
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment))); }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(Alignment)); }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+  };
+
+  // every row of a field starts on a cache line, so it can be processed with aligned vector loads
+  using FieldBuffer = std::vector<float, AlignedAllocator<float, 64>>;
+
+  // cells [x0, x1) x [y0, y1) that changed since the rect was last cleared
+  struct DirtyRect
+  {
+    uint32_t x0{};
+    uint32_t y0{};
+    uint32_t x1{};
+    uint32_t y1{};
+
+    [[nodiscard]] bool Empty() const { return x0 >= x1 || y0 >= y1; }
+
+    void Add(const DirtyRect& other)
+    {
+      if (other.Empty())
+      {
+        return;
+      }
+      if (Empty())
+      {
+        *this = other;
+        return;
+      }
+      x0 = std::min(x0, other.x0);
+      y0 = std::min(y0, other.y0);
+      x1 = std::max(x1, other.x1);
+      y1 = std::max(y1, other.y1);
+    }
+  };
+
+  // CPU-side height data, stored row-major with rows pitch floats apart. The cells past width are padding and stay zero
+  struct Heightfield
+  {
+    // rows are padded to a whole number of cache lines
+    static constexpr uint32_t PitchFor(uint32_t width) { return (width + 15) & ~15u; }
+
+    Heightfield() = default;
+    Heightfield(uint32_t w, uint32_t h)
+      : width(w), height(h), pitch(PitchFor(w)), data(static_cast<size_t>(pitch) * h) {}
+
+    float* Row(uint32_t y) { return data.data() + static_cast<size_t>(y) * pitch; }
+    const float* Row(uint32_t y) const { return data.data() + static_cast<size_t>(y) * pitch; }
+
+    float& At(uint32_t x, uint32_t y) { return data[x + static_cast<size_t>(y) * pitch]; }
+    float At(uint32_t x, uint32_t y) const { return data[x + static_cast<size_t>(y) * pitch]; }
+
+    [[nodiscard]] DirtyRect Bounds() const { return { 0, 0, width, height }; }
+
+    uint32_t width{};
+    uint32_t height{};
+    uint32_t pitch{};
+    FieldBuffer data;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "multires.h"
+#include <algorithm>
+#include <cmath>
+#include "../utility/thread_pool.h"
+
+namespace Erosion
+{
+  namespace
+  {
+    constexpr uint32_t bandRows = 16;
+  }
+
+  void Downsample(const Heightfield& fine, uint32_t factor, Heightfield& coarse, ThreadPool& pool)
+  {
+    const uint32_t width = (fine.width + factor - 1) / factor;
+    const uint32_t height = (fine.height + factor - 1) / factor;
+    if (coarse.width != width || coarse.height != height)
+    {
+      coarse = Heightfield(width, height);
+    }
+
+    ForEachBand(pool, height, bandRows, [&](uint32_t y0, uint32_t y1)
+      {
+        for (uint32_t cy = y0; cy < y1; cy++)
+        {
+          // blocks at the right and bottom edges may be cut short by the map
+          const uint32_t fy0 = cy * factor;
+          const uint32_t fy1 = std::min(fy0 + factor, fine.height);
+          float* out = coarse.Row(cy);
+          std::fill_n(out, width, 0.0f);
+          for (uint32_t fy = fy0; fy < fy1; fy++)
+          {
+            const float* row = fine.Row(fy);
+            for (uint32_t fx = 0; fx < fine.width; fx++)
+            {
+              out[fx / factor] += row[fx];
+            }
+          }
+          for (uint32_t cx = 0; cx < width; cx++)
+          {
+            const uint32_t columns = std::min(cx * factor + factor, fine.width) - cx * factor;
+            out[cx] /= static_cast<float>(columns * (fy1 - fy0));
+          }
+        }
+      });
+  }
+
+  void AddUpsampled(const Heightfield& coarse, uint32_t factor, Heightfield& fine, ThreadPool& pool)
+  {
+    // fine cell centers in coarse cell coordinates, clamped so the edges hold the value of the outermost coarse cells
+    const float scale = 1.0f / static_cast<float>(factor);
+    const float offset = 0.5f * scale - 0.5f;
+    auto sample = [&](uint32_t i, uint32_t size, uint32_t& i0, uint32_t& i1, float& t)
+    {
+      const float c = std::clamp(static_cast<float>(i) * scale + offset, 0.0f, static_cast<float>(size - 1));
+      i0 = static_cast<uint32_t>(c);
+      i1 = std::min(i0 + 1, size - 1);
+      t = c - static_cast<float>(i0);
+    };
+
+    ForEachBand(pool, fine.height, bandRows, [&](uint32_t y0, uint32_t y1)
+      {
+        for (uint32_t y = y0; y < y1; y++)
+        {
+          uint32_t cy0, cy1;
+          float v;
+          sample(y, coarse.height, cy0, cy1, v);
+          const float* top = coarse.Row(cy0);
+          const float* bottom = coarse.Row(cy1);
+          float* row = fine.Row(y);
+          for (uint32_t x = 0; x < fine.width; x++)
+          {
+            uint32_t cx0, cx1;
+            float u;
+            sample(x, coarse.width, cx0, cx1, u);
+            const float upper = top[cx0] + (top[cx1] - top[cx0]) * u;
+            const float lower = bottom[cx0] + (bottom[cx1] - bottom[cx0]) * u;
+            row[x] += upper + (lower - upper) * v;
+          }
+        }
+      });
+  }
+}
\ No newline at end of file
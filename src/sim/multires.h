@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include "heightfield.h"
+
+class ThreadPool;
+
+namespace Erosion
+{
+  // erodes a downsampled copy of the map first, so the large features are carved where a cell covers more ground
+  // and the finer levels only have to add detail
+  struct MultiresParams
+  {
+    uint32_t levels = 1;              // each level halves the resolution, 1 runs at full resolution only
+    uint32_t updatesPerLevel = 100;   // updates spent on each level coarser than full resolution
+    uint32_t syncInterval = 0;        // updates between adding a coarse level's progress to the map, 0 only when the level ends
+  };
+
+  // coarse is (fine.width / factor) x (fine.height / factor) rounded up, each cell the mean of the fine cells it covers
+  void Downsample(const Heightfield& fine, uint32_t factor, Heightfield& coarse, ThreadPool& pool);
+
+  // adds the bilinearly upsampled coarse field to fine. Upsampling only the change a coarse level made, instead of its
+  // heights, keeps the detail the fine map had
+  void AddUpsampled(const Heightfield& coarse, uint32_t factor, Heightfield& fine, ThreadPool& pool);
+}
\ No newline at end of file
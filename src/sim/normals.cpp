@@ -0,0 +1,103 @@
+#include "normals.h"
+#include "normals_kernel.h"
+#include <cmath>
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include "../utility/thread_pool.h"
+#include "../utility/cpu_features.h"
+
+namespace Erosion
+{
+  namespace detail
+  {
+    void SobelRowScalar(const float* up, const float* mid, const float* down, float yScale, uint32_t width, uint32_t x0, uint32_t x1, float* out)
+    {
+      for (uint32_t x = x0; x < x1; x++)
+      {
+        const uint32_t l = x > 0 ? x - 1 : 0;
+        const uint32_t r = x + 1 < width ? x + 1 : x;
+
+        // the filter spans two cells, or one at the edges
+        const float xScale = r - l == 2 ? 0.125f : 0.25f;
+        const float right = (up[r] + 2.0f * mid[r]) + down[r];
+        const float left = (up[l] + 2.0f * mid[l]) + down[l];
+        const float below = (down[l] + 2.0f * down[x]) + down[r];
+        const float above = (up[l] + 2.0f * up[x]) + up[r];
+        out[2 * x] = (right - left) * xScale;
+        out[2 * x + 1] = (below - above) * yScale;
+      }
+    }
+  }
+
+  NormalMap::NormalMap(uint32_t width, uint32_t height)
+    : width(width), height(height), pitch(Heightfield::PitchFor(width)), data(static_cast<size_t>(pitch) * height * 2)
+  {
+  }
+
+  void NormalMap::Update(const Heightfield& map, const DirtyTiles& dirty, ThreadPool& pool)
+  {
+    dirty.ForEachRect([&](const DirtyRect& rect) { Update(map, rect, pool); });
+  }
+
+  void NormalMap::Update(const Heightfield& map, const DirtyRect& rect, ThreadPool& pool)
+  {
+    if (map.width != width || map.height != height)
+    {
+      throw std::runtime_error(std::format("normal map is for a {}x{} map, not {}x{}", width, height, map.width, map.height));
+    }
+
+    const DirtyRect cells = Affected(rect);
+    if (cells.Empty())
+    {
+      return;
+    }
+
+#ifdef EROSION_AVX2
+    const auto row = HasAVX2() ? detail::SobelRowAVX2 : detail::SobelRowScalar;
+#else
+    const auto row = detail::SobelRowScalar;
+#endif
+
+    constexpr uint32_t bandRows = 16;
+    const uint32_t numBands = (cells.y1 - cells.y0 + bandRows - 1) / bandRows;
+    pool.ParallelFor(numBands, [&](uint32_t band)
+      {
+        const uint32_t y0 = cells.y0 + band * bandRows;
+        for (uint32_t y = y0; y < std::min(y0 + bandRows, cells.y1); y++)
+        {
+          const uint32_t up = y > 0 ? y - 1 : 0;
+          const uint32_t down = y + 1 < height ? y + 1 : y;
+          const float yScale = down - up == 2 ? 0.125f : 0.25f;
+          row(map.Row(up), map.Row(y), map.Row(down), yScale, width, cells.x0, cells.x1, data.data() + static_cast<size_t>(y) * pitch * 2);
+        }
+      });
+  }
+
+  DirtyRect NormalMap::Affected(const DirtyRect& rect) const
+  {
+    if (rect.Empty())
+    {
+      return {};
+    }
+    return {
+      rect.x0 > 0 ? rect.x0 - 1 : 0,
+      rect.y0 > 0 ? rect.y0 - 1 : 0,
+      std::min(rect.x1 + 1, width),
+      std::min(rect.y1 + 1, height),
+    };
+  }
+
+  glm::vec3 NormalMap::Normal(uint32_t x, uint32_t y, float cellSize) const
+  {
+    const glm::vec2 g = Gradient(x, y) / cellSize;
+    const float invLength = 1.0f / std::sqrt(g.x * g.x + g.y * g.y + 1.0f);
+    return { -g.x * invLength, invLength, -g.y * invLength };
+  }
+
+  float NormalMap::Slope(uint32_t x, uint32_t y, float cellSize) const
+  {
+    const glm::vec2 g = Gradient(x, y);
+    return std::sqrt(g.x * g.x + g.y * g.y) / cellSize;
+  }
+}
\ No newline at end of file
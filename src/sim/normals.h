@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include "heightfield.h"
+#include "dirty_tiles.h"
+
+class ThreadPool;
+
+namespace Erosion
+{
+  // surface gradient of a heightfield from a 3x3 Sobel filter, for shading and slope queries. Every cell holds
+  // (dh/dx, dh/dy) in heights per cell, interleaved, with rows pitch cells apart like the heightfield's.
+  // The map's edges are extended, and the gradient there is a one-sided difference
+  class NormalMap
+  {
+  public:
+    NormalMap() = default;
+    NormalMap(uint32_t width, uint32_t height);
+
+    // recomputes the gradients that depend on the dirty tiles
+    void Update(const Heightfield& map, const DirtyTiles& dirty, ThreadPool& pool);
+
+    // recomputes the gradients that depend on the cells in rect, which are those in Affected(rect)
+    void Update(const Heightfield& map, const DirtyRect& rect, ThreadPool& pool);
+
+    // cells whose gradient reads any cell of rect
+    [[nodiscard]] DirtyRect Affected(const DirtyRect& rect) const;
+
+    const float* Row(uint32_t y) const { return data.data() + static_cast<size_t>(y) * pitch * 2; }
+
+    [[nodiscard]] glm::vec2 Gradient(uint32_t x, uint32_t y) const
+    {
+      const float* cell = Row(y) + 2 * x;
+      return { cell[0], cell[1] };
+    }
+
+    // unit normal with y up, for cells cellSize apart in height units
+    [[nodiscard]] glm::vec3 Normal(uint32_t x, uint32_t y, float cellSize = 1.0f) const;
+
+    // rise over run, for cells cellSize apart in height units
+    [[nodiscard]] float Slope(uint32_t x, uint32_t y, float cellSize = 1.0f) const;
+
+    uint32_t width{};
+    uint32_t height{};
+    uint32_t pitch{};
+    FieldBuffer data;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+// only built with AVX2 code generation enabled, and only called after a runtime check
+#ifdef EROSION_AVX2
+#include "normals_kernel.h"
+#include <algorithm>
+#include <immintrin.h>
+
+namespace Erosion::detail
+{
+  void SobelRowAVX2(const float* up, const float* mid, const float* down, float yScale, uint32_t width, uint32_t x0, uint32_t x1, float* out)
+  {
+    // the edge cells and whatever is left of the interior after the last full vector go through the scalar kernel
+    const uint32_t begin = std::max(x0, 1u);
+    const uint32_t end = std::min(x1, width > 0 ? width - 1 : 0);
+    if (begin >= end)
+    {
+      SobelRowScalar(up, mid, down, yScale, width, x0, x1, out);
+      return;
+    }
+    SobelRowScalar(up, mid, down, yScale, width, x0, begin, out);
+
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 xs = _mm256_set1_ps(0.125f);
+    const __m256 ys = _mm256_set1_ps(yScale);
+    uint32_t x = begin;
+    for (; x + 8 <= end; x += 8)
+    {
+      const __m256 upL = _mm256_loadu_ps(up + x - 1);
+      const __m256 upC = _mm256_loadu_ps(up + x);
+      const __m256 upR = _mm256_loadu_ps(up + x + 1);
+      const __m256 downL = _mm256_loadu_ps(down + x - 1);
+      const __m256 downC = _mm256_loadu_ps(down + x);
+      const __m256 downR = _mm256_loadu_ps(down + x + 1);
+
+      const __m256 right = _mm256_add_ps(_mm256_add_ps(upR, _mm256_mul_ps(two, _mm256_loadu_ps(mid + x + 1))), downR);
+      const __m256 left = _mm256_add_ps(_mm256_add_ps(upL, _mm256_mul_ps(two, _mm256_loadu_ps(mid + x - 1))), downL);
+      const __m256 below = _mm256_add_ps(_mm256_add_ps(downL, _mm256_mul_ps(two, downC)), downR);
+      const __m256 above = _mm256_add_ps(_mm256_add_ps(upL, _mm256_mul_ps(two, upC)), upR);
+      const __m256 gx = _mm256_mul_ps(_mm256_sub_ps(right, left), xs);
+      const __m256 gy = _mm256_mul_ps(_mm256_sub_ps(below, above), ys);
+
+      // unpack interleaves within 128-bit lanes: lo = cells 0 1 | 4 5, hi = cells 2 3 | 6 7
+      const __m256 lo = _mm256_unpacklo_ps(gx, gy);
+      const __m256 hi = _mm256_unpackhi_ps(gx, gy);
+      _mm256_storeu_ps(out + 2 * x, _mm256_permute2f128_ps(lo, hi, 0x20));
+      _mm256_storeu_ps(out + 2 * x + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    SobelRowScalar(up, mid, down, yScale, width, x, x1, out);
+  }
+}
+#endif
\ No newline at end of file
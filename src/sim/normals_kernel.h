@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+
+// internal interface between NormalMap and its per-ISA row kernels
+namespace Erosion::detail
+{
+  // writes the gradients of cells [x0, x1) of a row of width cells to out, two floats per cell. up and down are the
+  // rows above and below it, which are the row itself at the map's edges, and yScale is one over the distance between
+  // them times the filter's weight. Every kernel computes bit-identical results
+  void SobelRowScalar(const float* up, const float* mid, const float* down, float yScale, uint32_t width, uint32_t x0, uint32_t x1, float* out);
+#ifdef EROSION_AVX2
+  void SobelRowAVX2(const float* up, const float* mid, const float* down, float yScale, uint32_t width, uint32_t x0, uint32_t x1, float* out);
+#endif
+}
\ No newline at end of file
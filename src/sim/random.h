@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+
+namespace Erosion
+{
+  // Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3"): a keyed bijection of a
+  // 128-bit counter. Any counter can be evaluated directly, so threads and SIMD lanes need no shared state
+  struct Philox4x32
+  {
+    uint32_t v[4];
+
+    static constexpr Philox4x32 Generate(Philox4x32 counter, uint64_t key)
+    {
+      uint32_t k0 = static_cast<uint32_t>(key);
+      uint32_t k1 = static_cast<uint32_t>(key >> 32);
+      uint32_t* c = counter.v;
+      for (int round = 0; round < 10; round++)
+      {
+        const uint64_t p0 = uint64_t(0xD2511F53) * c[0];
+        const uint64_t p1 = uint64_t(0xCD9E8D57) * c[2];
+        counter = { {
+          static_cast<uint32_t>(p1 >> 32) ^ c[1] ^ k0,
+          static_cast<uint32_t>(p1),
+          static_cast<uint32_t>(p0 >> 32) ^ c[3] ^ k1,
+          static_cast<uint32_t>(p0),
+        } };
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+      }
+      return counter;
+    }
+  };
+
+  // stream of random numbers identified by (seed, iteration, index). Two streams that differ in any of them are
+  // independent, and a stream is the same no matter which thread draws it or in what order
+  class CounterRng
+  {
+  public:
+    constexpr CounterRng(uint64_t seed, uint64_t iteration, uint32_t index)
+      : key_(seed), counter_{ { index, 0, static_cast<uint32_t>(iteration), static_cast<uint32_t>(iteration >> 32) } } {}
+
+    constexpr uint32_t NextU32()
+    {
+      if (used_ == 4)
+      {
+        block_ = Philox4x32::Generate(counter_, key_);
+        counter_.v[1]++;
+        used_ = 0;
+      }
+      return block_.v[used_++];
+    }
+
+    // uniform in [0, 1), with all 24 bits of the mantissa random
+    constexpr float NextFloat()
+    {
+      return static_cast<float>(NextU32() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // uniform in [lo, hi)
+    constexpr float NextFloat(float lo, float hi)
+    {
+      return lo + (hi - lo) * NextFloat();
+    }
+
+  private:
+    uint64_t key_;
+    Philox4x32 counter_;
+    Philox4x32 block_{};
+    uint32_t used_ = 4;
+  };
+}
\ No newline at end of file
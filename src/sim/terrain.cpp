@@ -0,0 +1,188 @@
+#include "terrain.h"
+#include "terrain_kernel.h"
+#include "random.h"
+#include <cmath>
+#include <algorithm>
+#include "../utility/thread_pool.h"
+#include "../utility/cpu_features.h"
+
+namespace Erosion
+{
+  namespace detail
+  {
+    namespace
+    {
+      uint32_t Hash(int32_t ix, int32_t iy, uint32_t seed)
+      {
+        uint32_t h = (static_cast<uint32_t>(ix) * hashX) ^ (static_cast<uint32_t>(iy) * hashY) ^ seed;
+        h ^= h >> 15;
+        h *= hashMix1;
+        h ^= h >> 12;
+        h *= hashMix2;
+        h ^= h >> 15;
+        return h;
+      }
+
+      float Gradient(uint32_t hash, float dx, float dy)
+      {
+        return gradientX[hash & 7] * dx + gradientY[hash & 7] * dy;
+      }
+
+      float Fade(float t)
+      {
+        return t * t * t * (t * (t * 6 - 15) + 10);
+      }
+
+      // 2D gradient noise, roughly in [-0.7, 0.7]
+      float Perlin(float x, float y, uint32_t seed)
+      {
+        const float fx = std::floor(x);
+        const float fy = std::floor(y);
+        const int32_t ix = static_cast<int32_t>(fx);
+        const int32_t iy = static_cast<int32_t>(fy);
+        const float tx = x - fx;
+        const float ty = y - fy;
+
+        const float n00 = Gradient(Hash(ix, iy, seed), tx, ty);
+        const float n10 = Gradient(Hash(ix + 1, iy, seed), tx - 1, ty);
+        const float n01 = Gradient(Hash(ix, iy + 1, seed), tx, ty - 1);
+        const float n11 = Gradient(Hash(ix + 1, iy + 1, seed), tx - 1, ty - 1);
+
+        const float u = Fade(tx);
+        const float v = Fade(ty);
+        const float nx0 = n00 + u * (n10 - n00);
+        const float nx1 = n01 + u * (n11 - n01);
+        return nx0 + v * (nx1 - nx0);
+      }
+
+      float Fbm(float x, float y, const NoiseOctaves& octaves, bool ridged)
+      {
+        float sum = 0;
+        float amplitude = 1;
+        for (uint32_t o = 0; o < octaves.count; o++)
+        {
+          float n = Perlin(x, y, octaves.seeds[o]);
+          if (ridged)
+          {
+            n = 1 - std::abs(n);
+            n = n * n;
+          }
+          sum += amplitude * n;
+          x *= octaves.lacunarity;
+          y *= octaves.lacunarity;
+          amplitude *= octaves.gain;
+        }
+        return sum * octaves.invNorm;
+      }
+    }
+
+    void TerrainRowScalar(const TerrainKernelArgs& args, float* row, uint32_t y)
+    {
+      const float py0 = static_cast<float>(y) * args.scale;
+      for (uint32_t x = 0; x < args.width; x++)
+      {
+        float px = static_cast<float>(x + args.originX) * args.scale;
+        float py = py0;
+        if (args.warpScale != 0)
+        {
+          const float wx = px * args.warpRatio;
+          const float wy = py * args.warpRatio;
+          const float dx = Fbm(wx, wy, args.warpX, false);
+          const float dy = Fbm(wx + args.warpOffsetX, wy + args.warpOffsetY, args.warpY, false);
+          px = px + args.warpScale * dx;
+          py = py + args.warpScale * dy;
+        }
+        row[x] = args.height * Fbm(px, py, args.octaves, args.ridged);
+      }
+    }
+  }
+
+  const char* ToString(TerrainShape shape)
+  {
+    switch (shape)
+    {
+    case TerrainShape::RADIAL: return "radial";
+    case TerrainShape::FBM: return "fbm";
+    case TerrainShape::RIDGED: return "ridged";
+    default: return "unknown";
+    }
+  }
+
+  namespace
+  {
+    constexpr uint32_t bandRows = 16;
+
+    // octave seeds come from their own stream of the simulation seed, so they never repeat a droplet's numbers
+    constexpr uint64_t terrainIteration = ~0ull;
+
+    detail::NoiseOctaves MakeOctaves(uint32_t count, float lacunarity, float gain, CounterRng& rng)
+    {
+      detail::NoiseOctaves octaves{ .count = std::min(count, TerrainParams::maxOctaves), .lacunarity = lacunarity, .gain = gain };
+      float norm = 0;
+      float amplitude = 1;
+      for (uint32_t o = 0; o < octaves.count; o++)
+      {
+        octaves.seeds[o] = rng.NextU32();
+        norm += amplitude;
+        amplitude *= gain;
+      }
+      octaves.invNorm = norm > 0 ? 1 / norm : 0;
+      return octaves;
+    }
+  }
+
+  void GenerateTerrain(Heightfield& map, const TerrainParams& params, uint64_t seed, ThreadPool& pool)
+  {
+    GenerateTerrain(map, params, seed, pool, { .worldWidth = map.width, .worldHeight = map.height });
+  }
+
+  void GenerateTerrain(Heightfield& map, const TerrainParams& params, uint64_t seed, ThreadPool& pool, const TerrainRegion& region)
+  {
+    if (params.shape == TerrainShape::RADIAL)
+    {
+      for (uint32_t y = 0; y < map.height; y++)
+      {
+        for (uint32_t x = 0; x < map.width; x++)
+        {
+          const float dx = static_cast<float>(x + region.x0) - static_cast<float>(region.worldWidth) / 2;
+          const float dy = static_cast<float>(y + region.y0) - static_cast<float>(region.worldHeight) / 2;
+          map.At(x, y) = params.height * std::sqrt(dx * dx + dy * dy) / 100;
+        }
+      }
+      return;
+    }
+
+    CounterRng rng(seed, terrainIteration, 0);
+    const float frequency = std::max(params.frequency, 1e-6f);
+    detail::TerrainKernelArgs args
+    {
+      .width = map.width,
+      .originX = region.x0,
+      .ridged = params.shape == TerrainShape::RIDGED,
+      .scale = frequency / static_cast<float>(std::max(region.worldWidth, 1u)),
+      .height = params.height,
+      .octaves = MakeOctaves(params.octaves, params.lacunarity, params.gain, rng),
+      .warpScale = params.warp * frequency,
+      .warpRatio = params.warpFrequency / frequency,
+      .warpOffsetX = 5.2f,
+      .warpOffsetY = 1.3f,
+    };
+    args.warpX = MakeOctaves(params.warpOctaves, params.lacunarity, params.gain, rng);
+    args.warpY = MakeOctaves(params.warpOctaves, params.lacunarity, params.gain, rng);
+
+#ifdef EROSION_AVX2
+    const auto row = HasAVX2() ? detail::TerrainRowAVX2 : detail::TerrainRowScalar;
+#else
+    const auto row = detail::TerrainRowScalar;
+#endif
+
+    const uint32_t numBands = (map.height + bandRows - 1) / bandRows;
+    pool.ParallelFor(numBands, [&](uint32_t band)
+      {
+        for (uint32_t y = band * bandRows; y < std::min(band * bandRows + bandRows, map.height); y++)
+        {
+          row(args, map.Row(y), y + region.y0);
+        }
+      });
+  }
+}
\ No newline at end of file
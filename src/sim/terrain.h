@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include "heightfield.h"
+
+class ThreadPool;
+
+namespace Erosion
+{
+  enum class TerrainShape
+  {
+    RADIAL,   // cone around the center of the map
+    FBM,      // sum of gradient noise octaves
+    RIDGED,   // octaves folded at zero, which gives sharp crests
+  };
+
+  [[nodiscard]] const char* ToString(TerrainShape shape);
+
+  struct TerrainParams
+  {
+    TerrainShape shape = TerrainShape::FBM;
+    uint32_t octaves = 6;           // at most maxOctaves
+    float frequency = 4.0f;         // features of the first octave across the width of the map
+    float lacunarity = 2.0f;        // frequency multiplier between octaves
+    float gain = 0.5f;              // amplitude multiplier between octaves
+    float height = 1.0f;
+    float warp = 0.0f;              // how far the noise is displaced, in map widths. 0 disables domain warping
+    float warpFrequency = 2.0f;
+    uint32_t warpOctaves = 3;
+
+    static constexpr uint32_t maxOctaves = 16;
+  };
+
+  // part of a larger map that is generated on its own, so the result matches generating the whole map at once
+  struct TerrainRegion
+  {
+    uint32_t x0{};
+    uint32_t y0{};
+    uint32_t worldWidth{};
+    uint32_t worldHeight{};
+  };
+
+  // fills map with terrain determined by params and seed, splitting the rows across the pool
+  void GenerateTerrain(Heightfield& map, const TerrainParams& params, uint64_t seed, ThreadPool& pool);
+  void GenerateTerrain(Heightfield& map, const TerrainParams& params, uint64_t seed, ThreadPool& pool, const TerrainRegion& region);
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+// only built with AVX2 code generation enabled, and only called after a runtime check
+#ifdef EROSION_AVX2
+#include "terrain_kernel.h"
+#include <immintrin.h>
+
+namespace Erosion::detail
+{
+  namespace
+  {
+    __m256i Hash(__m256i ix, __m256i iy, __m256i seed)
+    {
+      __m256i h = _mm256_xor_si256(
+        _mm256_xor_si256(_mm256_mullo_epi32(ix, _mm256_set1_epi32(static_cast<int>(hashX))), _mm256_mullo_epi32(iy, _mm256_set1_epi32(static_cast<int>(hashY)))),
+        seed);
+      h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+      h = _mm256_mullo_epi32(h, _mm256_set1_epi32(static_cast<int>(hashMix1)));
+      h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 12));
+      h = _mm256_mullo_epi32(h, _mm256_set1_epi32(static_cast<int>(hashMix2)));
+      h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+      return h;
+    }
+
+    // the permute only looks at the low three bits of the hash, like the table lookup of the scalar kernel
+    __m256 Gradient(__m256i hash, __m256 dx, __m256 dy)
+    {
+      const __m256 gx = _mm256_permutevar8x32_ps(_mm256_loadu_ps(gradientX), hash);
+      const __m256 gy = _mm256_permutevar8x32_ps(_mm256_loadu_ps(gradientY), hash);
+      return _mm256_add_ps(_mm256_mul_ps(gx, dx), _mm256_mul_ps(gy, dy));
+    }
+
+    __m256 Fade(__m256 t)
+    {
+      const __m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6)), _mm256_set1_ps(15))), _mm256_set1_ps(10));
+      return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+    }
+
+    __m256 Lerp(__m256 a, __m256 b, __m256 t)
+    {
+      return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+    }
+
+    __m256 Perlin(__m256 x, __m256 y, __m256i seed)
+    {
+      const __m256 one = _mm256_set1_ps(1.0f);
+      const __m256i oneI = _mm256_set1_epi32(1);
+      const __m256 fx = _mm256_floor_ps(x);
+      const __m256 fy = _mm256_floor_ps(y);
+      const __m256i ix = _mm256_cvttps_epi32(fx);
+      const __m256i iy = _mm256_cvttps_epi32(fy);
+      const __m256i ix1 = _mm256_add_epi32(ix, oneI);
+      const __m256i iy1 = _mm256_add_epi32(iy, oneI);
+      const __m256 tx = _mm256_sub_ps(x, fx);
+      const __m256 ty = _mm256_sub_ps(y, fy);
+      const __m256 tx1 = _mm256_sub_ps(tx, one);
+      const __m256 ty1 = _mm256_sub_ps(ty, one);
+
+      const __m256 n00 = Gradient(Hash(ix, iy, seed), tx, ty);
+      const __m256 n10 = Gradient(Hash(ix1, iy, seed), tx1, ty);
+      const __m256 n01 = Gradient(Hash(ix, iy1, seed), tx, ty1);
+      const __m256 n11 = Gradient(Hash(ix1, iy1, seed), tx1, ty1);
+
+      const __m256 u = Fade(tx);
+      const __m256 v = Fade(ty);
+      return Lerp(Lerp(n00, n10, u), Lerp(n01, n11, u), v);
+    }
+
+    __m256 Fbm(__m256 x, __m256 y, const NoiseOctaves& octaves, bool ridged)
+    {
+      const __m256 lacunarity = _mm256_set1_ps(octaves.lacunarity);
+      __m256 sum = _mm256_setzero_ps();
+      float amplitude = 1;
+      for (uint32_t o = 0; o < octaves.count; o++)
+      {
+        __m256 n = Perlin(x, y, _mm256_set1_epi32(static_cast<int>(octaves.seeds[o])));
+        if (ridged)
+        {
+          n = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_andnot_ps(_mm256_set1_ps(-0.0f), n));
+          n = _mm256_mul_ps(n, n);
+        }
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(amplitude), n));
+        x = _mm256_mul_ps(x, lacunarity);
+        y = _mm256_mul_ps(y, lacunarity);
+        amplitude *= octaves.gain;
+      }
+      return _mm256_mul_ps(sum, _mm256_set1_ps(octaves.invNorm));
+    }
+  }
+
+  void TerrainRowAVX2(const TerrainKernelArgs& args, float* row, uint32_t y)
+  {
+    constexpr uint32_t lanes = 8;
+    const __m256 scale = _mm256_set1_ps(args.scale);
+    const __m256 py0 = _mm256_set1_ps(static_cast<float>(y) * args.scale);
+    const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    for (uint32_t x = 0; x < args.width; x += lanes)
+    {
+      const __m256i xs = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(x + args.originX)), laneIndex);
+      __m256 px = _mm256_mul_ps(_mm256_cvtepi32_ps(xs), scale);
+      __m256 py = py0;
+      if (args.warpScale != 0)
+      {
+        const __m256 ratio = _mm256_set1_ps(args.warpRatio);
+        const __m256 warpScale = _mm256_set1_ps(args.warpScale);
+        const __m256 wx = _mm256_mul_ps(px, ratio);
+        const __m256 wy = _mm256_mul_ps(py, ratio);
+        const __m256 dx = Fbm(wx, wy, args.warpX, false);
+        const __m256 dy = Fbm(_mm256_add_ps(wx, _mm256_set1_ps(args.warpOffsetX)), _mm256_add_ps(wy, _mm256_set1_ps(args.warpOffsetY)), args.warpY, false);
+        px = _mm256_add_ps(px, _mm256_mul_ps(warpScale, dx));
+        py = _mm256_add_ps(py, _mm256_mul_ps(warpScale, dy));
+      }
+
+      const __m256 h = _mm256_mul_ps(_mm256_set1_ps(args.height), Fbm(px, py, args.octaves, args.ridged));
+
+      // rows start on a cache line, but the padding past the width has to stay untouched
+      if (x + lanes <= args.width)
+      {
+        _mm256_store_ps(row + x, h);
+      }
+      else
+      {
+        const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(args.width - x)), laneIndex);
+        _mm256_maskstore_ps(row + x, mask, h);
+      }
+    }
+  }
+}
+#endif
\ No newline at end of file
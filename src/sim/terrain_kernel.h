@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include "terrain.h"
+
+// internal interface between GenerateTerrain and its per-ISA row kernels
+namespace Erosion::detail
+{
+  // the eight gradient directions, picked by the low three bits of the lattice hash
+  inline constexpr float gradientX[8] = { 1, -1, 0, 0, 0.70710678f, -0.70710678f, 0.70710678f, -0.70710678f };
+  inline constexpr float gradientY[8] = { 0, 0, 1, -1, 0.70710678f, 0.70710678f, -0.70710678f, -0.70710678f };
+
+  // multipliers of the integer lattice hash
+  inline constexpr uint32_t hashX = 0x8DA6B343;
+  inline constexpr uint32_t hashY = 0xD8163841;
+  inline constexpr uint32_t hashMix1 = 0x2C1B3C6D;
+  inline constexpr uint32_t hashMix2 = 0x297A2D39;
+
+  struct NoiseOctaves
+  {
+    uint32_t count{};
+    float lacunarity{};
+    float gain{};
+    float invNorm{};    // one over the sum of the octave amplitudes
+    uint32_t seeds[TerrainParams::maxOctaves]{};
+  };
+
+  struct TerrainKernelArgs
+  {
+    uint32_t width{};
+    uint32_t originX{};   // x of the first cell of a row in the whole map
+    bool ridged{};
+    float scale{};        // noise units per cell
+    float height{};
+    NoiseOctaves octaves{};
+
+    // the domain is displaced by warpScale * (fbm(p * warpRatio), fbm(p * warpRatio + warpOffset))
+    float warpScale{};
+    float warpRatio{};
+    float warpOffsetX{};
+    float warpOffsetY{};
+    NoiseOctaves warpX{};
+    NoiseOctaves warpY{};
+  };
+
+  // writes cells [0, width) of row y, where y is in whole-map coordinates. Every kernel computes bit-identical results
+  void TerrainRowScalar(const TerrainKernelArgs& args, float* row, uint32_t y);
+#ifdef EROSION_AVX2
+  void TerrainRowAVX2(const TerrainKernelArgs& args, float* row, uint32_t y);
+#endif
+}
\ No newline at end of file
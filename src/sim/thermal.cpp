@@ -0,0 +1,297 @@
+#include "thermal.h"
+#include "thermal_kernel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include "../utility/thread_pool.h"
+#include "../utility/cpu_features.h"
+
+namespace Erosion
+{
+  namespace
+  {
+    constexpr uint32_t bandRows = 32;
+
+    // excess height of a over b once the talus slope over the distance between them is taken away
+    float Excess(float a, float b, float talus)
+    {
+      return std::max(a - b - talus, 0.0f);
+    }
+
+    constexpr int32_t offsetX[8] = { -1, 1, 0, 0, -1, 1, -1, 1 };
+    constexpr int32_t offsetY[8] = { 0, 0, -1, 1, -1, -1, 1, 1 };
+
+    // bounds-checked versions of the stencils for the border cells, which have fewer neighbors
+    template<typename Fn>
+    void ForEachNeighbor(uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t pitch, Fn&& fn)
+    {
+      for (uint32_t i = 0; i < 8; i++)
+      {
+        const int64_t nx = static_cast<int64_t>(x) + offsetX[i];
+        const int64_t ny = static_cast<int64_t>(y) + offsetY[i];
+        if (nx >= 0 && ny >= 0 && nx < width && ny < height)
+        {
+          fn(static_cast<size_t>(nx + ny * static_cast<int64_t>(pitch)), i >= 4);
+        }
+      }
+    }
+  }
+
+  namespace detail
+  {
+    void OutflowRowScalar(const OutflowRowArgs& args, uint32_t x0, uint32_t x1)
+    {
+      const float talus = args.params->talus;
+      const float talusDiag = args.params->talus * std::sqrt(2.0f);
+      const float scale = args.params->rate * 0.5f;
+      const float* h = args.height;
+      const float* hT = args.heightUp;
+      const float* hB = args.heightDown;
+
+      for (uint32_t x = x0; x < x1; x++)
+      {
+        const uint32_t xl = x - 1;
+        const uint32_t xr = x + 1;
+        const float c = h[x];
+        const float eL = Excess(c, h[xl], talus);
+        const float eR = Excess(c, h[xr], talus);
+        const float eT = Excess(c, hT[x], talus);
+        const float eB = Excess(c, hB[x], talus);
+        const float eTL = Excess(c, hT[xl], talusDiag);
+        const float eTR = Excess(c, hT[xr], talusDiag);
+        const float eBL = Excess(c, hB[xl], talusDiag);
+        const float eBR = Excess(c, hB[xr], talusDiag);
+
+        // shed a fraction of half the largest excess, so a cell never ends up below the neighbor it fed
+        const float largest = std::max(std::max(std::max(eL, eR), std::max(eT, eB)), std::max(std::max(eTL, eTR), std::max(eBL, eBR)));
+        const float total = eL + eR + eT + eB + eTL + eTR + eBL + eBR;
+        args.outflow[x] = scale * largest / std::max(total, 1e-30f);
+      }
+    }
+
+    void RelaxRowScalar(const RelaxRowArgs& args, uint32_t x0, uint32_t x1)
+    {
+      const float talus = args.params->talus;
+      const float talusDiag = args.params->talus * std::sqrt(2.0f);
+      const float* h = args.height;
+      const float* hT = args.heightUp;
+      const float* hB = args.heightDown;
+      const float* o = args.outflow;
+      const float* oT = args.outflowUp;
+      const float* oB = args.outflowDown;
+
+      for (uint32_t x = x0; x < x1; x++)
+      {
+        const uint32_t xl = x - 1;
+        const uint32_t xr = x + 1;
+        const float c = h[x];
+
+        // what this cell sheds, with the same excesses OutflowRow summed
+        const float shed = o[x] * (
+          Excess(c, h[xl], talus) + Excess(c, h[xr], talus) +
+          Excess(c, hT[x], talus) + Excess(c, hB[x], talus) +
+          Excess(c, hT[xl], talusDiag) + Excess(c, hT[xr], talusDiag) +
+          Excess(c, hB[xl], talusDiag) + Excess(c, hB[xr], talusDiag));
+
+        // what the neighbors shed into this cell
+        const float gained =
+          o[xl] * Excess(h[xl], c, talus) + o[xr] * Excess(h[xr], c, talus) +
+          oT[x] * Excess(hT[x], c, talus) + oB[x] * Excess(hB[x], c, talus) +
+          oT[xl] * Excess(hT[xl], c, talusDiag) + oT[xr] * Excess(hT[xr], c, talusDiag) +
+          oB[xl] * Excess(hB[xl], c, talusDiag) + oB[xr] * Excess(hB[xr], c, talusDiag);
+
+        args.heightOut[x] = c - shed + gained;
+      }
+    }
+  }
+
+  ThermalEroder::ThermalEroder(uint32_t width, uint32_t height, const ThermalParams& params)
+    : width_(width),
+      height_(height),
+      pitch_(Heightfield::PitchFor(width)),
+      params_(params),
+      outflow_(static_cast<size_t>(pitch_) * height),
+      terrainBack_(static_cast<size_t>(pitch_) * height)
+  {
+    outflowRow_ = detail::OutflowRowScalar;
+    relaxRow_ = detail::RelaxRowScalar;
+#ifdef EROSION_AVX2
+    if (HasAVX2())
+    {
+      outflowRow_ = detail::OutflowRowAVX2;
+      relaxRow_ = detail::RelaxRowAVX2;
+    }
+#endif
+  }
+
+  void ThermalEroder::Step(Heightfield& map, ThreadPool& pool, DirtyTiles* changed)
+  {
+    const uint32_t tileSize = changed ? changed->TileSize() : 0;
+    const uint32_t tilesX = changed ? (width_ + tileSize - 1) / tileSize : 0;
+    changedRows_.resize(static_cast<size_t>(tilesX) * height_);
+
+    // both passes only write their own cells: the first decides how much each cell sheds,
+    // the second gathers what the neighbors shed into it
+    ForEachBand(pool, height_, bandRows, [&](uint32_t y0, uint32_t y1) { ComputeOutflow(map, y0, y1); });
+    ForEachBand(pool, height_, bandRows, [&](uint32_t y0, uint32_t y1) { Relax(map, y0, y1, tileSize); });
+    std::swap(map.data, terrainBack_);
+
+    if (!changed)
+    {
+      return;
+    }
+
+    // the rows of each row of tiles are merged after the parallel pass
+    for (uint32_t ty0 = 0; ty0 < height_; ty0 += tileSize)
+    {
+      const uint32_t ty1 = std::min(ty0 + tileSize, height_);
+      for (uint32_t tx = 0; tx < tilesX; tx++)
+      {
+        uint8_t any = 0;
+        for (uint32_t y = ty0; y < ty1; y++)
+        {
+          any |= changedRows_[tx + static_cast<size_t>(y) * tilesX];
+        }
+        if (any)
+        {
+          changed->Mark({ tx * tileSize, ty0, std::min((tx + 1) * tileSize, width_), ty1 });
+        }
+      }
+    }
+  }
+
+  void ThermalEroder::Resize(uint32_t width, uint32_t height)
+  {
+    if (width == width_ && height == height_)
+    {
+      return;
+    }
+    width_ = width;
+    height_ = height;
+    pitch_ = Heightfield::PitchFor(width);
+
+    // the back buffer becomes the map, whose padding has to stay zero
+    outflow_.resize(static_cast<size_t>(pitch_) * height);
+    terrainBack_.assign(static_cast<size_t>(pitch_) * height, 0.0f);
+  }
+
+  void ThermalEroder::ComputeOutflow(const Heightfield& map, uint32_t y0, uint32_t y1)
+  {
+    const float talus = params_.talus;
+    const float talusDiag = params_.talus * std::sqrt(2.0f);
+    const uint32_t w = width_;
+    const uint32_t p = pitch_;
+
+    auto borderCell = [&](uint32_t x, uint32_t y)
+    {
+      const size_t i = x + static_cast<size_t>(y) * p;
+      const float c = map.data[i];
+      float largest = 0;
+      float total = 0;
+      ForEachNeighbor(x, y, w, height_, p, [&](size_t n, bool diagonal)
+        {
+          const float e = Excess(c, map.data[n], diagonal ? talusDiag : talus);
+          largest = std::max(largest, e);
+          total += e;
+        });
+      outflow_[i] = params_.rate * 0.5f * largest / std::max(total, 1e-30f);
+    };
+
+    for (uint32_t y = y0; y < y1; y++)
+    {
+      if (y == 0 || y + 1 >= height_ || w < 3)
+      {
+        for (uint32_t x = 0; x < w; x++)
+        {
+          borderCell(x, y);
+        }
+        continue;
+      }
+
+      const size_t row = static_cast<size_t>(y) * p;
+      const detail::OutflowRowArgs args = {
+        .params = &params_,
+        .height = map.data.data() + row,
+        .heightUp = map.data.data() + row - p,
+        .heightDown = map.data.data() + row + p,
+        .outflow = outflow_.data() + row,
+      };
+
+      borderCell(0, y);
+      outflowRow_(args, 1, w - 1);
+      borderCell(w - 1, y);
+    }
+  }
+
+  void ThermalEroder::Relax(const Heightfield& map, uint32_t y0, uint32_t y1, uint32_t tileSize)
+  {
+    const float talus = params_.talus;
+    const float talusDiag = params_.talus * std::sqrt(2.0f);
+    const uint32_t w = width_;
+    const uint32_t p = pitch_;
+
+    auto borderCell = [&](uint32_t x, uint32_t y)
+    {
+      const size_t i = x + static_cast<size_t>(y) * p;
+      const float c = map.data[i];
+      float shed = 0;
+      float gained = 0;
+      ForEachNeighbor(x, y, w, height_, p, [&](size_t n, bool diagonal)
+        {
+          const float t = diagonal ? talusDiag : talus;
+          shed += Excess(c, map.data[n], t);
+          gained += outflow_[n] * Excess(map.data[n], c, t);
+        });
+      terrainBack_[i] = c - outflow_[i] * shed + gained;
+    };
+
+    // compares the relaxed row with the one it came from, a tile column at a time
+    auto recordRow = [&](uint32_t y)
+    {
+      if (tileSize == 0)
+      {
+        return;
+      }
+      const size_t row = static_cast<size_t>(y) * p;
+      const uint32_t tilesX = (w + tileSize - 1) / tileSize;
+      uint8_t* flags = changedRows_.data() + static_cast<size_t>(y) * tilesX;
+      for (uint32_t tx = 0; tx < tilesX; tx++)
+      {
+        const uint32_t x0 = tx * tileSize;
+        const uint32_t x1 = std::min(x0 + tileSize, w);
+        flags[tx] = std::memcmp(map.data.data() + row + x0, terrainBack_.data() + row + x0, (x1 - x0) * sizeof(float)) != 0;
+      }
+    };
+
+    for (uint32_t y = y0; y < y1; y++)
+    {
+      if (y == 0 || y + 1 >= height_ || w < 3)
+      {
+        for (uint32_t x = 0; x < w; x++)
+        {
+          borderCell(x, y);
+        }
+        recordRow(y);
+        continue;
+      }
+
+      const size_t row = static_cast<size_t>(y) * p;
+      const detail::RelaxRowArgs args = {
+        .params = &params_,
+        .height = map.data.data() + row,
+        .heightUp = map.data.data() + row - p,
+        .heightDown = map.data.data() + row + p,
+        .outflow = outflow_.data() + row,
+        .outflowUp = outflow_.data() + row - p,
+        .outflowDown = outflow_.data() + row + p,
+        .heightOut = terrainBack_.data() + row,
+      };
+
+      borderCell(0, y);
+      relaxRow_(args, 1, w - 1);
+      borderCell(w - 1, y);
+      recordRow(y);
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "heightfield.h"
+#include "dirty_tiles.h"
+#include "../macros.h"
+
+class ThreadPool;
+
+namespace Erosion
+{
+  struct ThermalParams
+  {
+    uint32_t interval = 1;      // run after every Nth hydraulic update, 0 disables the stage
+    uint32_t iterations = 1;    // relaxation steps per run
+    float talus = 0.01f;        // steepest stable height difference between adjacent cells
+    float rate = 0.5f;          // fraction of the excess moved per step, at most 1
+  };
+
+  namespace detail
+  {
+    struct OutflowRowArgs;
+    struct RelaxRowArgs;
+
+    // update interior cells [x0, x1) of one row of a pass
+    using OutflowRowFn = void(*)(const OutflowRowArgs& args, uint32_t x0, uint32_t x1);
+    using RelaxRowFn = void(*)(const RelaxRowArgs& args, uint32_t x0, uint32_t x1);
+  }
+
+  // thermal weathering: material slides off slopes steeper than the talus angle to its lower neighbors
+  class ThermalEroder
+  {
+  public:
+    ThermalEroder(uint32_t width, uint32_t height, const ThermalParams& params);
+
+    NOCOPY_NOMOVE(ThermalEroder)
+
+    [[nodiscard]] const ThermalParams& Params() const { return params_; }
+
+    // performs one relaxation step. The terrain is double buffered, so map.data is swapped with an internal buffer.
+    // The tiles in which any cell changed are marked in changed
+    void Step(Heightfield& map, ThreadPool& pool, DirtyTiles* changed = nullptr);
+
+    // switches to maps of another size, keeping the buffers' memory where it is large enough
+    void Resize(uint32_t width, uint32_t height);
+
+  private:
+    void ComputeOutflow(const Heightfield& map, uint32_t y0, uint32_t y1);
+    // tileSize is that of the DirtyTiles Step marks, 0 if it marks none
+    void Relax(const Heightfield& map, uint32_t y0, uint32_t y1, uint32_t tileSize);
+
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t pitch_;
+    ThermalParams params_;
+    detail::OutflowRowFn outflowRow_;
+    detail::RelaxRowFn relaxRow_;
+
+    // amount a cell sends per unit of excess height towards a neighbor
+    FieldBuffer outflow_;
+    FieldBuffer terrainBack_;
+
+    // per row, the tile columns in which Relax changed a cell. Each band only writes its own rows
+    std::vector<uint8_t> changedRows_;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+// only built with AVX2 code generation enabled, and only called after a runtime check
+#ifdef EROSION_AVX2
+#include "thermal_kernel.h"
+#include <cmath>
+#include <immintrin.h>
+
+// std::max(a, b) is a < b ? b : a, which is _mm256_max_ps(b, a) even for NaN, so the operands below are swapped
+// relative to the scalar kernel to keep the lanes bit-identical to it
+namespace Erosion::detail
+{
+  namespace
+  {
+    __m256 Excess(__m256 a, __m256 b, __m256 talus)
+    {
+      return _mm256_max_ps(_mm256_setzero_ps(), _mm256_sub_ps(_mm256_sub_ps(a, b), talus));
+    }
+  }
+
+  void OutflowRowAVX2(const OutflowRowArgs& args, uint32_t x0, uint32_t x1)
+  {
+    const __m256 talus = _mm256_set1_ps(args.params->talus);
+    const __m256 talusDiag = _mm256_set1_ps(args.params->talus * std::sqrt(2.0f));
+    const __m256 scale = _mm256_set1_ps(args.params->rate * 0.5f);
+    const __m256 minTotal = _mm256_set1_ps(1e-30f);
+    const float* h = args.height;
+    const float* hT = args.heightUp;
+    const float* hB = args.heightDown;
+
+    uint32_t x = x0;
+    for (; x + 8 <= x1; x += 8)
+    {
+      const __m256 c = _mm256_loadu_ps(h + x);
+      const __m256 eL = Excess(c, _mm256_loadu_ps(h + x - 1), talus);
+      const __m256 eR = Excess(c, _mm256_loadu_ps(h + x + 1), talus);
+      const __m256 eT = Excess(c, _mm256_loadu_ps(hT + x), talus);
+      const __m256 eB = Excess(c, _mm256_loadu_ps(hB + x), talus);
+      const __m256 eTL = Excess(c, _mm256_loadu_ps(hT + x - 1), talusDiag);
+      const __m256 eTR = Excess(c, _mm256_loadu_ps(hT + x + 1), talusDiag);
+      const __m256 eBL = Excess(c, _mm256_loadu_ps(hB + x - 1), talusDiag);
+      const __m256 eBR = Excess(c, _mm256_loadu_ps(hB + x + 1), talusDiag);
+
+      const __m256 largest = _mm256_max_ps(
+        _mm256_max_ps(_mm256_max_ps(eBR, eBL), _mm256_max_ps(eTR, eTL)),
+        _mm256_max_ps(_mm256_max_ps(eB, eT), _mm256_max_ps(eR, eL)));
+      __m256 total = _mm256_add_ps(eL, eR);
+      total = _mm256_add_ps(total, eT);
+      total = _mm256_add_ps(total, eB);
+      total = _mm256_add_ps(total, eTL);
+      total = _mm256_add_ps(total, eTR);
+      total = _mm256_add_ps(total, eBL);
+      total = _mm256_add_ps(total, eBR);
+      _mm256_storeu_ps(args.outflow + x, _mm256_div_ps(_mm256_mul_ps(scale, largest), _mm256_max_ps(minTotal, total)));
+    }
+    OutflowRowScalar(args, x, x1);
+  }
+
+  void RelaxRowAVX2(const RelaxRowArgs& args, uint32_t x0, uint32_t x1)
+  {
+    const __m256 talus = _mm256_set1_ps(args.params->talus);
+    const __m256 talusDiag = _mm256_set1_ps(args.params->talus * std::sqrt(2.0f));
+    const float* h = args.height;
+    const float* hT = args.heightUp;
+    const float* hB = args.heightDown;
+    const float* o = args.outflow;
+    const float* oT = args.outflowUp;
+    const float* oB = args.outflowDown;
+
+    uint32_t x = x0;
+    for (; x + 8 <= x1; x += 8)
+    {
+      const __m256 c = _mm256_loadu_ps(h + x);
+      const __m256 nL = _mm256_loadu_ps(h + x - 1);
+      const __m256 nR = _mm256_loadu_ps(h + x + 1);
+      const __m256 nT = _mm256_loadu_ps(hT + x);
+      const __m256 nB = _mm256_loadu_ps(hB + x);
+      const __m256 nTL = _mm256_loadu_ps(hT + x - 1);
+      const __m256 nTR = _mm256_loadu_ps(hT + x + 1);
+      const __m256 nBL = _mm256_loadu_ps(hB + x - 1);
+      const __m256 nBR = _mm256_loadu_ps(hB + x + 1);
+
+      __m256 excess = _mm256_add_ps(Excess(c, nL, talus), Excess(c, nR, talus));
+      excess = _mm256_add_ps(excess, Excess(c, nT, talus));
+      excess = _mm256_add_ps(excess, Excess(c, nB, talus));
+      excess = _mm256_add_ps(excess, Excess(c, nTL, talusDiag));
+      excess = _mm256_add_ps(excess, Excess(c, nTR, talusDiag));
+      excess = _mm256_add_ps(excess, Excess(c, nBL, talusDiag));
+      excess = _mm256_add_ps(excess, Excess(c, nBR, talusDiag));
+      const __m256 shed = _mm256_mul_ps(_mm256_loadu_ps(o + x), excess);
+
+      const auto in = [&](const float* outflow, __m256 n, __m256 t)
+      {
+        return _mm256_mul_ps(_mm256_loadu_ps(outflow), Excess(n, c, t));
+      };
+      __m256 gained = _mm256_add_ps(in(o + x - 1, nL, talus), in(o + x + 1, nR, talus));
+      gained = _mm256_add_ps(gained, in(oT + x, nT, talus));
+      gained = _mm256_add_ps(gained, in(oB + x, nB, talus));
+      gained = _mm256_add_ps(gained, in(oT + x - 1, nTL, talusDiag));
+      gained = _mm256_add_ps(gained, in(oT + x + 1, nTR, talusDiag));
+      gained = _mm256_add_ps(gained, in(oB + x - 1, nBL, talusDiag));
+      gained = _mm256_add_ps(gained, in(oB + x + 1, nBR, talusDiag));
+
+      _mm256_storeu_ps(args.heightOut + x, _mm256_add_ps(_mm256_sub_ps(c, shed), gained));
+    }
+    RelaxRowScalar(args, x, x1);
+  }
+}
+#endif
\ No newline at end of file
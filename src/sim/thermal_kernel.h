@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include "thermal.h"
+
+// internal interface between ThermalEroder and its per-ISA row kernels
+namespace Erosion::detail
+{
+  // one row of the outflow pass. The Up and Down rows are the ones above and below, which must exist
+  struct OutflowRowArgs
+  {
+    const ThermalParams* params{};
+    const float* height{};
+    const float* heightUp{};
+    const float* heightDown{};
+    float* outflow{};
+  };
+
+  // one row of the relaxation pass, reading the outflows of the row and the rows above and below it
+  struct RelaxRowArgs
+  {
+    const ThermalParams* params{};
+    const float* height{};
+    const float* heightUp{};
+    const float* heightDown{};
+    const float* outflow{};
+    const float* outflowUp{};
+    const float* outflowDown{};
+    float* heightOut{};
+  };
+
+  // update interior cells [x0, x1) of a row, which must have neighbors on both sides: 1 <= x0 and x1 < width.
+  // The border cells are left to the caller. Every kernel computes bit-identical results
+  void OutflowRowScalar(const OutflowRowArgs& args, uint32_t x0, uint32_t x1);
+  void RelaxRowScalar(const RelaxRowArgs& args, uint32_t x0, uint32_t x1);
+#ifdef EROSION_AVX2
+  void OutflowRowAVX2(const OutflowRowArgs& args, uint32_t x0, uint32_t x1);
+  void RelaxRowAVX2(const RelaxRowArgs& args, uint32_t x0, uint32_t x1);
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "tile_store.h"
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+namespace Erosion
+{
+  namespace
+  {
+    uint64_t TileBytes(uint32_t tileSize)
+    {
+      return static_cast<uint64_t>(tileSize) * tileSize * sizeof(float);
+    }
+
+    uint64_t StoreBytes(uint32_t width, uint32_t height, uint32_t tileSize)
+    {
+      const uint64_t tiles = static_cast<uint64_t>((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize);
+      return tiles * TileBytes(tileSize);
+    }
+
+    uint32_t CheckTileSize(uint32_t tileSize)
+    {
+      // 128^2 floats is 64 KiB, the coarsest offset alignment of any platform's file mappings
+      if (tileSize == 0 || tileSize % 128 != 0)
+      {
+        throw std::runtime_error(std::format("tile size {} is not a multiple of 128", tileSize));
+      }
+      return tileSize;
+    }
+  }
+
+  TileStore::TileStore(const std::string& path, MappedFile::Mode mode, uint32_t width, uint32_t height, uint32_t tileSize, uint32_t maxResidentTiles)
+    : width_(width),
+      height_(height),
+      tileSize_(CheckTileSize(tileSize)),
+      tilesX_((width + tileSize - 1) / tileSize),
+      tilesY_((height + tileSize - 1) / tileSize),
+      maxResident_(std::max(maxResidentTiles, 1u)),
+      file_(path, mode, mode == MappedFile::Mode::CREATE ? StoreBytes(width, height, tileSize) : 0)
+  {
+    if (file_.Size() != StoreBytes(width, height, tileSize))
+    {
+      throw std::runtime_error(std::format("'{}' has {} bytes, a {}x{} store of {}^2 tiles needs {}",
+        path, file_.Size(), width, height, tileSize, StoreBytes(width, height, tileSize)));
+    }
+  }
+
+  TileStore::~TileStore()
+  {
+    // unmapping writes dirty pages back, but not necessarily before the OS feels like it
+    Flush();
+  }
+
+  TileStoreStats TileStore::Stats() const
+  {
+    std::lock_guard lock(mutex_);
+    return stats_;
+  }
+
+  float* TileStore::Acquire(uint32_t tx, uint32_t ty)
+  {
+    const uint32_t tile = tx + ty * tilesX_;
+
+    std::lock_guard lock(mutex_);
+    if (auto it = resident_.find(tile); it != resident_.end())
+    {
+      if (it->second.pins++ == 0)
+      {
+        lru_.erase(it->second.lruEntry);
+      }
+      return reinterpret_cast<float*>(it->second.view.Data());
+    }
+
+    // pinned tiles can't be evicted, so the limit is exceeded rather than failing when all of them are in use
+    while (resident_.size() >= maxResident_ && !lru_.empty())
+    {
+      resident_.erase(lru_.front());
+      lru_.pop_front();
+      stats_.evictions++;
+    }
+
+    Resident& entry = resident_[tile];
+    entry.view = file_.Map(tile * TileBytes(tileSize_), TileBytes(tileSize_));
+    entry.pins = 1;
+    stats_.maps++;
+    stats_.resident = static_cast<uint32_t>(resident_.size());
+    stats_.peakResident = std::max(stats_.peakResident, stats_.resident);
+    return reinterpret_cast<float*>(entry.view.Data());
+  }
+
+  void TileStore::Release(uint32_t tx, uint32_t ty)
+  {
+    const uint32_t tile = tx + ty * tilesX_;
+
+    std::lock_guard lock(mutex_);
+    Resident& entry = resident_.at(tile);
+    if (--entry.pins == 0)
+    {
+      entry.lruEntry = lru_.insert(lru_.end(), tile);
+    }
+    stats_.resident = static_cast<uint32_t>(resident_.size());
+  }
+
+  template<typename Fn>
+  void TileStore::ForEachTileIn(const DirtyRect& rect, Fn&& fn)
+  {
+    for (uint32_t ty = rect.y0 / tileSize_; ty * tileSize_ < rect.y1; ty++)
+    {
+      for (uint32_t tx = rect.x0 / tileSize_; tx * tileSize_ < rect.x1; tx++)
+      {
+        float* tile = Acquire(tx, ty);
+
+        // the part of rect inside this tile
+        const uint32_t x0 = std::max(rect.x0, tx * tileSize_);
+        const uint32_t y0 = std::max(rect.y0, ty * tileSize_);
+        const uint32_t x1 = std::min(rect.x1, (tx + 1) * tileSize_);
+        const uint32_t y1 = std::min(rect.y1, (ty + 1) * tileSize_);
+        for (uint32_t y = y0; y < y1; y++)
+        {
+          fn(tile + (y - ty * tileSize_) * static_cast<size_t>(tileSize_) + (x0 - tx * tileSize_), x0, y, x1 - x0);
+        }
+
+        Release(tx, ty);
+      }
+    }
+  }
+
+  void TileStore::Read(const DirtyRect& rect, Heightfield& out)
+  {
+    ForEachTileIn(rect, [&](const float* src, uint32_t x, uint32_t y, uint32_t count)
+      {
+        std::memcpy(out.Row(y - rect.y0) + (x - rect.x0), src, count * sizeof(float));
+      });
+  }
+
+  void TileStore::Write(const DirtyRect& rect, const Heightfield& in)
+  {
+    ForEachTileIn(rect, [&](float* dst, uint32_t x, uint32_t y, uint32_t count)
+      {
+        std::memcpy(dst, in.Row(y - rect.y0) + (x - rect.x0), count * sizeof(float));
+      });
+  }
+
+  void TileStore::Flush()
+  {
+    std::lock_guard lock(mutex_);
+    for (const auto& [tile, entry] : resident_)
+    {
+      entry.view.Flush();
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "heightfield.h"
+#include "../utility/mapped_file.h"
+#include "../macros.h"
+
+namespace Erosion
+{
+  struct TileStoreStats
+  {
+    uint64_t maps{};        // tiles mapped into memory
+    uint64_t evictions{};   // tiles unmapped to stay within the resident limit
+    uint32_t resident{};
+    uint32_t peakResident{};
+  };
+
+  // heightmap kept in a file of fixed-size square tiles, only some of which are mapped into memory at a time.
+  // Tiles are stored one after another in row-major tile order, each one row-major with tileSize floats per row
+  class TileStore
+  {
+  public:
+    // tileSize must be a multiple of 128, so every tile starts on a mapping boundary
+    TileStore(const std::string& path, MappedFile::Mode mode, uint32_t width, uint32_t height, uint32_t tileSize, uint32_t maxResidentTiles);
+    ~TileStore();
+
+    NOCOPY_NOMOVE(TileStore)
+
+    [[nodiscard]] uint32_t Width() const { return width_; }
+    [[nodiscard]] uint32_t Height() const { return height_; }
+    [[nodiscard]] uint32_t TileSize() const { return tileSize_; }
+    [[nodiscard]] uint32_t TilesX() const { return tilesX_; }
+    [[nodiscard]] uint32_t TilesY() const { return tilesY_; }
+    [[nodiscard]] TileStoreStats Stats() const;
+
+    // maps the tile if needed and keeps it resident until the matching Release. Cells past the map edge are padding
+    [[nodiscard]] float* Acquire(uint32_t tx, uint32_t ty);
+    void Release(uint32_t tx, uint32_t ty);
+
+    // copies the cells in rect to or from out, whose cell (0, 0) corresponds to (rect.x0, rect.y0)
+    void Read(const DirtyRect& rect, Heightfield& out);
+    void Write(const DirtyRect& rect, const Heightfield& in);
+
+    // writes every resident tile back to the file
+    void Flush();
+
+  private:
+    struct Resident
+    {
+      MappedFile::View view;
+      uint32_t pins{};
+      std::list<uint32_t>::iterator lruEntry;   // valid while unpinned
+    };
+
+    template<typename Fn>
+    void ForEachTileIn(const DirtyRect& rect, Fn&& fn);
+
+    uint32_t width_;
+    uint32_t height_;
+    uint32_t tileSize_;
+    uint32_t tilesX_;
+    uint32_t tilesY_;
+    uint32_t maxResident_;
+    MappedFile file_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<uint32_t, Resident> resident_;
+    std::list<uint32_t> lru_;     // unpinned resident tiles, least recently used first
+    TileStoreStats stats_;
+  };
+}
\ No newline at end of file
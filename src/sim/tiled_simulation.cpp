@@ -0,0 +1,156 @@
+#include "tiled_simulation.h"
+#include "random.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace Erosion
+{
+  TiledSimulation::TiledSimulation(const TiledSimulationCreateInfo& createInfo)
+    : width(createInfo.width),
+      height(createInfo.height),
+      halo(std::min(createInfo.halo, createInfo.tileSize / 2)),
+      terrain(createInfo.terrain),
+      thermalParams(createInfo.thermal),
+      // every thread holds at most the 3x3 tiles around its own while copying a window
+      store(createInfo.path, MappedFile::Mode::CREATE, createInfo.width, createInfo.height, createInfo.tileSize,
+        std::max(createInfo.maxResidentTiles, 9 * std::max(createInfo.numThreads, 1u))),
+      eroder(createInfo.droplet, createInfo.dropletBackend),
+      pool(createInfo.numThreads)
+  {
+    for (uint32_t i = 0; i < pool.NumThreads(); i++)
+    {
+      thermal.push_back(std::make_unique<ThermalEroder>(0, 0, thermalParams));
+    }
+  }
+
+  DirtyRect TiledSimulation::TileRect(uint32_t tile) const
+  {
+    const uint32_t tileSize = store.TileSize();
+    const uint32_t x0 = tile % store.TilesX() * tileSize;
+    const uint32_t y0 = tile / store.TilesX() * tileSize;
+    return { x0, y0, std::min(x0 + tileSize, width), std::min(y0 + tileSize, height) };
+  }
+
+  uint64_t TiledSimulation::DropletsBefore(uint32_t tile) const
+  {
+    // droplets are spread over the tiles by area, so edge tiles that are cut off get fewer
+    const uint32_t tileSize = store.TileSize();
+    const uint64_t rowsAbove = std::min(tile / store.TilesX() * tileSize, height);
+    const uint64_t rowHeight = std::min(height - static_cast<uint32_t>(rowsAbove), tileSize);
+    const uint64_t columnsLeft = std::min(tile % store.TilesX() * tileSize, width);
+    const double cells = static_cast<double>(rowsAbove * width + rowHeight * columnsLeft);
+    return static_cast<uint64_t>(std::floor(eroder.Params().dropletsPerUpdate * cells / (static_cast<double>(width) * height)));
+  }
+
+  template<typename Fn>
+  void TiledSimulation::ForEachWindow(Fn&& fn)
+  {
+    // same-phase tiles are a whole tile apart and the halo is at most half a tile, so their windows are disjoint
+    std::vector<uint32_t> phaseTiles;
+    for (uint32_t phase = 0; phase < 4; phase++)
+    {
+      phaseTiles.clear();
+      for (uint32_t ty = phase / 2; ty < store.TilesY(); ty += 2)
+      {
+        for (uint32_t tx = phase % 2; tx < store.TilesX(); tx += 2)
+        {
+          phaseTiles.push_back(tx + ty * store.TilesX());
+        }
+      }
+
+      pool.ParallelFor(static_cast<uint32_t>(phaseTiles.size()), [&](uint32_t i, uint32_t thread)
+        {
+          const DirtyRect rect = TileRect(phaseTiles[i]);
+          const DirtyRect window
+          {
+            .x0 = rect.x0 - std::min(rect.x0, halo),
+            .y0 = rect.y0 - std::min(rect.y0, halo),
+            .x1 = std::min(rect.x1 + halo, width),
+            .y1 = std::min(rect.y1 + halo, height),
+          };
+
+          Heightfield map(window.x1 - window.x0, window.y1 - window.y0);
+          store.Read(window, map);
+          fn(phaseTiles[i], window, map, thread);
+          store.Write(window, map);
+        });
+    }
+  }
+
+  void TiledSimulation::Init(uint64_t seed)
+  {
+    this->seed = seed;
+    iteration = 0;
+
+    pool.ParallelFor(store.TilesX() * store.TilesY(), [&](uint32_t tile)
+      {
+        const DirtyRect rect = TileRect(tile);
+        Heightfield map(rect.x1 - rect.x0, rect.y1 - rect.y0);
+
+        // the pool is busy running this loop, so the tile is generated on the calling thread
+        GenerateTerrain(map, terrain, seed, serial, { .x0 = rect.x0, .y0 = rect.y0, .worldWidth = width, .worldHeight = height });
+        store.Write(rect, map);
+      });
+  }
+
+  void TiledSimulation::Update()
+  {
+    const uint32_t margin = eroder.Margin();
+    const bool runThermal = thermalParams.interval > 0 && thermalParams.iterations > 0 && (iteration + 1) % thermalParams.interval == 0;
+    if (width <= 2 * margin + 1 || height <= 2 * margin + 1)
+    {
+      iteration++;
+      return;
+    }
+
+    // a droplet reaches Margin() cells past its position, which has to stay inside the window
+    const float apron = static_cast<float>(std::max(static_cast<int32_t>(halo) - static_cast<int32_t>(margin) - 1, 0));
+    const glm::vec2 mapLo = glm::vec2(static_cast<float>(margin));
+    const glm::vec2 mapHi = glm::vec2(static_cast<float>(width - margin - 1), static_cast<float>(height - margin - 1));
+
+    ForEachWindow([&](uint32_t tile, const DirtyRect& window, Heightfield& map, uint32_t thread)
+      {
+        const DirtyRect rect = TileRect(tile);
+        const glm::vec2 origin = glm::vec2(static_cast<float>(window.x0), static_cast<float>(window.y0));
+        const glm::vec2 tileLo = glm::vec2(static_cast<float>(rect.x0), static_cast<float>(rect.y0));
+        const glm::vec2 tileHi = glm::vec2(static_cast<float>(rect.x1), static_cast<float>(rect.y1));
+
+        // spawns use the same streams as the in-memory simulation would for the same droplet index
+        const glm::vec2 spawnLo = glm::max(tileLo, mapLo);
+        const glm::vec2 spawnHi = glm::min(tileHi, mapHi);
+        std::vector<glm::vec2> spawnPositions;
+        if (spawnLo.x < spawnHi.x && spawnLo.y < spawnHi.y)
+        {
+          const uint64_t end = DropletsBefore(tile + 1);
+          for (uint64_t i = DropletsBefore(tile); i < end; i++)
+          {
+            CounterRng rng(seed, iteration, static_cast<uint32_t>(i));
+            const float x = rng.NextFloat(spawnLo.x, spawnHi.x);
+            const float y = rng.NextFloat(spawnLo.y, spawnHi.y);
+            spawnPositions.push_back(glm::vec2(x, y) - origin);
+          }
+        }
+
+        const DropletBounds bounds
+        {
+          .lo = glm::max(tileLo - apron, mapLo) - origin,
+          .hi = glm::min(tileHi + apron, mapHi) - origin,
+        };
+        eroder.Simulate(map, spawnPositions, bounds);
+
+        if (runThermal)
+        {
+          // relaxes the halo too, so cells near tile borders can be relaxed by more than one window per update
+          ThermalEroder& relax = *thermal[thread];
+          relax.Resize(map.width, map.height);
+          for (uint32_t i = 0; i < thermalParams.iterations; i++)
+          {
+            relax.Step(map, serial);
+          }
+        }
+      });
+
+    iteration++;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "droplet.h"
+#include "thermal.h"
+#include "terrain.h"
+#include "tile_store.h"
+#include "../utility/thread_pool.h"
+#include "../macros.h"
+
+namespace Erosion
+{
+  struct TiledSimulationCreateInfo
+  {
+    uint32_t width{};
+    uint32_t height{};
+    std::string path;                 // backing file of the heightmap, created or overwritten
+    uint32_t tileSize = 512;          // a multiple of 128
+    uint32_t halo = 32;               // cells around a tile that are loaded with it, at most tileSize / 2
+    uint32_t maxResidentTiles = 64;   // raised if the threads need more at once
+    TerrainParams terrain{};
+    DropletParams droplet{};          // dropletsPerUpdate is spread over the whole map
+    ThermalParams thermal{};
+    DropletBackend dropletBackend = DropletBackend::AUTO;
+    uint32_t numThreads = std::thread::hardware_concurrency();
+  };
+
+  // droplet and thermal erosion of a map too large for memory. The map lives in a TileStore, and every update
+  // loads each tile with a halo of its neighbors, erodes it, and writes the whole window back, so changes near a
+  // tile border reach the neighbors. Tiles are processed in the same four phases as DropletEroder::ErodeTiled, and
+  // the result does not depend on the number of threads
+  class TiledSimulation
+  {
+  public:
+    TiledSimulation(const TiledSimulationCreateInfo& createInfo);
+
+    NOCOPY_NOMOVE(TiledSimulation)
+
+    void Init(uint64_t seed);
+    void Update();
+
+    [[nodiscard]] TileStore& Store() { return store; }
+    [[nodiscard]] uint64_t Iteration() const { return iteration; }
+
+  private:
+    // calls fn(tile, window, map, thread) for every tile, where map holds the cells of window and thread is the index
+    // of the pool thread running it
+    template<typename Fn>
+    void ForEachWindow(Fn&& fn);
+
+    [[nodiscard]] DirtyRect TileRect(uint32_t tile) const;
+    [[nodiscard]] uint64_t DropletsBefore(uint32_t tile) const;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t halo;
+    TerrainParams terrain;
+    ThermalParams thermalParams;
+    TileStore store;
+    DropletEroder eroder;
+    ThreadPool pool;
+
+    // a pool without workers runs everything on the calling thread, so all pool threads can share it
+    ThreadPool serial{ 1 };
+
+    // one per pool thread, resized to each window it relaxes
+    std::vector<std::unique_ptr<ThermalEroder>> thermal;
+
+    uint64_t seed = 0;
+    uint64_t iteration = 0;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+// only built with AVX2 code generation enabled, and only called after a runtime check
+#ifdef ENGINE_AVX2
+#include "transform_kernel.h"
+#include <immintrin.h>
+
+namespace detail
+{
+  void ComputeModelsAVX2(const TransformLanes& in, ModelLanes& out)
+  {
+    // the same operations in the same order as ComputeModelsScalar, on all lanes at once
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 w = _mm256_loadu_ps(in.qw);
+    const __m256 x = _mm256_loadu_ps(in.qx);
+    const __m256 y = _mm256_loadu_ps(in.qy);
+    const __m256 z = _mm256_loadu_ps(in.qz);
+    const __m256 sx = _mm256_loadu_ps(in.sx);
+    const __m256 sy = _mm256_loadu_ps(in.sy);
+    const __m256 sz = _mm256_loadu_ps(in.sz);
+
+    const __m256 xx = _mm256_mul_ps(x, x);
+    const __m256 yy = _mm256_mul_ps(y, y);
+    const __m256 zz = _mm256_mul_ps(z, z);
+    const __m256 xz = _mm256_mul_ps(x, z);
+    const __m256 xy = _mm256_mul_ps(x, y);
+    const __m256 yz = _mm256_mul_ps(y, z);
+    const __m256 wx = _mm256_mul_ps(w, x);
+    const __m256 wy = _mm256_mul_ps(w, y);
+    const __m256 wz = _mm256_mul_ps(w, z);
+
+    const auto store = [&](int entry, __m256 rotation, __m256 scale)
+    {
+      _mm256_storeu_ps(out.m[entry], _mm256_mul_ps(rotation, scale));
+    };
+    store(0, _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx);
+    store(1, _mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx);
+    store(2, _mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx);
+    store(3, _mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy);
+    store(4, _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy);
+    store(5, _mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy);
+    store(6, _mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz);
+    store(7, _mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz);
+    store(8, _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz);
+    _mm256_storeu_ps(out.m[9], _mm256_loadu_ps(in.px));
+    _mm256_storeu_ps(out.m[10], _mm256_loadu_ps(in.py));
+    _mm256_storeu_ps(out.m[11], _mm256_loadu_ps(in.pz));
+  }
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+// internal interface between UpdateModels and its per-ISA kernels
+namespace detail
+{
+  constexpr uint32_t transformLanes = 8;
+
+  // a batch of transforms, one array per component and one lane per transform. Unused lanes hold the identity
+  struct TransformLanes
+  {
+    float px[transformLanes];
+    float py[transformLanes];
+    float pz[transformLanes];
+    float sx[transformLanes];
+    float sy[transformLanes];
+    float sz[transformLanes];
+    float qw[transformLanes];
+    float qx[transformLanes];
+    float qy[transformLanes];
+    float qz[transformLanes];
+  };
+
+  // the upper three rows of each lane's translate * rotate * scale, column major. The last row is always 0, 0, 0, 1
+  struct ModelLanes
+  {
+    float m[12][transformLanes];
+  };
+
+  // every kernel computes bit-identical results
+  void ComputeModelsScalar(const TransformLanes& in, ModelLanes& out);
+#ifdef ENGINE_AVX2
+  void ComputeModelsAVX2(const TransformLanes& in, ModelLanes& out);
+#endif
+}
\ No newline at end of file
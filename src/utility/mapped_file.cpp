@@ -0,0 +1,213 @@
+#include "mapped_file.h"
+
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  std::string LastError()
+  {
+#ifdef _WIN32
+    return std::format("error {}", GetLastError());
+#else
+    return std::strerror(errno);
+#endif
+  }
+}
+
+MappedFile::View& MappedFile::View::operator=(View&& other) noexcept
+{
+  if (this != &other)
+  {
+    Unmap();
+    base_ = std::exchange(other.base_, nullptr);
+    mapSize_ = std::exchange(other.mapSize_, 0);
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+MappedFile::View::~View()
+{
+  Unmap();
+}
+
+void MappedFile::View::Unmap()
+{
+  if (!base_)
+  {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(base_);
+#else
+  munmap(base_, mapSize_);
+#endif
+  base_ = nullptr;
+  data_ = nullptr;
+}
+
+void MappedFile::View::Flush() const
+{
+  if (!base_)
+  {
+    return;
+  }
+#ifdef _WIN32
+  FlushViewOfFile(base_, mapSize_);
+#else
+  msync(base_, mapSize_, MS_SYNC);
+#endif
+}
+
+MappedFile::MappedFile(const std::string& path, Mode mode, uint64_t size)
+  : mode_(mode)
+{
+#ifdef _WIN32
+  const DWORD access = mode == Mode::READ ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE;
+  const DWORD disposition = mode == Mode::CREATE ? CREATE_ALWAYS : OPEN_EXISTING;
+  file_ = CreateFileA(path.c_str(), access, FILE_SHARE_READ, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE)
+  {
+    throw std::runtime_error(std::format("failed to open '{}': {}", path, LastError()));
+  }
+
+  if (mode == Mode::CREATE)
+  {
+    LARGE_INTEGER end{};
+    end.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFilePointerEx(file_, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file_))
+    {
+      CloseHandle(file_);
+      throw std::runtime_error(std::format("failed to resize '{}': {}", path, LastError()));
+    }
+    size_ = size;
+  }
+  else
+  {
+    LARGE_INTEGER fileSize{};
+    GetFileSizeEx(file_, &fileSize);
+    size_ = static_cast<uint64_t>(fileSize.QuadPart);
+  }
+
+  // a mapping of an empty file fails, and there is nothing to map anyway
+  if (size_ > 0)
+  {
+    mapping_ = CreateFileMappingA(file_, nullptr, mode == Mode::READ ? PAGE_READONLY : PAGE_READWRITE, 0, 0, nullptr);
+    if (!mapping_)
+    {
+      CloseHandle(file_);
+      throw std::runtime_error(std::format("failed to map '{}': {}", path, LastError()));
+    }
+  }
+#else
+  const int flags = mode == Mode::READ ? O_RDONLY : mode == Mode::READ_WRITE ? O_RDWR : O_RDWR | O_CREAT | O_TRUNC;
+  fd_ = open(path.c_str(), flags, 0644);
+  if (fd_ < 0)
+  {
+    throw std::runtime_error(std::format("failed to open '{}': {}", path, LastError()));
+  }
+
+  if (mode == Mode::CREATE)
+  {
+    // the file is sparse until written, so creating a huge store is cheap
+    if (ftruncate(fd_, static_cast<off_t>(size)) != 0)
+    {
+      close(fd_);
+      throw std::runtime_error(std::format("failed to resize '{}': {}", path, LastError()));
+    }
+    size_ = size;
+  }
+  else
+  {
+    struct stat st{};
+    fstat(fd_, &st);
+    size_ = static_cast<uint64_t>(st.st_size);
+  }
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+  if (mapping_)
+  {
+    CloseHandle(mapping_);
+  }
+  CloseHandle(file_);
+#else
+  close(fd_);
+#endif
+}
+
+void MappedFile::Sync() const
+{
+#ifdef _WIN32
+  const bool synced = FlushFileBuffers(file_);
+#else
+  const bool synced = fsync(fd_) == 0;
+#endif
+  if (!synced)
+  {
+    throw std::runtime_error(std::format("failed to sync file: {}", LastError()));
+  }
+}
+
+uint64_t MappedFile::Granularity()
+{
+#ifdef _WIN32
+  SYSTEM_INFO info{};
+  GetSystemInfo(&info);
+  return info.dwAllocationGranularity;
+#else
+  return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+MappedFile::View MappedFile::Map(uint64_t offset, size_t size) const
+{
+  if (size == 0 || offset + size > size_)
+  {
+    throw std::runtime_error(std::format("mapping [{}, {}) is outside the file of {} bytes", offset, offset + size, size_));
+  }
+
+  const uint64_t alignedOffset = offset - offset % Granularity();
+  const size_t mapSize = size + static_cast<size_t>(offset - alignedOffset);
+
+  View view;
+#ifdef _WIN32
+  const DWORD access = mode_ == Mode::READ ? FILE_MAP_READ : FILE_MAP_WRITE;
+  view.base_ = MapViewOfFile(mapping_, access, static_cast<DWORD>(alignedOffset >> 32), static_cast<DWORD>(alignedOffset), mapSize);
+  if (!view.base_)
+  {
+    throw std::runtime_error(std::format("failed to map view: {}", LastError()));
+  }
+#else
+  const int protection = mode_ == Mode::READ ? PROT_READ : PROT_READ | PROT_WRITE;
+  void* base = mmap(nullptr, mapSize, protection, MAP_SHARED, fd_, static_cast<off_t>(alignedOffset));
+  if (base == MAP_FAILED)
+  {
+    throw std::runtime_error(std::format("failed to map view: {}", LastError()));
+  }
+  view.base_ = base;
+#endif
+  view.mapSize_ = mapSize;
+  view.data_ = static_cast<std::byte*>(view.base_) + (offset - alignedOffset);
+  view.size_ = size;
+  return view;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "../macros.h"
+
+// a file whose contents are accessed through memory-mapped views, so the OS pages data in and out as needed
+class MappedFile
+{
+public:
+  enum class Mode
+  {
+    READ,
+    READ_WRITE,
+    CREATE,       // creates or truncates the file and sets it to the requested size, read-write
+  };
+
+  // a mapped range of the file, unmapped on destruction
+  class View
+  {
+  public:
+    View() = default;
+    View(View&& other) noexcept { *this = std::move(other); }
+    View& operator=(View&& other) noexcept;
+    ~View();
+
+    NOCOPY(View)
+
+    [[nodiscard]] std::byte* Data() const { return data_; }
+    [[nodiscard]] size_t Size() const { return size_; }
+
+    // writes modified pages back to the file
+    void Flush() const;
+
+  private:
+    friend class MappedFile;
+    void Unmap();
+
+    void* base_{};       // start of the mapping, which may be before data_ to satisfy the alignment of the offset
+    size_t mapSize_{};
+    std::byte* data_{};
+    size_t size_{};
+  };
+
+  // throws std::runtime_error if the file can't be opened or resized
+  MappedFile(const std::string& path, Mode mode, uint64_t size = 0);
+  ~MappedFile();
+
+  NOCOPY_NOMOVE(MappedFile)
+
+  [[nodiscard]] uint64_t Size() const { return size_; }
+  [[nodiscard]] bool Writable() const { return mode_ != Mode::READ; }
+
+  // maps [offset, offset + size). Any offset works, but multiples of Granularity() avoid mapping extra bytes
+  [[nodiscard]] View Map(uint64_t offset, size_t size) const;
+
+  // waits until everything written to the file, through views or otherwise, is on the storage device
+  void Sync() const;
+
+  [[nodiscard]] static uint64_t Granularity();
+
+private:
+  Mode mode_;
+  uint64_t size_{};
+#ifdef _WIN32
+  void* file_{};
+  void* mapping_{};
+#else
+  int fd_ = -1;
+#endif
+};
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "thread_pool.h"
+
+// scratch space for RadixSortPairs, kept between sorts so they do not allocate
+struct RadixSortScratch
+{
+  std::vector<uint64_t> keys;
+  std::vector<uint32_t> values;
+  std::vector<std::array<uint32_t, 256>> histograms;
+  std::vector<std::array<uint64_t, 2>> bits;
+};
+
+// stable sort of keys in ascending order, carrying values along. Each thread of the pool histograms and scatters its
+// own contiguous chunk, a byte of the key per pass, and bytes that are the same in every key are skipped
+inline void RadixSortPairs(std::span<uint64_t> keys, std::span<uint32_t> values, RadixSortScratch& scratch, ThreadPool& pool)
+{
+  constexpr size_t minChunk = 4096;
+  const size_t count = keys.size();
+  if (count <= 1)
+  {
+    return;
+  }
+
+  const auto numChunks = static_cast<uint32_t>(std::clamp<size_t>(count / minChunk, 1, pool.NumThreads()));
+  const size_t chunkSize = (count + numChunks - 1) / numChunks;
+  scratch.keys.resize(count);
+  scratch.values.resize(count);
+  scratch.histograms.resize(numChunks);
+
+  // the bits that differ between any two keys: those set in some key but not in all of them
+  scratch.bits.resize(numChunks);
+  pool.ParallelFor(numChunks, [&](uint32_t chunk)
+    {
+      const size_t end = std::min((chunk + 1) * chunkSize, count);
+      uint64_t all = ~0ull;
+      uint64_t any = 0;
+      for (size_t i = chunk * chunkSize; i < end; i++)
+      {
+        all &= keys[i];
+        any |= keys[i];
+      }
+      scratch.bits[chunk] = { all, any };
+    });
+  uint64_t all = ~0ull;
+  uint64_t any = 0;
+  for (const auto& [chunkAll, chunkAny] : scratch.bits)
+  {
+    all &= chunkAll;
+    any |= chunkAny;
+  }
+  const uint64_t differing = any & ~all;
+
+  std::span<uint64_t> srcKeys = keys;
+  std::span<uint32_t> srcValues = values;
+  std::span<uint64_t> dstKeys = scratch.keys;
+  std::span<uint32_t> dstValues = scratch.values;
+  for (uint32_t shift = 0; shift < 64; shift += 8)
+  {
+    if (((differing >> shift) & 0xFF) == 0)
+    {
+      continue;
+    }
+
+    pool.ParallelFor(numChunks, [&](uint32_t chunk)
+      {
+        auto& histogram = scratch.histograms[chunk];
+        histogram.fill(0);
+        const size_t end = std::min((chunk + 1) * chunkSize, count);
+        for (size_t i = chunk * chunkSize; i < end; i++)
+        {
+          histogram[(srcKeys[i] >> shift) & 0xFF]++;
+        }
+      });
+
+    // every chunk writes a digit's keys after those of the same digit from earlier chunks, which keeps the sort stable
+    uint32_t offset = 0;
+    for (uint32_t digit = 0; digit < 256; digit++)
+    {
+      for (auto& histogram : scratch.histograms)
+      {
+        const uint32_t n = histogram[digit];
+        histogram[digit] = offset;
+        offset += n;
+      }
+    }
+
+    pool.ParallelFor(numChunks, [&](uint32_t chunk)
+      {
+        auto& next = scratch.histograms[chunk];
+        const size_t end = std::min((chunk + 1) * chunkSize, count);
+        for (size_t i = chunk * chunkSize; i < end; i++)
+        {
+          const uint32_t slot = next[(srcKeys[i] >> shift) & 0xFF]++;
+          dstKeys[slot] = srcKeys[i];
+          dstValues[slot] = srcValues[i];
+        }
+      });
+
+    std::swap(srcKeys, dstKeys);
+    std::swap(srcValues, dstValues);
+  }
+
+  if (srcKeys.data() != keys.data())
+  {
+    std::copy(srcKeys.begin(), srcKeys.end(), keys.begin());
+    std::copy(srcValues.begin(), srcValues.end(), values.begin());
+  }
+}
\ No newline at end of file
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../macros.h"
+
+// fixed set of workers that cooperatively run the iterations of a ParallelFor
+// the calling thread takes part in the work, so a pool of N threads spawns N - 1 workers
+class ThreadPool
+{
+public:
+  explicit ThreadPool(uint32_t numThreads = std::thread::hardware_concurrency())
+  {
+    for (uint32_t i = 1; i < numThreads; i++)
+    {
+      workers_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+    }
+    wakeCv_.notify_all();
+    for (auto& worker : workers_)
+    {
+      worker.join();
+    }
+  }
+
+  NOCOPY_NOMOVE(ThreadPool)
+
+  [[nodiscard]] uint32_t NumThreads() const { return static_cast<uint32_t>(workers_.size()) + 1; }
+
+  // runs fn(i) for every i in [0, count) and returns once all of them have finished. If any iteration throws, the
+  // iterations not yet started are skipped and the first exception is rethrown on the calling thread
+  void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& fn)
+  {
+    ParallelFor(count, [&fn](uint32_t i, uint32_t) { fn(i); });
+  }
+
+  // the same, but also passes the index in [0, NumThreads()) of the thread running the iteration, so iterations can
+  // reuse scratch data per thread. The calling thread is 0
+  void ParallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& fn)
+  {
+    if (workers_.empty() || count <= 1)
+    {
+      for (uint32_t i = 0; i < count; i++)
+      {
+        fn(i, 0);
+      }
+      return;
+    }
+
+    {
+      // workers that woke up late for the previous job may still be looking at it
+      std::unique_lock lock(mutex_);
+      doneCv_.wait(lock, [this] { return active_ == 0; });
+      job_ = &fn;
+      count_ = count;
+      next_.store(0);
+      error_ = nullptr;
+      generation_++;
+      active_++;
+    }
+    wakeCv_.notify_all();
+
+    Drain(0);
+
+    std::unique_lock lock(mutex_);
+    active_--;
+    doneCv_.wait(lock, [this] { return active_ == 0; });
+    job_ = nullptr;
+    if (error_)
+    {
+      std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+  }
+
+private:
+  // never throws, so every thread that took part always reaches the active_ bookkeeping after it
+  void Drain(uint32_t thread) noexcept
+  {
+    for (uint32_t i = next_.fetch_add(1); i < count_; i = next_.fetch_add(1))
+    {
+      try
+      {
+        (*job_)(i, thread);
+      }
+      catch (...)
+      {
+        std::lock_guard lock(mutex_);
+        if (!error_)
+        {
+          error_ = std::current_exception();
+        }
+        // nobody starts another iteration of this job
+        next_.store(count_);
+      }
+    }
+  }
+
+  void WorkerLoop(uint32_t thread)
+  {
+    uint64_t seenGeneration = 0;
+    for (;;)
+    {
+      {
+        std::unique_lock lock(mutex_);
+        wakeCv_.wait(lock, [&] { return stop_ || generation_ != seenGeneration; });
+        if (stop_)
+        {
+          return;
+        }
+        seenGeneration = generation_;
+        active_++;
+      }
+
+      Drain(thread);
+
+      {
+        std::lock_guard lock(mutex_);
+        active_--;
+      }
+      doneCv_.notify_all();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wakeCv_;
+  std::condition_variable doneCv_;
+
+  // job state, only written while no thread is active
+  const std::function<void(uint32_t, uint32_t)>* job_{};
+  uint32_t count_{};
+  std::atomic_uint32_t next_{ 0 };
+  std::exception_ptr error_;
+
+  uint64_t generation_{};
+  uint32_t active_{};
+  bool stop_{};
+};
+
+// splits [0, height) into bands of bandRows rows and runs fn(y0, y1) for each of them on the pool
+template<typename Fn>
+void ForEachBand(ThreadPool& pool, uint32_t height, uint32_t bandRows, Fn&& fn)
+{
+  const uint32_t numBands = (height + bandRows - 1) / bandRows;
+  pool.ParallelFor(numBands, [&](uint32_t band)
+    {
+      fn(band * bandRows, std::min(band * bandRows + bandRows, height));
+    });
+}
\ No newline at end of file
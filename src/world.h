@@ -32,8 +32,8 @@ struct World
   Game::GameObject& MakeSphere(glm::vec3 pos, float scale)
   {
     Game::GameObject& obj = entityManager.GetObject(entityManager.CreateEntity());
-    obj.transform.position = pos;
-    obj.transform.scale = glm::vec3(scale);
+    obj.transform.SetPosition(pos);
+    obj.transform.SetScale(glm::vec3(scale));
     obj.mesh = sphereMeshHandle;
     obj.renderable.visible = true;
     return obj;
@@ -42,8 +42,8 @@ struct World
   Game::GameObject& MakeBox(glm::vec3 pos, glm::vec3 halfExtents)
   {
     Game::GameObject& obj = entityManager.GetObject(entityManager.CreateEntity());
-    obj.transform.position = pos;
-    obj.transform.scale = glm::vec3(halfExtents);
+    obj.transform.SetPosition(pos);
+    obj.transform.SetScale(glm::vec3(halfExtents));
     obj.mesh = cubeMeshHandle;
     obj.renderable.visible = true;
     return obj;
@@ -0,0 +1,573 @@
+#include <iostream>
+#include <format>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <variant>
+#include <algorithm>
+#include <type_traits>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+#include "sim/erosion.h"
+#include "sim/tiled_simulation.h"
+#include "sim/export.h"
+#include "sim/flow.h"
+#include "sim/terrain.h"
+#include "utility/thread_pool.h"
+
+namespace
+{
+  struct Param
+  {
+    std::string_view name;
+    std::variant<uint32_t*, int32_t*, float*> value;
+  };
+
+  std::vector<Param> ParamTable(Erosion::SimulationCreateInfo& info)
+  {
+    auto& d = info.droplet;
+    auto& g = info.grid;
+    auto& t = info.thermal;
+    auto& n = info.terrain;
+    auto& m = info.multires;
+    return
+    {
+      { "droplet.dropletsPerUpdate", &d.dropletsPerUpdate },
+      { "droplet.maxLifetime", &d.maxLifetime },
+      { "droplet.brushRadius", &d.brushRadius },
+      { "droplet.inertia", &d.inertia },
+      { "droplet.sedimentCapacityFactor", &d.sedimentCapacityFactor },
+      { "droplet.minSedimentCapacity", &d.minSedimentCapacity },
+      { "droplet.erodeSpeed", &d.erodeSpeed },
+      { "droplet.depositSpeed", &d.depositSpeed },
+      { "droplet.evaporateSpeed", &d.evaporateSpeed },
+      { "droplet.gravity", &d.gravity },
+      { "droplet.initialWater", &d.initialWater },
+      { "droplet.initialSpeed", &d.initialSpeed },
+      { "grid.stepsPerUpdate", &g.stepsPerUpdate },
+      { "grid.timeStep", &g.timeStep },
+      { "grid.rainRate", &g.rainRate },
+      { "grid.pipeArea", &g.pipeArea },
+      { "grid.gravity", &g.gravity },
+      { "grid.sedimentCapacity", &g.sedimentCapacity },
+      { "grid.dissolveRate", &g.dissolveRate },
+      { "grid.depositRate", &g.depositRate },
+      { "grid.evaporationRate", &g.evaporationRate },
+      { "grid.minTilt", &g.minTilt },
+      { "grid.maxErosionDepth", &g.maxErosionDepth },
+      { "thermal.interval", &t.interval },
+      { "thermal.iterations", &t.iterations },
+      { "thermal.talus", &t.talus },
+      { "thermal.rate", &t.rate },
+      { "terrain.octaves", &n.octaves },
+      { "terrain.frequency", &n.frequency },
+      { "terrain.lacunarity", &n.lacunarity },
+      { "terrain.gain", &n.gain },
+      { "terrain.height", &n.height },
+      { "terrain.warp", &n.warp },
+      { "terrain.warpFrequency", &n.warpFrequency },
+      { "terrain.warpOctaves", &n.warpOctaves },
+      { "multires.levels", &m.levels },
+      { "multires.updatesPerLevel", &m.updatesPerLevel },
+      { "multires.syncInterval", &m.syncInterval },
+    };
+  }
+
+  // name=value, where name is one of ParamTable
+  void SetParam(Erosion::SimulationCreateInfo& info, std::string_view assignment)
+  {
+    const size_t eq = assignment.find('=');
+    if (eq == std::string_view::npos)
+    {
+      throw std::runtime_error(std::format("expected name=value, got '{}'", assignment));
+    }
+
+    const std::string_view name = assignment.substr(0, eq);
+    const std::string value(assignment.substr(eq + 1));
+    for (const Param& param : ParamTable(info))
+    {
+      if (param.name == name)
+      {
+        std::visit([&](auto* ptr)
+          {
+            using T = std::remove_pointer_t<decltype(ptr)>;
+            if constexpr (std::is_same_v<T, float>)
+            {
+              *ptr = std::stof(value);
+            }
+            else if constexpr (std::is_same_v<T, int32_t>)
+            {
+              *ptr = static_cast<int32_t>(std::stol(value));
+            }
+            else
+            {
+              *ptr = static_cast<uint32_t>(std::stoul(value));
+            }
+          }, param.value);
+        return;
+      }
+    }
+
+    throw std::runtime_error(std::format("unknown parameter '{}'", name));
+  }
+
+  Erosion::ErosionMode ParseMode(std::string_view mode)
+  {
+    if (mode == "droplet")
+    {
+      return Erosion::ErosionMode::DROPLET;
+    }
+    if (mode == "grid")
+    {
+      return Erosion::ErosionMode::GRID;
+    }
+    throw std::runtime_error(std::format("unknown mode '{}'", mode));
+  }
+
+  Erosion::TerrainShape ParseTerrain(std::string_view shape)
+  {
+    for (auto candidate : { Erosion::TerrainShape::RADIAL, Erosion::TerrainShape::FBM, Erosion::TerrainShape::RIDGED })
+    {
+      if (shape == Erosion::ToString(candidate))
+      {
+        return candidate;
+      }
+    }
+    throw std::runtime_error(std::format("unknown terrain '{}'", shape));
+  }
+
+  Erosion::FlowMethod ParseFlowMethod(std::string_view method)
+  {
+    for (auto candidate : { Erosion::FlowMethod::D8, Erosion::FlowMethod::DINF })
+    {
+      if (method == Erosion::ToString(candidate))
+      {
+        return candidate;
+      }
+    }
+    throw std::runtime_error(std::format("unknown flow method '{}'", method));
+  }
+
+  struct ExportRequest
+  {
+    std::string map;    // height, normals, flow or deposition
+    std::string path;
+  };
+
+  // map=path
+  ExportRequest ParseExport(std::string_view request)
+  {
+    const size_t eq = request.find('=');
+    if (eq == std::string_view::npos)
+    {
+      throw std::runtime_error(std::format("expected map=path, got '{}'", request));
+    }
+
+    ExportRequest result{ std::string(request.substr(0, eq)), std::string(request.substr(eq + 1)) };
+    if (result.map != "height" && result.map != "normals" && result.map != "flow" && result.map != "deposition")
+    {
+      throw std::runtime_error(std::format("unknown map '{}'", result.map));
+    }
+    return result;
+  }
+
+  // the heights and the terrain they started from are read in bands, the flow map needs the whole map in memory
+  struct ExportSources
+  {
+    uint32_t width{};
+    uint32_t height{};
+    uint32_t bandRows{};
+    Erosion::HeightBandFn current;
+    Erosion::HeightBandFn baseline;
+    const Erosion::Heightfield* map{};
+  };
+
+  void Export(const ExportRequest& request, const ExportSources& sources, float cellSize, const Erosion::FlowParams& flow, ThreadPool& pool)
+  {
+    const Erosion::ImageFormat format = Erosion::ImageFormatFromPath(request.path);
+    if (request.map == "height")
+    {
+      Erosion::WriteImage(request.path, format, Erosion::HeightImage(sources.width, sources.height, sources.current), pool, sources.bandRows);
+    }
+    else if (request.map == "normals")
+    {
+      Erosion::WriteImage(request.path, format, Erosion::NormalImage(sources.width, sources.height, sources.current, cellSize), pool, sources.bandRows);
+    }
+    else if (request.map == "deposition")
+    {
+      Erosion::WriteImage(request.path, format, Erosion::DepositionImage(sources.width, sources.height, sources.current, sources.baseline), pool, sources.bandRows);
+    }
+    else
+    {
+      Erosion::FlowRouter router(sources.width, sources.height, flow);
+      router.Compute(*sources.map, pool);
+      Erosion::WriteImage(request.path, format, Erosion::FlowImage(router.Accumulation()), pool, sources.bandRows);
+    }
+  }
+
+  void PrintUsage()
+  {
+    std::cout <<
+      "usage: erosion_bake [options]\n"
+      "  --size N          map width and height (default 512)\n"
+      "  --width N         map width\n"
+      "  --height N        map height\n"
+      "  --seed N          random seed (default 0)\n"
+      "  --iterations N    simulation updates to run (default 100)\n"
+      "  --mode M          droplet or grid (default droplet)\n"
+      "  --terrain T       initial terrain: radial, fbm or ridged (default fbm)\n"
+      "  --threads N       worker threads including the main one (default: all cores)\n"
+      "  --tile-size N     droplet tile size (default 64)\n"
+      "  --set name=value  overrides a parameter, e.g. droplet.erodeSpeed=0.5 or thermal.interval=0. multires.levels=N\n"
+      "                    starts N - 1 halvings of the resolution below the map and spends multires.updatesPerLevel\n"
+      "                    of the --iterations on each of them\n"
+      "  --list-params     prints the parameters --set accepts and their defaults\n"
+      "  --out PATH        heightmap output, the same as --export height=PATH (default out.r32)\n"
+      "  --export MAP=PATH also writes MAP, one of height, normals, flow or deposition, to PATH. The extension picks\n"
+      "                    the format: .png for 16-bit PNG, .pgm for 16-bit PGM, .r16 or .raw for raw 16-bit,\n"
+      "                    .tif or .tiff for float TIFF, anything else for raw floats. 16-bit formats are scaled to the\n"
+      "                    value range. Can be repeated. flow needs the whole map in memory and does not work with --tiled\n"
+      "  --cell-size F     spacing of the cells in height units for the normals (default 1 / width, as rendered)\n"
+      "  --flow-method M   routing of the flow map: d8 sends each cell's water to its steepest neighbor, dinf splits\n"
+      "                    it between two (default d8). Depressions are filled first, so rivers run through lakes\n"
+      "  --no-fill         leaves depressions unfilled for the flow map, water stops in every pit\n"
+      "  --quiet           no progress output\n"
+      "  --tiled PATH      keeps the map in tiles in a file at PATH and erodes it tile by tile, for maps larger\n"
+      "                    than memory. Only the droplet mode is supported\n"
+      "  --store-tile N    tile size of --tiled, a multiple of 128 (default 512)\n"
+      "  --halo N          cells loaded around each tile of --tiled (default 32)\n"
+      "  --resident N      tiles of --tiled kept in memory (default 64)\n"
+      "  --checkpoint PATH saves the simulation state to PATH when done and every --checkpoint-every iterations\n"
+      "  --checkpoint-every N  iterations between checkpoints (default 0, only at the end)\n"
+      "  --compress-checkpoint  delta and run-length codes checkpoint fields, smaller but slower to write\n"
+      "  --resume PATH     continues from a checkpoint instead of generating the terrain. --iterations counts\n"
+      "                    from the start, so a resumed run ends where the uninterrupted one would have\n";
+  }
+}
+
+// runs the simulation without a window or GL context and writes the result to disk, see PrintUsage for the options
+auto main(int argc, char** argv) -> int
+{
+  Erosion::SimulationCreateInfo info{ .width = 512, .height = 512 };
+  uint64_t seed = 0;
+  uint64_t iterations = 100;
+  std::string outPath = "out.r32";
+  bool quiet = false;
+  std::string tiledPath;
+  Erosion::TiledSimulationCreateInfo tiledInfo{};
+  std::string checkpointPath;
+  uint64_t checkpointEvery = 0;
+  Erosion::CheckpointCompression checkpointCompression = Erosion::CheckpointCompression::NONE;
+  std::string resumePath;
+  std::vector<ExportRequest> exports;
+  float cellSize = 0;
+  Erosion::FlowParams flow{};
+
+  try
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      const std::string_view arg = argv[i];
+      auto next = [&]() -> std::string
+      {
+        if (i + 1 >= argc)
+        {
+          throw std::runtime_error(std::format("missing value for {}", arg));
+        }
+        return argv[++i];
+      };
+
+      if (arg == "--size")
+      {
+        info.width = info.height = static_cast<uint32_t>(std::stoul(next()));
+      }
+      else if (arg == "--width")
+      {
+        info.width = static_cast<uint32_t>(std::stoul(next()));
+      }
+      else if (arg == "--height")
+      {
+        info.height = static_cast<uint32_t>(std::stoul(next()));
+      }
+      else if (arg == "--seed")
+      {
+        seed = std::stoull(next());
+      }
+      else if (arg == "--iterations")
+      {
+        iterations = std::stoull(next());
+      }
+      else if (arg == "--mode")
+      {
+        info.mode = ParseMode(next());
+      }
+      else if (arg == "--terrain")
+      {
+        info.terrain.shape = ParseTerrain(next());
+      }
+      else if (arg == "--threads")
+      {
+        info.numThreads = std::max(static_cast<uint32_t>(std::stoul(next())), 1u);
+      }
+      else if (arg == "--tile-size")
+      {
+        info.tileSize = static_cast<uint32_t>(std::stoul(next()));
+      }
+      else if (arg == "--set")
+      {
+        SetParam(info, next());
+      }
+      else if (arg == "--list-params")
+      {
+        for (const Param& param : ParamTable(info))
+        {
+          std::visit([&](auto* ptr) { std::cout << std::format("{} = {}\n", param.name, *ptr); }, param.value);
+        }
+        return 0;
+      }
+      else if (arg == "--out")
+      {
+        outPath = next();
+      }
+      else if (arg == "--export")
+      {
+        exports.push_back(ParseExport(next()));
+      }
+      else if (arg == "--cell-size")
+      {
+        cellSize = std::stof(next());
+      }
+      else if (arg == "--flow-method")
+      {
+        flow.method = ParseFlowMethod(next());
+      }
+      else if (arg == "--no-fill")
+      {
+        flow.fillDepressions = false;
+      }
+      else if (arg == "--tiled")
+      {
+        tiledPath = next();
+      }
+      else if (arg == "--store-tile")
+      {
+        tiledInfo.tileSize = static_cast<uint32_t>(std::stoul(next()));
+      }
+      else if (arg == "--halo")
+      {
+        tiledInfo.halo = static_cast<uint32_t>(std::stoul(next()));
+      }
+      else if (arg == "--resident")
+      {
+        tiledInfo.maxResidentTiles = static_cast<uint32_t>(std::stoul(next()));
+      }
+      else if (arg == "--checkpoint")
+      {
+        checkpointPath = next();
+      }
+      else if (arg == "--checkpoint-every")
+      {
+        checkpointEvery = std::stoull(next());
+      }
+      else if (arg == "--compress-checkpoint")
+      {
+        checkpointCompression = Erosion::CheckpointCompression::DELTA_RLE;
+      }
+      else if (arg == "--resume")
+      {
+        resumePath = next();
+      }
+      else if (arg == "--quiet")
+      {
+        quiet = true;
+      }
+      else if (arg == "--help" || arg == "-h")
+      {
+        PrintUsage();
+        return 0;
+      }
+      else
+      {
+        throw std::runtime_error(std::format("unknown argument '{}'", arg));
+      }
+    }
+
+    if (info.width < 2 || info.height < 2)
+    {
+      throw std::runtime_error("the map must be at least 2x2");
+    }
+    if (!tiledPath.empty() && info.mode != Erosion::ErosionMode::DROPLET)
+    {
+      throw std::runtime_error("--tiled only supports the droplet mode");
+    }
+    if (!tiledPath.empty() && std::any_of(exports.begin(), exports.end(), [](const ExportRequest& e) { return e.map == "flow"; }))
+    {
+      throw std::runtime_error("the flow map needs the whole map in memory and does not work with --tiled");
+    }
+    if (!tiledPath.empty() && (!checkpointPath.empty() || !resumePath.empty()))
+    {
+      throw std::runtime_error("--tiled keeps its state in its tile file, --checkpoint and --resume do not apply");
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << std::format("error: {}\n", e.what());
+    PrintUsage();
+    return 2;
+  }
+
+  exports.insert(exports.begin(), { "height", outPath });
+  if (cellSize <= 0)
+  {
+    cellSize = 1.0f / static_cast<float>(info.width);
+  }
+
+  try
+  {
+    ThreadPool pool(info.numThreads);
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t reportEvery = std::max<uint64_t>(iterations / 10, 1);
+    auto report = [&](uint64_t i)
+    {
+      if (!quiet && (i + 1) % reportEvery == 0)
+      {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("{}/{} iterations, {:.2f} s\n", i + 1, iterations, seconds);
+      }
+    };
+
+    if (tiledPath.empty())
+    {
+      Erosion::Simulation simulation(info);
+      if (resumePath.empty())
+      {
+        simulation.Init(seed);
+      }
+      else
+      {
+        simulation.LoadCheckpoint(resumePath);
+        if (!quiet)
+        {
+          std::cout << std::format("resumed at iteration {}\n", simulation.GetIteration());
+        }
+      }
+
+      auto checkpoint = [&]()
+      {
+        const auto checkpointStart = std::chrono::steady_clock::now();
+        simulation.SaveCheckpoint(checkpointPath, checkpointCompression);
+        if (!quiet)
+        {
+          const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - checkpointStart).count();
+          std::cout << std::format("checkpoint at iteration {}, {:.1f} ms\n", simulation.GetIteration(), ms);
+        }
+      };
+
+      for (uint64_t i = simulation.GetIteration(); i < iterations; i++)
+      {
+        // the time step only gates pausing, each update advances the simulation by a fixed amount
+        simulation.Update(1.0);
+        report(i);
+        if (!checkpointPath.empty() && checkpointEvery > 0 && (i + 1) % checkpointEvery == 0 && i + 1 < iterations && simulation.GetLevel() == 0)
+        {
+          checkpoint();
+        }
+      }
+      if (!checkpointPath.empty())
+      {
+        if (simulation.GetLevel() > 0)
+        {
+          throw std::runtime_error("the run ended on a coarse level, which can't be checkpointed");
+        }
+        checkpoint();
+      }
+
+      const Erosion::Heightfield& map = simulation.GetHeightfield();
+      const ExportSources sources
+      {
+        .width = info.width,
+        .height = info.height,
+        .bandRows = 256,
+        .current = [&](uint32_t y0, Erosion::Heightfield& band)
+        {
+          for (uint32_t y = 0; y < band.height; y++)
+          {
+            std::memcpy(band.Row(y), map.Row(y0 + y), info.width * sizeof(float));
+          }
+        },
+        .baseline = [&](uint32_t y0, Erosion::Heightfield& band)
+        {
+          Erosion::GenerateTerrain(band, info.terrain, simulation.GetSeed(), pool, { 0, y0, info.width, info.height });
+        },
+        .map = &map,
+      };
+      for (const ExportRequest& request : exports)
+      {
+        Export(request, sources, cellSize, flow, pool);
+      }
+    }
+    else
+    {
+      tiledInfo.width = info.width;
+      tiledInfo.height = info.height;
+      tiledInfo.path = tiledPath;
+      tiledInfo.terrain = info.terrain;
+      tiledInfo.droplet = info.droplet;
+      tiledInfo.thermal = info.thermal;
+      tiledInfo.dropletBackend = info.dropletBackend;
+      tiledInfo.numThreads = info.numThreads;
+
+      Erosion::TiledSimulation simulation(tiledInfo);
+      simulation.Init(seed);
+      for (uint64_t i = 0; i < iterations; i++)
+      {
+        simulation.Update();
+        report(i);
+      }
+
+      Erosion::TileStore& store = simulation.Store();
+      const ExportSources sources
+      {
+        .width = info.width,
+        .height = info.height,
+        .bandRows = store.TileSize(),
+        .current = [&](uint32_t y0, Erosion::Heightfield& band)
+        {
+          store.Read({ 0, y0, info.width, y0 + band.height }, band);
+        },
+        .baseline = [&](uint32_t y0, Erosion::Heightfield& band)
+        {
+          Erosion::GenerateTerrain(band, info.terrain, seed, pool, { 0, y0, info.width, info.height });
+        },
+      };
+      for (const ExportRequest& request : exports)
+      {
+        Export(request, sources, cellSize, flow, pool);
+      }
+
+      if (!quiet)
+      {
+        const Erosion::TileStoreStats stats = store.Stats();
+        std::cout << std::format("{} tile maps, {} evictions, at most {} tiles resident\n", stats.maps, stats.evictions, stats.peakResident);
+      }
+    }
+
+    if (!quiet)
+    {
+      for (const ExportRequest& request : exports)
+      {
+        std::cout << std::format("wrote {}x{} {} map to {}\n", info.width, info.height, request.map, request.path);
+      }
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << std::format("error: {}\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,384 @@
+#include <iostream>
+#include <format>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <random>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include "gfx/erosion_compute.h"
+#include "gfx/culling.h"
+#include "sim/grid.h"
+#include "sim/thermal.h"
+#include "sim/terrain.h"
+#include "utility/thread_pool.h"
+
+// compares the grid and thermal compute shaders and InstanceCuller's GPU backend against their CPU versions
+namespace
+{
+  struct FieldDiff
+  {
+    double maxError{};   // largest difference between the two, as a fraction of the CPU field's range
+    double rmsError{};
+    float lo{};
+    float hi{};
+  };
+
+  FieldDiff Compare(const Erosion::Heightfield& cpu, const Erosion::Heightfield& gpu)
+  {
+    FieldDiff diff{ .lo = cpu.At(0, 0), .hi = cpu.At(0, 0) };
+    double maxAbs = 0;
+    double sumSquares = 0;
+    for (uint32_t y = 0; y < cpu.height; y++)
+    {
+      for (uint32_t x = 0; x < cpu.width; x++)
+      {
+        const double error = std::abs(static_cast<double>(cpu.At(x, y)) - gpu.At(x, y));
+        maxAbs = std::max(maxAbs, error);
+        sumSquares += error * error;
+        diff.lo = std::min(diff.lo, cpu.At(x, y));
+        diff.hi = std::max(diff.hi, cpu.At(x, y));
+      }
+    }
+
+    // fields that are all but constant, like the water early on, are compared in absolute terms
+    const double range = std::max(static_cast<double>(diff.hi) - diff.lo, 1e-6);
+    diff.maxError = maxAbs / range;
+    diff.rmsError = std::sqrt(sumSquares / (static_cast<double>(cpu.width) * cpu.height)) / range;
+    return diff;
+  }
+
+  struct CullDiff
+  {
+    uint32_t candidates{};
+    uint32_t drawn{};
+    uint32_t mismatches{};         // draws whose count or order differs between the GPU and CullCPU
+    uint32_t kernelMismatches{};   // the same between CullCPU's kernel and its scalar one
+    GFX::CullKernel kernel{};
+  };
+
+  // random objects in and around the view of a depth buffer with a few random occluders, split into draws of
+  // random meshes. Every draw goes through the GPU culling, the CPU culling and the CPU culling's scalar kernel, and the
+  // results have to be identical
+  CullDiff CompareCulling(uint64_t seed, uint32_t numObjects, bool occlusion, ThreadPool& pool)
+  {
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<float> unit(0, 1);
+
+    // odd sizes, so the pyramid's levels have rows and columns left over
+    constexpr int width = 301;
+    constexpr int height = 173;
+    const glm::mat4 viewProj = glm::perspective(glm::radians(60.0f), static_cast<float>(width) / height, 0.1f, 200.0f) *
+      glm::lookAt(glm::vec3(0, 2, 0), glm::vec3(0, 2, -1), glm::vec3(0, 1, 0));
+
+    GLuint depth{};
+    GLuint framebuffer{};
+    glCreateTextures(GL_TEXTURE_2D, 1, &depth);
+    glTextureStorage2D(depth, 1, GL_DEPTH24_STENCIL8, width, height);
+    glCreateFramebuffers(1, &framebuffer);
+    glNamedFramebufferTexture(framebuffer, GL_DEPTH_STENCIL_ATTACHMENT, depth, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+    glClearDepth(1.0);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_SCISSOR_TEST);
+    for (int i = 0; i < 6; i++)
+    {
+      glScissor(static_cast<GLint>(unit(rng) * width), static_cast<GLint>(unit(rng) * height),
+        static_cast<GLsizei>(unit(rng) * width / 2) + 1, static_cast<GLsizei>(unit(rng) * height / 2) + 1);
+      glClearDepth(0.985 + 0.015 * unit(rng));
+      glClear(GL_DEPTH_BUFFER_BIT);
+    }
+    glDisable(GL_SCISSOR_TEST);
+    glClearDepth(1.0);
+
+    GFX::InstanceCuller culler;
+    GFX::InstanceCuller scalarCuller(GFX::CullKernel::SCALAR);
+    culler.CaptureDepth(viewProj);
+    scalarCuller.CaptureDepth(viewProj);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &depth);
+
+    std::vector<GFX::InstanceData> instances(numObjects);
+    for (GFX::InstanceData& instance : instances)
+    {
+      const glm::vec3 position = { unit(rng) * 160 - 80, unit(rng) * 20 - 8, -unit(rng) * 190 + 10 };
+      const glm::vec3 scale = { 0.2f + 3 * unit(rng), 0.2f + 3 * unit(rng), 0.2f + 3 * unit(rng) };
+      instance =
+      {
+        .model = glm::scale(glm::translate(glm::mat4(1), position), scale),
+        .color = glm::vec4(1),
+        .glow = glm::vec3(0),
+        .flags = unit(rng) < 0.9f ? GFX::instanceVisible : 0,
+      };
+    }
+
+    // the candidates are a shuffled subset of the objects, each draw takes a run of them
+    std::vector<uint32_t> candidates(numObjects);
+    for (uint32_t i = 0; i < numObjects; i++)
+    {
+      candidates[i] = i;
+    }
+    std::shuffle(candidates.begin(), candidates.end(), rng);
+    candidates.resize(numObjects - numObjects / 8);
+
+    std::vector<GFX::DrawElementsIndirectCommand> draws;
+    std::vector<GFX::MeshBounds> bounds;
+    for (uint32_t start = 0; start < candidates.size();)
+    {
+      const uint32_t count = std::min(static_cast<uint32_t>(candidates.size()) - start, 1 + static_cast<uint32_t>(unit(rng) * 700));
+      draws.push_back({ .count = 36, .instanceCount = count, .firstIndex = 0, .baseVertex = 0, .baseInstance = start });
+      bounds.push_back(GFX::MeshBounds(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f, 0.5f + unit(rng)));
+      start += count;
+    }
+
+    const auto makeBuffer = [](const auto& data)
+    {
+      GLuint buffer{};
+      glCreateBuffers(1, &buffer);
+      glNamedBufferStorage(buffer, std::max<GLsizeiptr>(data.size() * sizeof(data[0]), 4), data.data(), GL_DYNAMIC_STORAGE_BIT);
+      return buffer;
+    };
+    const auto range = [](GLuint buffer, const auto& data) { return GFX::BufferRange{ buffer, 0, std::max<size_t>(data.size() * sizeof(data[0]), 4) }; };
+    std::vector<uint32_t> order(candidates.size(), UINT32_MAX);
+    GLuint buffers[] = { makeBuffer(instances), makeBuffer(candidates), makeBuffer(bounds), makeBuffer(draws), makeBuffer(order) };
+
+    const GFX::CullView view = culler.View(viewProj, occlusion);
+    culler.Cull(view,
+      {
+        .numDraws = static_cast<uint32_t>(draws.size()),
+        .instances = range(buffers[0], instances),
+        .candidates = range(buffers[1], candidates),
+        .bounds = range(buffers[2], bounds),
+        .draws = range(buffers[3], draws),
+        .drawOrder = range(buffers[4], order),
+      });
+    std::vector<GFX::DrawElementsIndirectCommand> gpuDraws(draws.size());
+    std::vector<uint32_t> gpuOrder(order.size());
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glGetNamedBufferSubData(buffers[3], 0, static_cast<GLsizeiptr>(gpuDraws.size() * sizeof(gpuDraws[0])), gpuDraws.data());
+    glGetNamedBufferSubData(buffers[4], 0, static_cast<GLsizeiptr>(gpuOrder.size() * sizeof(uint32_t)), gpuOrder.data());
+    glDeleteBuffers(5, buffers);
+
+    std::vector<GFX::DrawElementsIndirectCommand> scalarDraws = draws;
+    std::vector<uint32_t> scalarOrder = order;
+    culler.CullCPU(view,
+      {
+        .numDraws = static_cast<uint32_t>(draws.size()),
+        .instances = instances.data(),
+        .candidates = candidates.data(),
+        .bounds = bounds.data(),
+        .draws = draws.data(),
+        .drawOrder = order.data(),
+      }, pool);
+    scalarCuller.CullCPU(view,
+      {
+        .numDraws = static_cast<uint32_t>(scalarDraws.size()),
+        .instances = instances.data(),
+        .candidates = candidates.data(),
+        .bounds = bounds.data(),
+        .draws = scalarDraws.data(),
+        .drawOrder = scalarOrder.data(),
+      }, pool);
+
+    const auto differs = [&](const auto& otherDraws, const std::vector<uint32_t>& otherOrder, size_t d)
+    {
+      const uint32_t base = draws[d].baseInstance;
+      return otherDraws[d].instanceCount != draws[d].instanceCount ||
+        !std::equal(order.begin() + base, order.begin() + base + draws[d].instanceCount, otherOrder.begin() + base);
+    };
+    CullDiff diff{ .candidates = static_cast<uint32_t>(candidates.size()), .kernel = culler.Kernel() };
+    for (size_t d = 0; d < draws.size(); d++)
+    {
+      diff.drawn += draws[d].instanceCount;
+      diff.mismatches += differs(gpuDraws, gpuOrder, d) ? 1 : 0;
+      diff.kernelMismatches += differs(scalarDraws, scalarOrder, d) ? 1 : 0;
+    }
+    return diff;
+  }
+
+  void PrintUsage()
+  {
+    std::cout <<
+      "usage: gpu_parity [options]\n"
+      "  --size N          map width and height (default 256)\n"
+      "  --seed N          terrain seed (default 0)\n"
+      "  --updates N       simulation updates to compare after (default 20)\n"
+      "  --tolerance F     largest difference allowed, as a fraction of each field's range (default 1e-3)\n"
+      "  --objects N       objects to cull (default 20000)\n"
+      "exits with 1 if a field differs by more than the tolerance or the culled draws differ. Without a GPU, run it on Mesa's software rasterizer:\n"
+      "  LIBGL_ALWAYS_SOFTWARE=1 MESA_GL_VERSION_OVERRIDE=4.6 MESA_GLSL_VERSION_OVERRIDE=460 xvfb-run -a gpu_parity\n"
+      "the shaders are loaded from assets/shaders relative to the working directory\n";
+  }
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t size = 256;
+  uint64_t seed = 0;
+  uint32_t updates = 20;
+  double tolerance = 1e-3;
+  uint32_t objects = 20000;
+
+  try
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      const std::string_view arg = argv[i];
+      auto next = [&]() -> std::string
+      {
+        if (i + 1 >= argc)
+        {
+          throw std::runtime_error(std::format("missing value for {}", arg));
+        }
+        return argv[++i];
+      };
+
+      if (arg == "--size")
+      {
+        size = std::max(static_cast<uint32_t>(std::stoul(next())), 2u);
+      }
+      else if (arg == "--seed")
+      {
+        seed = std::stoull(next());
+      }
+      else if (arg == "--updates")
+      {
+        updates = static_cast<uint32_t>(std::stoul(next()));
+      }
+      else if (arg == "--tolerance")
+      {
+        tolerance = std::stod(next());
+      }
+      else if (arg == "--objects")
+      {
+        objects = static_cast<uint32_t>(std::stoul(next()));
+      }
+      else if (arg == "--help" || arg == "-h")
+      {
+        PrintUsage();
+        return 0;
+      }
+      else
+      {
+        throw std::runtime_error(std::format("unknown option '{}'", arg));
+      }
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << std::format("error: {}\n", e.what());
+    PrintUsage();
+    return 1;
+  }
+
+  if (!glfwInit())
+  {
+    std::cerr << "error: failed to initialize GLFW\n";
+    return 1;
+  }
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow* window = glfwCreateWindow(1, 1, "gpu_parity", nullptr, nullptr);
+  if (!window)
+  {
+    std::cerr << "error: failed to create an OpenGL 4.6 context\n";
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+
+  int result = 0;
+  try
+  {
+    if (gladLoadGL(glfwGetProcAddress) == 0)
+    {
+      throw std::runtime_error("failed to load OpenGL");
+    }
+    std::cout << std::format("renderer: {}\n", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+
+    const Erosion::GridParams gridParams{};
+    const Erosion::ThermalParams thermalParams{};
+
+    ThreadPool pool;
+    Erosion::Heightfield cpuMap(size, size);
+    Erosion::GenerateTerrain(cpuMap, {}, seed, pool);
+
+    GFX::ComputeEroder gpu(size, size, gridParams, thermalParams);
+    gpu.Upload(cpuMap);
+
+    // the same schedule as Simulation::Update in grid mode
+    Erosion::GridEroder grid(size, size, gridParams);
+    Erosion::ThermalEroder thermal(size, size, thermalParams);
+    for (uint32_t update = 1; update <= updates; update++)
+    {
+      for (uint32_t i = 0; i < gridParams.stepsPerUpdate; i++)
+      {
+        grid.Step(cpuMap, pool);
+      }
+      if (thermalParams.interval != 0 && update % thermalParams.interval == 0)
+      {
+        for (uint32_t i = 0; i < thermalParams.iterations; i++)
+        {
+          thermal.Step(cpuMap, pool);
+        }
+      }
+      gpu.Update();
+    }
+
+    Erosion::Heightfield cpuField(size, size);
+    Erosion::Heightfield gpuField;
+    const auto check = [&](std::string_view name, const Erosion::Heightfield& cpu, GFX::ComputeField field)
+    {
+      gpu.Download(field, gpuField);
+      const FieldDiff diff = Compare(cpu, gpuField);
+      const bool pass = diff.maxError <= tolerance;
+      std::cout << std::format("{:<10} range [{:.4g}, {:.4g}]  max error {:.3e}  rms error {:.3e}  {}\n",
+        name, diff.lo, diff.hi, diff.maxError, diff.rmsError, pass ? "ok" : "FAILED");
+      if (!pass)
+      {
+        result = 1;
+      }
+    };
+
+    check("terrain", cpuMap, GFX::ComputeField::TERRAIN);
+    std::copy(grid.Water().begin(), grid.Water().end(), cpuField.data.begin());
+    check("water", cpuField, GFX::ComputeField::WATER);
+    std::copy(grid.Sediment().begin(), grid.Sediment().end(), cpuField.data.begin());
+    check("sediment", cpuField, GFX::ComputeField::SEDIMENT);
+
+    for (bool occlusion : { false, true })
+    {
+      const CullDiff diff = CompareCulling(seed, objects, occlusion, pool);
+      const bool pass = diff.mismatches == 0 && diff.kernelMismatches == 0;
+      std::cout << std::format("{:<10} {} candidates, {} drawn, {} draws differ, {} differ between the {} and scalar kernels  {}\n",
+        occlusion ? "occlusion" : "frustum", diff.candidates, diff.drawn, diff.mismatches, diff.kernelMismatches,
+        GFX::ToString(diff.kernel), pass ? "ok" : "FAILED");
+      if (!pass)
+      {
+        result = 1;
+      }
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << std::format("error: {}\n", e.what());
+    result = 1;
+  }
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return result;
+}
\ No newline at end of file